@@ -0,0 +1,103 @@
+// bench_amac.cpp
+// resolveSongs on one thread with 1, 2, 4, ... lookups interleaved. Every lookup is a chain
+// of dependent loads (bucket, chain nodes, the song and its ancestors, the genre), so with
+// one walk at a time each hop waits for memory. The catalog is built so the forest is
+// deep: equal sized genres are merged pairwise level by level and nothing path-compresses
+// before the measurement. For scale, the first line measures one DRAM miss with a random
+// pointer chase.
+//
+// usage: ./bench_amac.out [songs=2000000] [lookups=2000000]
+
+#include "../dspotify25b2.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ns per load of a random cyclic pointer chase over 256MB
+static double dramMissNs() {
+    const size_t n = (256u << 20) / sizeof(size_t);
+    std::vector<size_t> next(n);
+    std::vector<size_t> order(n);
+    for(size_t i = 0; i < n; i++) {
+	order[i] = i;
+    }
+    std::mt19937_64 rng(1);
+    for(size_t i = n - 1; i > 0; i--) {
+	std::swap(order[i], order[rng() % (i + 1)]);
+    }
+    for(size_t i = 0; i < n; i++) {
+	next[order[i]] = order[(i + 1) % n];
+    }
+    const int loads = 4000000;
+    size_t cur = order[0];
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < loads; i++) {
+	cur = next[cur];
+    }
+    double ns = secondsSince(start) * 1e9 / loads;
+    return cur == n ? 0 : ns;
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 2000000;
+    const int lookups = argc > 2 ? atoi(argv[2]) : 2000000;
+    std::cout << "one DRAM miss (pointer chase): " << dramMissNs() << " ns\n";
+
+    const int genres = 4096;
+    DSpotify* ds = new DSpotify();
+    for(int g = 1; g <= genres; g++) {
+	ds->addGenre(g);
+    }
+    // songs in random id order, so neighbours in the forest are far apart in memory
+    std::vector<int> ids(songs);
+    for(int i = 0; i < songs; i++) {
+	ids[i] = i + 1;
+    }
+    std::mt19937 rng(2);
+    std::shuffle(ids.begin(), ids.end(), rng);
+    for(int i = 0; i < songs; i++) {
+	ds->addSong(ids[i], 1 + i % genres);
+    }
+    // merge level by level: every level puts half the trees one deeper
+    int first = 1;
+    int count = genres;
+    int nextGenre = genres + 1;
+    while(count > 1) {
+	int levelStart = nextGenre;
+	for(int g = first; g + 1 < first + count; g += 2) {
+	    ds->mergeGenres(g, g + 1, nextGenre++);
+	}
+	first = levelStart;
+	count /= 2;
+    }
+
+    std::vector<int> query(lookups);
+    for(int i = 0; i < lookups; i++) {
+	query[i] = 1 + rng() % songs;
+    }
+    std::vector<int> songGenres(lookups);
+    std::vector<int> songChanges(lookups);
+    double sequential = 0;
+    for(int width = 1; width <= 64; width *= 2) {
+	auto start = std::chrono::steady_clock::now();
+	ds->resolveSongs(query.data(), lookups, songGenres.data(), songChanges.data(), 1, false, width);
+	double ns = secondsSince(start) * 1e9 / lookups;
+	if(width == 1) {
+	    sequential = ns;
+	}
+	std::cout << "interleave " << width << ": " << ns << " ns/lookup (" << sequential / ns << "x)\n";
+    }
+    long long changes = 0;
+    for(int i = 0; i < lookups; i++) {
+	changes += songChanges[i];
+    }
+    std::cout << "average genre changes per song (about the depth walked): " << (double)changes / lookups << "\n";
+    delete ds;
+    return 0;
+}
@@ -0,0 +1,74 @@
+// bench_buildcatalog.cpp
+// Building the initial catalog: addGenre + addSong once per record (the hash tables grow
+// step by step) against buildFromCatalog with 1, 2, 4, 8 and 16 threads. The catalog is
+// generated: song ids shuffled, every song in a random genre. After each build a sample
+// of songs and every genre are checked against the sequential catalog.
+//
+// usage: ./bench_buildcatalog.out [songs=10000000] [genres=100000]
+
+#include "../dspotify25b2.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 10000000;
+    const int genres = argc > 2 ? atoi(argv[2]) : 100000;
+    std::vector<int> genreIds(genres);
+    for(int g = 0; g < genres; g++) {
+	genreIds[g] = g + 1;
+    }
+    std::vector<int> songIds(songs);
+    std::vector<int> songGenres(songs);
+    for(int s = 0; s < songs; s++) {
+	songIds[s] = s + 1;
+    }
+    std::mt19937 rng(1);
+    std::shuffle(songIds.begin(), songIds.end(), rng);
+    for(int s = 0; s < songs; s++) {
+	songGenres[s] = 1 + rng() % genres;
+    }
+
+    DSpotify* sequential = new DSpotify();
+    auto start = std::chrono::steady_clock::now();
+    for(int g = 0; g < genres; g++) {
+	sequential->addGenre(genreIds[g]);
+    }
+    for(int s = 0; s < songs; s++) {
+	sequential->addSong(songIds[s], songGenres[s]);
+    }
+    double base = secondsSince(start);
+    std::cout << songs << " songs, " << genres << " genres\n";
+    std::cout << "addGenre + addSong: " << base << " s\n";
+
+    std::vector<int> sample(100000);
+    for(size_t i = 0; i < sample.size(); i++) {
+	sample[i] = 1 + rng() % songs;
+    }
+    for(int threads = 1; threads <= 16; threads *= 2) {
+	DSpotify* built = new DSpotify();
+	start = std::chrono::steady_clock::now();
+	StatusType st = built->buildFromCatalog(genreIds.data(), genres, songIds.data(), songGenres.data(), songs,
+						threads);
+	double sec = secondsSince(start);
+	int mismatches = st == StatusType::SUCCESS ? 0 : 1;
+	for(int id : sample) {
+	    mismatches += built->getSongGenre(id).ans() != sequential->getSongGenre(id).ans();
+	    mismatches += built->getNumberOfGenreChanges(id).ans() != sequential->getNumberOfGenreChanges(id).ans();
+	}
+	for(int g = 1; g <= genres; g++) {
+	    mismatches += built->getNumberOfSongsByGenre(g).ans() != sequential->getNumberOfSongsByGenre(g).ans();
+	}
+	std::cout << "buildFromCatalog, " << threads << " threads: " << sec << " s (" << base / sec << "x)"
+		  << (mismatches == 0 ? "" : " MISMATCH") << "\n";
+	delete built;
+    }
+    delete sequential;
+    return 0;
+}
@@ -0,0 +1,75 @@
+// bench_churn.cpp
+// Steady-state churn: every round adds a batch of genres and songs, merges some of the
+// new genres, then retires the songs and the emptied genres of an older round. With
+// removeSong/removeGenre the resident memory should level off instead of growing.
+//
+// usage: ./bench_churn.out [rounds=40] [songsPerRound=200000] [genresPerRound=2000] [keepRounds=3]
+
+#include "../dspotify25b2.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static long residentKb() {
+    long pages = 0;
+    long resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(f == nullptr) {
+	return -1;
+    }
+    if(fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+	resident = -1;
+    }
+    fclose(f);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char** argv) {
+    const int rounds = argc > 1 ? atoi(argv[1]) : 40;
+    const int songsPerRound = argc > 2 ? atoi(argv[2]) : 200000;
+    const int genresPerRound = argc > 3 ? atoi(argv[3]) : 2000;
+    const int keepRounds = argc > 4 ? atoi(argv[4]) : 3;
+
+    std::mt19937 rng(11);
+    DSpotify* ds = new DSpotify();
+    // genre ids of round r: [r*2*genresPerRound + 1, ...), the second half is for merges
+    auto firstGenre = [&](int r) { return r * 2 * genresPerRound + 1; };
+
+    auto start = std::chrono::steady_clock::now();
+    long long ops = 0;
+    for(int r = 0; r < rounds; r++) {
+	int g0 = firstGenre(r);
+	for(int g = 0; g < genresPerRound; g++) {
+	    ds->addGenre(g0 + g);
+	}
+	for(int s = 0; s < songsPerRound; s++) {
+	    ds->addSong(r * songsPerRound + s + 1, g0 + rng() % genresPerRound);
+	}
+	for(int m = 0; m < genresPerRound / 2; m++) {
+	    ds->mergeGenres(g0 + 2 * m, g0 + 2 * m + 1, g0 + genresPerRound + m);
+	}
+	ops += genresPerRound + songsPerRound + genresPerRound / 2;
+
+	int old = r - keepRounds;
+	if(old >= 0) {
+	    for(int s = 0; s < songsPerRound; s++) {
+		ds->removeSong(old * songsPerRound + s + 1);
+	    }
+	    for(int g = firstGenre(old); g < firstGenre(old + 1); g++) {
+		ds->removeGenre(g);
+	    }
+	    ops += songsPerRound + 2 * genresPerRound;
+	}
+	std::cout << "round " << r << ": rss " << residentKb() / 1024 << " MB\n";
+    }
+    double sec = secondsSince(start);
+    std::cout << ops / sec / 1e6 << " Mops/s over " << ops << " operations\n";
+    delete ds;
+    return 0;
+}
@@ -0,0 +1,75 @@
+// bench_denseids.cpp
+// Hashed vs direct-addressed (setDenseIdRange) song and genre tables on
+//  - dense ids 1..songs, all inside the configured range: no hashing at all,
+//  - sparse random ids up to 2^31, almost all outside the range: the fallback path, which
+//    should cost the hashed table plus one range check.
+// Lookups are getSongGenre on random existing songs, after merging the genres pairwise.
+//
+// usage: ./bench_denseids.out [songs=1000000] [lookups=5000000]
+
+#include "../dspotify25b2.h"
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run(const char* label, const std::vector<int>& ids, bool denseMode, int lookups) {
+    const int genres = 1000;
+    DSpotify* ds = new DSpotify();
+    if(denseMode) {
+	ds->setDenseIdRange((int)ids.size(), 2 * genres);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for(int g = 1; g <= genres; g++) {
+	ds->addGenre(g);
+    }
+    for(size_t i = 0; i < ids.size(); i++) {
+	ds->addSong(ids[i], 1 + i % genres);
+    }
+    int next = genres + 1;
+    for(int g = 1; g + 1 <= genres; g += 2) {
+	ds->mergeGenres(g, g + 1, next++);
+    }
+    double build = secondsSince(start);
+
+    std::mt19937 rng(9);
+    long long sink = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+	sink += ds->getSongGenre(ids[rng() % ids.size()]).ans();
+    }
+    double sec = secondsSince(start);
+    std::cout << label << (denseMode ? " ids, dense mode: " : " ids, hashed:     ")
+	      << "build " << build << " s, " << sec * 1e9 / lookups << " ns/lookup"
+	      << (sink == -1 ? "!" : "") << "\n";
+    delete ds;
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int lookups = argc > 2 ? atoi(argv[2]) : 5000000;
+    std::vector<int> denseIds(songs);
+    for(int i = 0; i < songs; i++) {
+	denseIds[i] = i + 1;
+    }
+    std::mt19937 rng(4);
+    std::shuffle(denseIds.begin(), denseIds.end(), rng);
+    // one random id per block of the positive range, so they are distinct
+    std::vector<int> sparseIds(songs);
+    const long long block = 2147483000LL / songs;
+    for(int i = 0; i < songs; i++) {
+	sparseIds[i] = (int)(1 + i * block + rng() % block);
+    }
+    std::shuffle(sparseIds.begin(), sparseIds.end(), rng);
+
+    run("dense", denseIds, false, lookups);
+    run("dense", denseIds, true, lookups);
+    run("sparse", sparseIds, false, lookups);
+    run("sparse", sparseIds, true, lookups);
+    return 0;
+}
@@ -0,0 +1,73 @@
+// bench_findmany.cpp
+// Compares one-at-a-time HashTable::find against the batched, prefetching
+// HashTable::findMany on a table that is (by default) much larger than LLC.
+//
+// usage: ./bench_findmany.out [entries=8000000] [queries=8000000] [batch=256]
+
+#include "../hashtable_chainhashing.h"
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+static int key2int(const int& k) {
+    return k;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const int entries = argc > 1 ? atoi(argv[1]) : 8000000;
+    const int queries = argc > 2 ? atoi(argv[2]) : 8000000;
+    const int batch = argc > 3 ? atoi(argv[3]) : 256;
+
+    std::mt19937 rng(12345);
+    HashTable<int,int> table(key2int);
+    int* ids = new int[entries];
+    for(int i = 0; i<entries; i++) {
+	ids[i] = (int)(rng() & 0x3fffffff) + 1;
+	table.insert(ids[i],i);
+    }
+    int* keys = new int[queries];
+    for(int i = 0; i<queries; i++) {
+	// 90% hits, 10% (almost certainly) misses
+	keys[i] = (rng() % 10) ? ids[rng() % entries] : -(int)(rng() & 0x3fffffff);
+    }
+
+    long long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i<queries; i++) {
+	if(table.contains(keys[i])) {
+	    sum += table.find(keys[i]);
+	}
+    }
+    double single = secondsSince(start);
+
+    long long sumMany = 0;
+    int** out = new int*[batch];
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i<queries; i += batch) {
+	size_t cnt = (queries - i < batch) ? queries - i : batch;
+	table.findMany(keys + i,cnt,out);
+	for(size_t j = 0; j<cnt; j++) {
+	    if(out[j] != nullptr) {
+		sumMany += *out[j];
+	    }
+	}
+    }
+    double many = secondsSince(start);
+
+    std::cout << "entries=" << entries << " queries=" << queries << " batch=" << batch << "\n";
+    std::cout << "contains+find: " << queries / single / 1e6 << " Mlookups/s\n";
+    std::cout << "findMany:      " << queries / many / 1e6 << " Mlookups/s\n";
+    std::cout << "speedup:       " << single / many << "x\n";
+    if(sum != sumMany) {
+	std::cout << "checksum mismatch!\n";
+	return 1;
+    }
+    delete[] out;
+    delete[] keys;
+    delete[] ids;
+    return 0;
+}
@@ -0,0 +1,123 @@
+// bench_hashflood.cpp
+// Plain (Fibonacci hash) vs hardened (seeded mixing + sorted bins) HashTable on
+//  - random keys: the normal-case cost of hardening,
+//  - Fibonacci-colliding keys (see tools/gen_workload.cpp --mode collide): the attack
+//    on the unseeded hash, which the seeded hash spreads out again,
+//  - a degenerate key2int that maps everything to 3 values: collisions no seed can
+//    avoid, where only the sorted bins keep lookups logarithmic. inserts and erases
+//    there are still O(n) each (the bin is a flat array, and an erase walks the chain
+//    to unlink its node): this case is also run with 4x the keys, where the hardened
+//    ns/insert and ns/erase grow with the bucket size while ns/lookup barely moves.
+//
+// usage: ./bench_hashflood.out [keys=40000] [lookups=2000000]
+
+#include "../hashtable_chainhashing.h"
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int identityKey(const int& k) {
+    return k;
+}
+
+static int degenerateKey(const int& k) {
+    return k % 3;
+}
+
+// ids whose frac(id * (sqrt(5)-1)/2) is below delta, found the same way as in gen_workload
+static void collidingKeys(int* out, int n) {
+    static long double multiplier = 0.5 * (sqrt(5) - 1);
+    long double delta = 1.0L / (2 * n + 2);
+    if(delta < 2.0L * n / 2147483647.0L) {
+	delta = 2.0L * n / 2147483647.0L;
+    }
+    long long fib[45] = {1, 2};
+    for(int i = 2; i < 45; i++) {
+	fib[i] = fib[i-1] + fib[i-2];
+    }
+    long long cur = 0;
+    for(int c = 0; c < n; c++) {
+	for(int i = 0; i < 45; i++) {
+	    long double scaled = multiplier * (cur + fib[i]);
+	    if(scaled - floorl(scaled) < delta) {
+		cur += fib[i];
+		break;
+	    }
+	}
+	out[c] = (int)cur;
+    }
+}
+
+static void run(const char* name, int (*key2int)(const int&), bool hardened, const int* keys, int n, int lookups) {
+    std::mt19937 rng(1);
+    HashTable<int,int> table(key2int, 0, hardened);
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i++) {
+	table.insert(keys[i], i);
+    }
+    double insertSec = secondsSince(start);
+    long long sum = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+	int k = keys[rng() % n];
+	if(table.contains(k)) {
+	    sum += table.find(k);
+	}
+    }
+    double lookupSec = secondsSince(start);
+    int longest = 0;
+    for(int b = 0; b < table.capacity; b++) {
+	int len = 0;
+	for(hashtable::Node<int,int>* it = table.table[b].next; it != nullptr; it = it->next) {
+	    len++;
+	}
+	longest = len > longest ? len : longest;
+    }
+    // every other key, so the table (and its bins) stay large throughout
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < n; i += 2) {
+	table.deleteEntry(keys[i]);
+    }
+    double eraseSec = secondsSince(start);
+    std::cout << name << (hardened ? " hardened: " : " plain:    ") << insertSec / n * 1e9 << " ns/insert, "
+	      << eraseSec / ((n + 1) / 2) * 1e9 << " ns/erase, " << lookupSec / lookups * 1e9 << " ns/lookup, longest chain "
+	      << longest << " (checksum " << sum % 1000 << ")\n";
+}
+
+int main(int argc, char** argv) {
+    const int n = argc > 1 ? atoi(argv[1]) : 40000;
+    const int lookups = argc > 2 ? atoi(argv[2]) : 2000000;
+
+    int* keys = new int[n];
+    std::mt19937 rng(2);
+    for(int i = 0; i < n; i++) {
+	keys[i] = (int)(rng() & 0x7ffffffe) + 1;
+    }
+    run("random     ", identityKey, false, keys, n, lookups);
+    run("random     ", identityKey, true, keys, n, lookups);
+
+    collidingKeys(keys, n);
+    // the plain table is quadratic here, so it gets fewer lookups
+    run("fibonacci  ", identityKey, false, keys, n, lookups / 100);
+    run("fibonacci  ", identityKey, true, keys, n, lookups);
+
+    for(int i = 0; i < n; i++) {
+	keys[i] = i + 1;
+    }
+    run("degenerate ", degenerateKey, false, keys, n, lookups / 100);
+    run("degenerate ", degenerateKey, true, keys, n, lookups);
+    delete[] keys;
+
+    // the flat bins make a flooded bucket's inserts and erases linear in its size
+    keys = new int[4 * n];
+    for(int i = 0; i < 4 * n; i++) {
+	keys[i] = i + 1;
+    }
+    run("degenerate4", degenerateKey, true, keys, 4 * n, lookups);
+    delete[] keys;
+    return 0;
+}
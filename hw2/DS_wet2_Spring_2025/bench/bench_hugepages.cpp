@@ -0,0 +1,57 @@
+// bench_hugepages.cpp
+// Random getSongGenre lookups on a large catalog, with the song table and the Song
+// objects on regular pages, on transparent huge pages and on reserved (hugetlb) pages.
+// The lookups are dominated by TLB and cache misses once the catalog is far bigger than
+// the TLB reach of 4K pages. Each line reports the backing that was actually obtained:
+// without reserved pages (vm.nr_hugepages) HUGETLB falls back to transparent, and
+// transparent is only advised, check AnonHugePages in /proc/meminfo to see it applied.
+//
+// usage: ./bench_hugepages.out [songs=2000000] [lookups=5000000]
+
+#include "../dspotify25b2.h"
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void run(hugepages::Backing want, int songs, int lookups) {
+    DSpotify* ds = new DSpotify(want);
+    const int genres = 1000;
+    for(int g = 1; g <= genres; g++) {
+	ds->addGenre(g);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for(int s = 1; s <= songs; s++) {
+	ds->addSong(s, 1 + s % genres);
+    }
+    double build = secondsSince(start);
+    // merge down to a few genres so lookups also walk the forest
+    int next = genres + 1;
+    for(int g = 1; g + 1 <= genres; g += 2) {
+	ds->mergeGenres(g, g + 1, next++);
+    }
+
+    std::mt19937 rng(11);
+    long long sink = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < lookups; i++) {
+	sink += ds->getSongGenre(1 + rng() % songs).ans();
+    }
+    double sec = secondsSince(start);
+    std::cout << "requested " << hugepages::name(want) << ", got " << hugepages::name(ds->pageBacking())
+	      << ": build " << build << " s, " << sec * 1e9 / lookups << " ns/lookup"
+	      << (sink == -1 ? "!" : "") << "\n";
+    delete ds;
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 2000000;
+    const int lookups = argc > 2 ? atoi(argv[2]) : 5000000;
+    run(hugepages::Backing::DEFAULT, songs, lookups);
+    run(hugepages::Backing::TRANSPARENT, songs, lookups);
+    run(hugepages::Backing::HUGETLB, songs, lookups);
+    return 0;
+}
@@ -0,0 +1,112 @@
+// bench_members.cpp
+// Cost and payoff of the per-genre member lists:
+//  - memory: the two list pointers per Song (and one per Genre), next to the process RSS,
+//  - merge throughput: mergeGenres splices the two lists in O(1),
+//  - enumeration: forEachSongInGenre and paging vs the only way without the lists,
+//    resolving every song of the catalog and keeping those of the genre.
+//
+// usage: ./bench_members.out [songs=2000000] [genres=20000]
+
+#include "../dspotify25b2.h"
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <vector>
+#include <unistd.h>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double rssMB() {
+    std::ifstream in("/proc/self/statm");
+    long long pages = 0;
+    long long resident = 0;
+    in >> pages >> resident;
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+static void count(int songId, void* ctx) {
+    *static_cast<long long*>(ctx) += songId;
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 2000000;
+    const int genres = argc > 2 ? atoi(argv[2]) : 20000;
+    double before = rssMB();
+    DSpotify* ds = new DSpotify();
+    for(int g = 1; g <= genres; g++) {
+	ds->addGenre(g);
+    }
+    for(int s = 1; s <= songs; s++) {
+	ds->addSong(s, 1 + s % genres);
+    }
+    double catalog = rssMB() - before;
+    double lists = (2.0 * sizeof(DSpotify::Song*) * songs + sizeof(DSpotify::Song*) * genres) / (1024.0 * 1024.0);
+    std::cout << "catalog: " << catalog << " MB RSS, member lists " << lists << " MB of it ("
+	      << 100.0 * lists / catalog << "%), sizeof(Song) " << sizeof(DSpotify::Song) << "\n";
+
+    // merge everything down to one genre, pairing them up like a tournament
+    std::deque<int> pending;
+    for(int g = 1; g <= genres; g++) {
+	pending.push_back(g);
+    }
+    int next = genres + 1;
+    int merges = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(pending.size() > 1) {
+	int a = pending.front();
+	pending.pop_front();
+	int b = pending.front();
+	pending.pop_front();
+	ds->mergeGenres(a, b, next);
+	pending.push_back(next++);
+	merges++;
+    }
+    double sec = secondsSince(start);
+    std::cout << merges << " merges: " << merges / sec / 1e6 << " M merges/s\n";
+
+    int last = next - 1;
+    long long sum = 0;
+    start = std::chrono::steady_clock::now();
+    ds->forEachSongInGenre(last, count, &sum);
+    std::cout << "forEachSongInGenre (" << ds->getNumberOfSongsByGenre(last).ans() << " songs): "
+	      << secondsSince(start) * 1e3 << " ms\n";
+
+    std::vector<int> page(1000);
+    int cursor = 0;
+    int pages = 0;
+    start = std::chrono::steady_clock::now();
+    do {
+	int nextCursor = 0;
+	if(ds->getGenreSongsPage(last, cursor, (int)page.size(), page.data(), &nextCursor).status() != StatusType::SUCCESS) {
+	    break;
+	}
+	cursor = nextCursor;
+	pages++;
+    } while(cursor != 0);
+    std::cout << "getGenreSongsPage, " << pages << " pages of " << page.size() << ": "
+	      << secondsSince(start) * 1e3 << " ms\n";
+
+    // the genre of a small, unmerged genre: added after the merges
+    ds->addGenre(next);
+    for(int s = songs + 1; s <= songs + 100; s++) {
+	ds->addSong(s, next);
+    }
+    start = std::chrono::steady_clock::now();
+    sum = 0;
+    ds->forEachSongInGenre(next, count, &sum);
+    double listed = secondsSince(start);
+    start = std::chrono::steady_clock::now();
+    long long scanned = 0;
+    for(int s = 1; s <= songs + 100; s++) {
+	if(ds->getSongGenre(s).ans() == next) {
+	    scanned += s;
+	}
+    }
+    std::cout << "100 song genre: list " << listed * 1e6 << " us, catalog scan " << secondsSince(start) * 1e3
+	      << " ms" << (scanned == sum ? "" : " (MISMATCH)") << "\n";
+    delete ds;
+    return 0;
+}
@@ -0,0 +1,87 @@
+// bench_readview.cpp
+// Writer throughput (addSong/mergeGenres with periodic publishReadView) with and
+// without reader threads that keep scanning the latest published ReadView. Readers never
+// wait; the writer pays O(log n) per mutation to keep the versioned maps and O(1) per
+// publish. The longest single mutation is reported as the writer's pause.
+//
+// usage: ./bench_readview.out [mutations=2000000] [publishInterval=250000] [maxReaders=2]
+
+#include "../dspotify25b2.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct ScanState {
+    long long songs;
+    long long genreSum;
+};
+
+static void countSong(int songId, int genreId, int changes, void* ctx) {
+    ScanState* st = (ScanState*)ctx;
+    st->songs++;
+    st->genreSum += genreId + changes + songId;
+}
+
+static void reader(const DSpotify* ds, std::atomic<bool>* stop, std::atomic<long long>* scanned) {
+    while(!stop->load()) {
+	shared_ptr<const ReadView> view = ds->openReadView();
+	ScanState st = {0, 0};
+	view->forEachSong(countSong, &st);
+	scanned->fetch_add(st.songs);
+    }
+}
+
+int main(int argc, char** argv) {
+    const int mutations = argc > 1 ? atoi(argv[1]) : 2000000;
+    const int interval = argc > 2 ? atoi(argv[2]) : 250000;
+    const int maxReaders = argc > 3 ? atoi(argv[3]) : 2;
+    const int numGenres = 10000;
+
+    for(int readers = 0; readers <= maxReaders; readers++) {
+	std::mt19937 rng(5);
+	DSpotify* ds = new DSpotify();
+	ds->setReadViewInterval(interval);
+	std::atomic<bool> stop(false);
+	std::atomic<long long> scanned(0);
+	std::thread* threads = new std::thread[readers];
+	for(int r = 0; r < readers; r++) {
+	    threads[r] = std::thread(reader, ds, &stop, &scanned);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	int nextGenre = 1;
+	for(; nextGenre <= numGenres; nextGenre++) {
+	    ds->addGenre(nextGenre);
+	}
+	double longest = 0;
+	for(int m = 1; m <= mutations; m++) {
+	    auto before = std::chrono::steady_clock::now();
+	    if(m % 1000 == 0) {
+		int g1 = 1 + rng() % (nextGenre - 1);
+		int g2 = 1 + rng() % (nextGenre - 1);
+		int g3 = nextGenre++;
+		ds->mergeGenres(g1, g2, g3);
+	    } else {
+		ds->addSong(m, 1 + rng() % (nextGenre - 1));
+	    }
+	    longest = std::max(longest, secondsSince(before));
+	}
+	double sec = secondsSince(start);
+	stop = true;
+	for(int r = 0; r < readers; r++) {
+	    threads[r].join();
+	}
+	std::cout << "readers=" << readers << ": writer " << mutations / sec / 1e6 << " Mmutations/s, readers scanned "
+		  << scanned.load() / sec / 1e6 << " Msongs/s, longest writer pause " << longest * 1e3 << " ms\n";
+	delete[] threads;
+	delete ds;
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+// bench_resolve.cpp
+// Thread scaling of DSpotify::resolveSongs on a generated catalog, compared with
+// resolving the same ids one by one through getSongGenre/getNumberOfGenreChanges.
+//
+// usage: ./bench_resolve.out [songs=4000000] [genres=20000] [merges=15000] [maxThreads=16]
+
+#include "../dspotify25b2.h"
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// builds the catalog again for every run, so each run starts from uncompressed trees
+static DSpotify* buildCatalog(int numSongs, int numGenres, int numMerges) {
+    std::mt19937 rng(7);
+    DSpotify* ds = new DSpotify();
+    for(int g = 1; g <= numGenres; g++) {
+	ds->addGenre(g);
+    }
+    int nextGenre = numGenres + 1;
+    int mergeEvery = numSongs / (numMerges + 1) + 1;
+    for(int s = 1; s <= numSongs; s++) {
+	ds->addSong(s, 1 + rng() % (nextGenre - 1));
+	if(s % mergeEvery == 0) {
+	    int g1 = 1 + rng() % (nextGenre - 1);
+	    int g2 = 1 + rng() % (nextGenre - 1);
+	    if(ds->mergeGenres(g1, g2, nextGenre) == StatusType::SUCCESS) {
+		nextGenre++;
+	    }
+	}
+    }
+    return ds;
+}
+
+int main(int argc, char** argv) {
+    const int numSongs = argc > 1 ? atoi(argv[1]) : 4000000;
+    const int numGenres = argc > 2 ? atoi(argv[2]) : 20000;
+    const int numMerges = argc > 3 ? atoi(argv[3]) : 15000;
+    const int maxThreads = argc > 4 ? atoi(argv[4]) : 16;
+
+    int* ids = new int[numSongs];
+    for(int i = 0; i < numSongs; i++) {
+	ids[i] = i + 1;
+    }
+    std::mt19937 rng(99);
+    for(int i = numSongs - 1; i > 0; i--) {
+	int j = rng() % (i + 1);
+	int tmp = ids[i];
+	ids[i] = ids[j];
+	ids[j] = tmp;
+    }
+    int* genres = new int[numSongs];
+    int* changes = new int[numSongs];
+
+    std::cout << "songs=" << numSongs << " hardware threads=" << std::thread::hardware_concurrency() << "\n";
+
+    DSpotify* ds = buildCatalog(numSongs, numGenres, numMerges);
+    auto start = std::chrono::steady_clock::now();
+    long long checksum = 0;
+    for(int i = 0; i < numSongs; i++) {
+	checksum += ds->getSongGenre(ids[i]).ans() + ds->getNumberOfGenreChanges(ids[i]).ans();
+    }
+    double sequential = secondsSince(start);
+    std::cout << "one by one:        " << numSongs / sequential / 1e6 << " Msongs/s\n";
+    delete ds;
+
+    ds = buildCatalog(numSongs, numGenres, numMerges);
+    for(int threads = 1; threads <= maxThreads; threads *= 2) {
+	start = std::chrono::steady_clock::now();
+	ds->resolveSongs(ids, numSongs, genres, changes, threads);
+	double sec = secondsSince(start);
+	long long sum = 0;
+	for(int i = 0; i < numSongs; i++) {
+	    sum += genres[i] + changes[i];
+	}
+	std::cout << "resolveSongs t=" << threads << ": " << numSongs / sec / 1e6 << " Msongs/s"
+		  << (sum == checksum ? "" : "  (checksum mismatch!)") << "\n";
+    }
+    delete ds;
+    delete[] changes;
+    delete[] genres;
+    delete[] ids;
+    return 0;
+}
@@ -0,0 +1,104 @@
+// bench_shared.cpp
+// Memory and read throughput of one SharedDSpotify segment serving several reader
+// processes, against every process building its own DSpotify. The writer keeps adding
+// songs and merging genres while the readers run, so the seqlock retries are included.
+//
+// usage: ./bench_shared.out [songs=1000000] [readers=4] [lookups=2000000]
+
+#include "../dspotify25b2.h"
+#include "../shareddspotify.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double rssMB() {
+    std::ifstream in("/proc/self/statm");
+    long long pages = 0;
+    long long resident = 0;
+    in >> pages >> resident;
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int readers = argc > 2 ? atoi(argv[2]) : 4;
+    const int lookups = argc > 3 ? atoi(argv[3]) : 2000000;
+    const int genres = 1000;
+    const char* name = "/dspotify_bench_shared";
+
+    // what one private copy costs
+    double before = rssMB();
+    DSpotify* priv = new DSpotify();
+    for(int g = 1; g <= genres; g++) {
+	priv->addGenre(g);
+    }
+    for(int s = 1; s <= songs; s++) {
+	priv->addSong(s, 1 + s % genres);
+    }
+    double privateMB = rssMB() - before;
+    delete priv;
+
+    SharedDSpotify writer;
+    // room for the songs and genres added while the readers run
+    if(writer.create(name, 2 * songs, 4 * genres) != StatusType::SUCCESS) {
+	std::cout << "could not create " << name << "\n";
+	return 1;
+    }
+    for(int g = 1; g <= genres; g++) {
+	writer.addGenre(g);
+    }
+    for(int s = 1; s <= songs; s++) {
+	writer.addSong(s, 1 + s % genres);
+    }
+    double sharedMB = writer.segmentBytes() / (1024.0 * 1024.0);
+    std::cout << readers << " readers: " << readers * privateMB << " MB as private copies ("
+	      << privateMB << " MB each), " << sharedMB << " MB as one shared segment" << std::endl;
+
+    for(int r = 0; r < readers; r++) {
+	if(fork() == 0) {
+	    SharedDSpotify reader;
+	    if(reader.attach(name) != StatusType::SUCCESS) {
+		_exit(1);
+	    }
+	    std::mt19937 rng(r);
+	    long long sink = 0;
+	    auto start = std::chrono::steady_clock::now();
+	    for(int i = 0; i < lookups; i++) {
+		sink += reader.getSongGenre(1 + rng() % songs).ans();
+	    }
+	    double sec = secondsSince(start);
+	    std::cout << "  reader " << r << ": " << lookups / sec / 1e6 << " M getSongGenre/s"
+		      << (sink == -1 ? "!" : "") << std::endl;
+	    _exit(0);
+	}
+    }
+    // keep writing until every reader is done
+    int nextSong = songs + 1;
+    int nextGenre = genres + 1;
+    long long writes = 0;
+    int running = readers;
+    std::mt19937 rng(99);
+    auto start = std::chrono::steady_clock::now();
+    while(running > 0) {
+	for(int i = 0; i < 100 && nextSong < 2 * songs; i++, writes++) {
+	    writer.addSong(nextSong++, 1 + rng() % genres);
+	}
+	if(nextGenre < 4 * genres) {
+	    writer.addGenre(nextGenre++);
+	}
+	int status = 0;
+	while(running > 0 && waitpid(-1, &status, WNOHANG) > 0) {
+	    running--;
+	}
+    }
+    std::cout << "  writer meanwhile: " << writes / secondsSince(start) / 1e6 << " M addSong/s\n";
+    SharedDSpotify::remove(name);
+    return 0;
+}
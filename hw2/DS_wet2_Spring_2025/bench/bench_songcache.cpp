@@ -0,0 +1,134 @@
+// bench_songcache.cpp
+// The song result cache under Zipf-distributed queries (a few hit songs take most of
+// them): getSongGenre / getNumberOfGenreChanges latency and hit rate without the cache
+// and with a few cache sizes, then the same queries interleaved with mergeGenres (every
+// merge invalidates the whole cache) at several rates, and what the cache costs a merge.
+//
+// usage: ./bench_songcache.out [songs=2000000] [genres=20000] [queries=10000000] [zipf=1.0]
+
+#include "../dspotify25b2.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// a fresh catalog: genres 1..genres, songs 1..songs spread over them
+static DSpotify* makeCatalog(int songs, int genres, int cacheEntries) {
+    DSpotify* ds = new DSpotify();
+    ds->setSongCacheSize(cacheEntries);
+    for(int g = 1; g <= genres; g++) {
+	ds->addGenre(g);
+    }
+    for(int s = 1; s <= songs; s++) {
+	ds->addSong(s, 1 + s % genres);
+    }
+    return ds;
+}
+
+// runs the queries (even ones getSongGenre, odd ones getNumberOfGenreChanges), merging two
+// genres every mergeEvery queries (0: never). returns ns per query
+static double run(DSpotify* ds, const std::vector<int>& queries, int mergeEvery, int genres, long long* sink) {
+    int nextGenre = genres + 1;
+    int mergeA = 1;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < queries.size(); i++) {
+	if(i % 2 == 0) {
+	    *sink += ds->getSongGenre(queries[i]).ans();
+	} else {
+	    *sink += ds->getNumberOfGenreChanges(queries[i]).ans();
+	}
+	if(mergeEvery > 0 && (i + 1) % mergeEvery == 0) {
+	    // merge the next two of the original genres into a new one
+	    if(ds->mergeGenres(mergeA, mergeA + 1, nextGenre) == StatusType::SUCCESS) {
+		nextGenre++;
+	    }
+	    mergeA = mergeA + 2 < genres ? mergeA + 2 : 1;
+	}
+    }
+    return secondsSince(start) * 1e9 / queries.size();
+}
+
+static void report(const char* label, DSpotify* ds, double ns) {
+    long long hits = 0;
+    long long misses = 0;
+    ds->songCacheStats(&hits, &misses);
+    std::cout << label << ": " << ns << " ns/query";
+    if(hits + misses > 0) {
+	std::cout << ", hit rate " << 100.0 * hits / (hits + misses) << "%";
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 2000000;
+    const int genres = argc > 2 ? atoi(argv[2]) : 20000;
+    const int count = argc > 3 ? atoi(argv[3]) : 10000000;
+    const double zipf = argc > 4 ? atof(argv[4]) : 1.0;
+
+    // song of popularity rank r is rankToSong[r], so the hit songs are spread over the ids
+    std::vector<int> rankToSong(songs);
+    for(int s = 0; s < songs; s++) {
+	rankToSong[s] = s + 1;
+    }
+    std::mt19937 rng(11);
+    std::shuffle(rankToSong.begin(), rankToSong.end(), rng);
+    std::vector<double> cdf(songs);
+    double total = 0;
+    for(int r = 0; r < songs; r++) {
+	total += 1.0 / pow(r + 1, zipf);
+	cdf[r] = total;
+    }
+    std::uniform_real_distribution<double> uniform(0, total);
+    std::vector<int> queries(count);
+    for(int i = 0; i < count; i++) {
+	size_t r = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+	queries[i] = rankToSong[std::min(r, (size_t)songs - 1)];
+    }
+    std::cout << songs << " songs, " << genres << " genres, " << count << " queries, zipf " << zipf << "\n";
+
+    long long sink = 0;
+    const int sizes[] = {0, 4096, 65536, 1 << 20};
+    for(int entries : sizes) {
+	DSpotify* ds = makeCatalog(songs, genres, entries);
+	double ns = run(ds, queries, 0, genres, &sink);
+	std::string label = entries == 0 ? "no cache" : "cache of " + std::to_string(entries) + " entries";
+	report(label.c_str(), ds, ns);
+	delete ds;
+    }
+
+    std::cout << "with merges (cache of 65536 entries vs none):\n";
+    const int rates[] = {100000, 10000, 1000, 100};
+    for(int every : rates) {
+	DSpotify* plain = makeCatalog(songs, genres, 0);
+	DSpotify* cached = makeCatalog(songs, genres, 65536);
+	double base = run(plain, queries, every, genres, &sink);
+	double ns = run(cached, queries, every, genres, &sink);
+	std::string label = "  1 merge per " + std::to_string(every) + " queries: " + std::to_string(base)
+	    + " ns/query without, with";
+	report(label.c_str(), cached, ns);
+	delete plain;
+	delete cached;
+    }
+
+    // the mutation side: a merge only bumps the epoch, time the merges alone
+    for(int entries : {0, 65536}) {
+	DSpotify* ds = makeCatalog(songs, genres, entries);
+	int merges = 0;
+	auto start = std::chrono::steady_clock::now();
+	for(int g = 1; g + 1 <= genres; g += 2) {
+	    merges += ds->mergeGenres(g, g + 1, genres + g) == StatusType::SUCCESS;
+	}
+	double ns = secondsSince(start) * 1e9 / merges;
+	std::cout << "mergeGenres, " << (entries == 0 ? "no cache" : "cache of 65536 entries") << ": " << ns
+		  << " ns/merge\n";
+	delete ds;
+    }
+    std::cout << "(checksum " << sink << ")\n";
+    return 0;
+}
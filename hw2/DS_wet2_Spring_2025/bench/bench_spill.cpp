@@ -0,0 +1,147 @@
+// bench_spill.cpp
+// SpilledDSpotify with its page cache at 1:1, 1:4 and 1:16 of the catalog's file: build
+// (addSong in random id order, then rounds of mergeGenres so the trees get deep), then
+// queries with uniform song ids and with Zipf-distributed ones (a few hit songs take most
+// of them). Reports ops/s, the page hit rate and the pages written back, and checks every
+// answer against an in-memory DSpotify (timed with the queries, it is cheap next to a
+// page miss). The file is opened with O_DIRECT, so the reads and writes reach the disk
+// instead of the kernel's page cache.
+//
+// usage: ./bench_spill.out [songs=1000000] [queries=1000000] [zipf=1.0] [file=bench_spill.dat]
+
+#include "../dspotify25b2.h"
+#include "../spilleddspotify.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static const int genres = 1024;
+
+struct BuildRates {
+    double adds;
+    double merges;
+};
+
+// adds the genres and songs to c, then merges the genres pairwise in rounds. returns the
+// ops/s of the adds and of the merges
+template<class Catalog>
+static BuildRates build(Catalog& c, const std::vector<int>& ids) {
+    BuildRates rates;
+    for(int g = 1; g <= genres; g++) {
+	c.addGenre(g);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < ids.size(); i++) {
+	c.addSong(ids[i], 1 + (int)(i % genres));
+    }
+    rates.adds = ids.size() / secondsSince(start);
+    // genres 1..1024 merge into 1025..1536, those into 1537..1792, and so on
+    start = std::chrono::steady_clock::now();
+    int merges = 0;
+    int first = 1;
+    int count = genres;
+    while(count > 1) {
+	for(int i = 0; i < count; i += 2) {
+	    c.mergeGenres(first + i, first + i + 1, first + count + i / 2);
+	    merges++;
+	}
+	first += count;
+	count /= 2;
+    }
+    rates.merges = merges / secondsSince(start);
+    return rates;
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int count = argc > 2 ? atoi(argv[2]) : 1000000;
+    const double zipf = argc > 3 ? atof(argv[3]) : 1.0;
+    const char* path = argc > 4 ? argv[4] : "bench_spill.dat";
+
+    std::mt19937 rng(5);
+    std::vector<int> ids(songs);
+    for(int s = 0; s < songs; s++) {
+	ids[s] = s + 1;
+    }
+    std::shuffle(ids.begin(), ids.end(), rng);
+
+    std::vector<int> uniformQueries(count);
+    std::uniform_int_distribution<int> pick(1, songs);
+    for(int i = 0; i < count; i++) {
+	uniformQueries[i] = pick(rng);
+    }
+    // song of popularity rank r is ids[r], so the hit songs are spread over the file
+    std::vector<double> cdf(songs);
+    double total = 0;
+    for(int r = 0; r < songs; r++) {
+	total += 1.0 / pow(r + 1, zipf);
+	cdf[r] = total;
+    }
+    std::uniform_real_distribution<double> uniform(0, total);
+    std::vector<int> zipfQueries(count);
+    for(int i = 0; i < count; i++) {
+	size_t r = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+	zipfQueries[i] = ids[std::min(r, (size_t)songs - 1)];
+    }
+
+    DSpotify ref;
+    BuildRates memRates = build(ref, ids);
+    size_t dataBytes = 0;
+    {
+	SpilledDSpotify probe;
+	if(probe.create(path, songs, 2 * genres, PageCache::page_size) != StatusType::SUCCESS) {
+	    std::cout << "could not create " << path << "\n";
+	    return 1;
+	}
+	dataBytes = probe.dataBytes();
+    }
+    std::cout << songs << " songs, " << count << " queries, zipf " << zipf << ", file of "
+	      << dataBytes / (1024.0 * 1024.0) << " MB\n";
+    std::cout << "in memory: " << memRates.adds << " adds/s, " << memRates.merges << " merges/s\n";
+
+    long long mismatches = 0;
+    for(int ratio : {1, 4, 16}) {
+	SpilledDSpotify ds;
+	if(ds.create(path, songs, 2 * genres, dataBytes / ratio) != StatusType::SUCCESS) {
+	    std::cout << "could not create " << path << "\n";
+	    return 1;
+	}
+	const PageCache& cache = ds.pageCache();
+	std::cout << "cache 1:" << ratio << " (" << cache.frames() << " frames" << (cache.direct() ? ", O_DIRECT" : "")
+		  << ")\n";
+	BuildRates rates = build(ds, ids);
+	std::cout << "  build: " << rates.adds << " adds/s, " << rates.merges << " merges/s\n";
+	for(int z = 0; z < 2; z++) {
+	    const std::vector<int>& queries = z == 0 ? uniformQueries : zipfQueries;
+	    long long hits = cache.hits();
+	    long long misses = cache.misses();
+	    long long writes = cache.writes();
+	    auto start = std::chrono::steady_clock::now();
+	    for(int i = 0; i < count; i++) {
+		if(i % 2 == 0) {
+		    mismatches += ds.getSongGenre(queries[i]).ans() != ref.getSongGenre(queries[i]).ans();
+		} else {
+		    mismatches += ds.getNumberOfGenreChanges(queries[i]).ans() != ref.getNumberOfGenreChanges(queries[i]).ans();
+		}
+	    }
+	    ds.flush();
+	    double seconds = secondsSince(start);
+	    hits = cache.hits() - hits;
+	    misses = cache.misses() - misses;
+	    std::cout << "  " << (z == 0 ? "uniform" : "zipf") << " queries: " << count / seconds << " ops/s, page hit rate "
+		      << 100.0 * hits / (hits + misses) << "%, " << cache.writes() - writes << " pages written\n";
+	}
+    }
+    remove(path);
+    std::cout << (mismatches == 0 ? "all answers match DSpotify" : "MISMATCHES: " + std::to_string(mismatches)) << "\n";
+    return mismatches != 0;
+}
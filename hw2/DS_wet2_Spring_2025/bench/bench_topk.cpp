@@ -0,0 +1,84 @@
+// bench_topk.cpp
+// Cost of keeping the genre heap up to date (per addSong / mergeGenres) and of
+// getLargestGenres(k) compared with asking getNumberOfSongsByGenre for every genre.
+//
+// usage: ./bench_topk.out [genres=100000] [songs=2000000] [merges=50000] [k=10]
+
+#include "../dspotify25b2.h"
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    const int numGenres = argc > 1 ? atoi(argv[1]) : 100000;
+    const int numSongs = argc > 2 ? atoi(argv[2]) : 2000000;
+    const int numMerges = argc > 3 ? atoi(argv[3]) : 50000;
+    const int k = argc > 4 ? atoi(argv[4]) : 10;
+
+    std::mt19937 rng(2025);
+    DSpotify* ds = new DSpotify();
+
+    auto start = std::chrono::steady_clock::now();
+    for(int g = 1; g <= numGenres; g++) {
+	ds->addGenre(g);
+    }
+    double addGenreSec = secondsSince(start);
+
+    // skewed genre sizes: genre g gets songs with probability ~ 1/g
+    std::geometric_distribution<int> skew(0.001);
+    start = std::chrono::steady_clock::now();
+    for(int s = 1; s <= numSongs; s++) {
+	int g = 1 + skew(rng) % numGenres;
+	ds->addSong(s, g);
+    }
+    double addSongSec = secondsSince(start);
+
+    int nextGenre = numGenres + 1;
+    start = std::chrono::steady_clock::now();
+    for(int m = 0; m < numMerges; m++) {
+	int g1 = 1 + rng() % (nextGenre - 1);
+	int g2 = 1 + rng() % (nextGenre - 1);
+	if(ds->mergeGenres(g1, g2, nextGenre) == StatusType::SUCCESS) {
+	    nextGenre++;
+	}
+    }
+    double mergeSec = secondsSince(start);
+
+    int* top = new int[k];
+    const int queries = 1000;
+    start = std::chrono::steady_clock::now();
+    int written = 0;
+    for(int q = 0; q < queries; q++) {
+	written = ds->getLargestGenres(k, top).ans();
+    }
+    double topSec = secondsSince(start) / queries;
+
+    // what a caller had to do before: ask every genre id and keep the best k
+    start = std::chrono::steady_clock::now();
+    int best = 0;
+    for(int g = 1; g < nextGenre; g++) {
+	int cnt = ds->getNumberOfSongsByGenre(g).ans();
+	if(cnt > best) {
+	    best = cnt;
+	}
+    }
+    double scanSec = secondsSince(start);
+
+    std::cout << "genres=" << nextGenre - 1 << " songs=" << numSongs << " k=" << k << "\n";
+    std::cout << "addGenre:    " << addGenreSec / numGenres * 1e9 << " ns/op\n";
+    std::cout << "addSong:     " << addSongSec / numSongs * 1e9 << " ns/op\n";
+    std::cout << "mergeGenres: " << mergeSec / numMerges * 1e9 << " ns/op\n";
+    std::cout << "getLargestGenres: " << topSec * 1e6 << " us/query (" << written << " ids)\n";
+    std::cout << "full scan:        " << scanSec * 1e6 << " us/query\n";
+    if(written > 0 && ds->getNumberOfSongsByGenre(top[0]).ans() != best) {
+	std::cout << "top genre mismatch!\n";
+	return 1;
+    }
+    delete[] top;
+    delete ds;
+    return 0;
+}
@@ -0,0 +1,78 @@
+// bench_trace.cpp
+// Overhead of the trace points. run_benchmarks.sh builds it twice (see bench_trace.flags):
+// without DSPOTIFY_TRACE it times the plain build; with it, the same workload with
+// tracing disabled and enabled, and then dumps the enabled run as Chrome trace JSON.
+// Compare the "disabled" line of the traced build with the plain build.
+//
+// usage: ./bench_trace.out [ops=1000000] [trace.json=/tmp/dspotify_trace.json]
+
+#include "../dspotify25b2.h"
+#include <chrono>
+#include <cstdlib>
+#include <random>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// a fixed mix of all six commands, returns the time it took
+static double replay(int ops) {
+    std::mt19937 rng(3);
+    DSpotify* ds = new DSpotify();
+    int nextGenre = 1;
+    int nextSong = 1;
+    long long sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < ops; i++) {
+	unsigned r = rng() % 100;
+	if(r < 2 || nextGenre < 3) {
+	    ds->addGenre(nextGenre++);
+	} else if(r < 45) {
+	    ds->addSong(nextSong++, 1 + rng() % (nextGenre - 1));
+	} else if(r < 47) {
+	    if(ds->mergeGenres(1 + rng() % (nextGenre - 1), 1 + rng() % (nextGenre - 1), nextGenre) == StatusType::SUCCESS) {
+		nextGenre++;
+	    }
+	} else if(r < 70) {
+	    sink += ds->getSongGenre(1 + rng() % nextSong).ans();
+	} else if(r < 85) {
+	    sink += ds->getNumberOfSongsByGenre(1 + rng() % nextGenre).ans();
+	} else {
+	    sink += ds->getNumberOfGenreChanges(1 + rng() % nextSong).ans();
+	}
+    }
+    double sec = secondsSince(start);
+    delete ds;
+    return sink == -1 ? 0 : sec;
+}
+
+// best of a few runs, the single runs are noisy compared with the effect measured
+static double bestOf(int ops) {
+    double best = replay(ops);
+    for(int rep = 1; rep < 3; rep++) {
+	double sec = replay(ops);
+	best = sec < best ? sec : best;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const int ops = argc > 1 ? atoi(argv[1]) : 1000000;
+#ifdef DSPOTIFY_TRACE
+    const char* path = argc > 2 ? argv[2] : "/tmp/dspotify_trace.json";
+    trace::setEnabled(false);
+    double disabled = bestOf(ops);
+    trace::setEnabled(true);
+    double enabled = bestOf(ops);
+    trace::setEnabled(false);
+    std::cout << "trace compiled in, disabled: " << ops / disabled / 1e6 << " Mops/s\n";
+    std::cout << "trace compiled in, enabled:  " << ops / enabled / 1e6 << " Mops/s\n";
+    if(trace::dump(path)) {
+	std::cout << "last events of the enabled run written to " << path << "\n";
+    }
+#else
+    double plain = bestOf(ops);
+    std::cout << "trace not compiled in:       " << ops / plain / 1e6 << " Mops/s\n";
+#endif
+    return 0;
+}
@@ -0,0 +1,123 @@
+// bench_widths.cpp
+// The compact (32-bit) engine against the wide (64-bit) one, BasicDSpotify<Compact> and
+// BasicDSpotify<Wide> run one after the other on the same catalog; compare the two:
+//  - layout: sizeof of Song, Genre and a table bucket / bin,
+//  - memory: process RSS per song of the whole catalog,
+//  - throughput: addSong, getSongGenre, getNumberOfGenreChanges and mergeGenres.
+//
+// usage: ./bench_widths.out [songs=4000000] [genres=40000]
+
+#include "../dspotify25b2.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double rssMB() {
+    std::ifstream in("/proc/self/statm");
+    long long pages = 0;
+    long long resident = 0;
+    in >> pages >> resident;
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+template<class W>
+static void run(const char* name, const std::vector<int>& ids, int genres) {
+    typedef BasicDSpotify<W> Engine;
+    typedef typename Engine::Song Song;
+    const int songs = (int)ids.size();
+    std::cout << name << " widths: sizeof(Song) " << sizeof(Song) << ", sizeof(Genre) "
+	      << sizeof(typename Engine::Genre) << ", bucket " << sizeof(hashtable::Node<int, shared_ptr<Song>>)
+	      << ", bin " << sizeof(hashtable::Bin<int, shared_ptr<Song>, typename W::index_type>) << "\n";
+
+    std::mt19937 rng(7);
+    double before = rssMB();
+    Engine* ds = new Engine();
+    for(int g = 1; g <= genres; g++) {
+	ds->addGenre(g);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for(int s = 0; s < songs; s++) {
+	ds->addSong(ids[s], 1 + ids[s] % genres);
+    }
+    double sec = secondsSince(start);
+    double catalog = rssMB() - before;
+    std::cout << songs << " songs: addSong " << songs / sec / 1e6 << " M/s, " << catalog << " MB RSS ("
+	      << catalog * 1024 * 1024 / songs << " bytes per song)\n";
+
+    // merge everything down to one genre, pairing them up like a tournament
+    std::deque<int> pending;
+    for(int g = 1; g <= genres; g++) {
+	pending.push_back(g);
+    }
+    int next = genres + 1;
+    int merges = 0;
+    start = std::chrono::steady_clock::now();
+    while(pending.size() > 1) {
+	int a = pending.front();
+	pending.pop_front();
+	int b = pending.front();
+	pending.pop_front();
+	ds->mergeGenres(a, b, next);
+	pending.push_back(next++);
+	merges++;
+    }
+    sec = secondsSince(start);
+    std::cout << merges << " merges: " << merges / sec / 1e6 << " M merges/s\n";
+
+    std::vector<int> queries(songs);
+    for(int i = 0; i < songs; i++) {
+	queries[i] = 1 + rng() % songs;
+    }
+    long long sink = 0;
+    start = std::chrono::steady_clock::now();
+    for(int id : queries) {
+	sink += ds->getSongGenre(id).ans();
+    }
+    sec = secondsSince(start);
+    std::cout << "getSongGenre: " << songs / sec / 1e6 << " M/s\n";
+    start = std::chrono::steady_clock::now();
+    for(int id : queries) {
+	sink += ds->getNumberOfGenreChanges(id).ans();
+    }
+    sec = secondsSince(start);
+    std::cout << "getNumberOfGenreChanges: " << songs / sec / 1e6 << " M/s (checksum " << sink << ")\n\n";
+    delete ds;
+}
+
+int main(int argc, char** argv) {
+    const int songs = argc > 1 ? atoi(argv[1]) : 4000000;
+    const int genres = argc > 2 ? atoi(argv[2]) : 40000;
+    std::vector<int> ids(songs);
+    for(int s = 0; s < songs; s++) {
+	ids[s] = s + 1;
+    }
+    std::mt19937 rng(7);
+    std::shuffle(ids.begin(), ids.end(), rng);
+    // each width in its own child process: memory freed by the first run would be reused
+    // by the second without showing up in its RSS
+    for(int wide = 0; wide < 2; wide++) {
+	std::cout.flush();
+	pid_t pid = fork();
+	if(pid == 0) {
+	    if(wide) {
+		run<dspotify::Wide>("wide", ids, genres);
+	    } else {
+		run<dspotify::Compact>("compact", ids, genres);
+	    }
+	    std::cout.flush();
+	    _exit(0);
+	}
+	waitpid(pid, nullptr, 0);
+    }
+    return 0;
+}
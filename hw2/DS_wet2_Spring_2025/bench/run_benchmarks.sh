@@ -0,0 +1,35 @@
+#!/bin/bash
+# Builds every bench_*.cpp against the engine sources (everything except the
+# read-only driver main25b2.cpp) and runs it with its default arguments.
+# usage: ./run_benchmarks.sh [bench_name ...]
+
+cd "$(dirname "$0")"
+SOURCES=$(ls ../*.cpp | grep -v main25b2.cpp)
+FLAGS="-std=c++14 -DNDEBUG -Wall -O2 -pthread"
+
+if [ $# -gt 0 ]; then
+  benches="$@"
+else
+  benches=$(ls bench_*.cpp | sed 's/\.cpp$//')
+fi
+
+# a bench_X.flags file lists extra flag sets, one per line: bench_X is built and run
+# once per line
+for b in $benches; do
+  if [ -f "$b.flags" ]; then
+    variants=$(cat "$b.flags")
+  else
+    variants="-DBENCH_DEFAULT"
+  fi
+  while read -r extra; do
+    echo "🔧 Compiling $b $extra..."
+    g++ $FLAGS $extra -o "$b.out" "$b.cpp" $SOURCES
+    if [ $? -ne 0 ]; then
+      echo "❌ Compilation of $b failed"
+      exit 1
+    fi
+    echo "🚀 Running $b"
+    ./"$b.out"
+    echo ""
+  done <<< "$variants"
+done
@@ -1,15 +1,128 @@
 // dspotify25b2.cpp
 #include "dspotify25b2.h"
+#include <atomic>
+#include <thread>
+#include <system_error>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-DSpotify::DSpotify()
-  : songs(make_shared<HashTable<int,shared_ptr<Song>>>(songHashKey)),
-    genres(make_shared<HashTable<int,shared_ptr<Genre>>>(genreHashKey)),
-    uf(make_shared<UnionFind<int>>(intKey))
+template<class W>
+BasicDSpotify<W>::BasicDSpotify() : BasicDSpotify(hugepages::Backing::DEFAULT)
 {}
 
-DSpotify::~DSpotify() = default;
+template<class W>
+BasicDSpotify<W>::BasicDSpotify(hugepages::Backing backing)
+  // ids come from outside, so both tables are hardened against hash flooding
+  : songs(make_shared<SongTable>(songHashKey, 0, true, backing)),
+    genres(make_shared<GenreTable>(genreHashKey, 0, true, backing)),
+    uf(make_shared<UnionFind<int,W>>(intKey)),
+    epoch(0),
+    published(make_shared<const ReadView>(0)),
+    publishInterval(0),
+    sincePublish(0),
+    versionsStale(false),
+    failVersionUpdates(0),
+    viewsPublished(0),
+    versionRebuilds(0),
+    pages(backing),
+    snapshotPid(-1),
+    snapshotLast(SnapshotState::IDLE),
+    songCacheShift(32),
+    songCacheEpoch(1),
+    songCacheHits(0),
+    songCacheMisses(0)
+{
+    if (pages != hugepages::Backing::DEFAULT) {
+        songPool = make_shared<hugepages::Pool>(pages);
+        // genres are far fewer than songs, a single huge page per chunk is plenty
+        genrePool = make_shared<hugepages::Pool>(pages, hugepages::huge_page_size);
+    }
+}
+
+namespace {
+    // whether a count of the engine's width can be handed out as an int. always true for
+    // the compact widths, whose counts are ints
+    template<class C>
+    bool fitsInt(C count) {
+        return (long long)count >= INT_MIN && (long long)count <= INT_MAX;
+    }
+
+    // the answer of an int API call: a count that does not fit is reported as FAILURE
+    // instead of being truncated
+    template<class C>
+    output_t<int> narrowed(output_t<C> res) {
+        if (res.status() != StatusType::SUCCESS) {
+            return output_t<int>(res.status());
+        }
+        if (!fitsInt(res.ans())) {
+            return output_t<int>(StatusType::FAILURE);
+        }
+        return output_t<int>((int)res.ans());
+    }
+}
+
+template<class W>
+shared_ptr<BasicSong<W>> BasicDSpotify<W>::newSong(int songId) {
+    if (!songPool) {
+        return make_shared<Song>(songId, 1);
+    }
+    return allocate_shared<Song>(hugepages::PoolAllocator<Song>(songPool), songId, 1);
+}
+
+template<class W>
+shared_ptr<BasicGenre<W>> BasicDSpotify<W>::newGenre(int genreId) {
+    if (!genrePool) {
+        return make_shared<Genre>(genreId);
+    }
+    return allocate_shared<Genre>(hugepages::PoolAllocator<Genre>(genrePool), genreId);
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::setDenseIdRange(int maxSongId, int maxGenreId) {
+    if (maxSongId < 0 || maxGenreId < 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (songs->len != 0 || genres->len != 0) {
+        return StatusType::FAILURE;
+    }
+    if (!songs->setDenseRange(1, maxSongId)) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    if (!genres->setDenseRange(1, maxGenreId)) {
+        (void)songs->setDenseRange(0, 0);
+        return StatusType::ALLOCATION_ERROR;
+    }
+    return StatusType::SUCCESS;
+}
 
-StatusType DSpotify::addGenre(int genreId) {
+template<class W>
+hugepages::Backing BasicDSpotify<W>::pageBacking() const {
+    hugepages::Backing got = songs->pageBacking();
+    if (songPool && songPool->backing() < got) {
+        got = songPool->backing();
+    }
+    return got;
+}
+
+template<class W>
+BasicDSpotify<W>::~BasicDSpotify() {
+    // a snapshot still running is abandoned rather than waited for
+    if (snapshotPid > 0) {
+        (void)kill(snapshotPid, SIGKILL);
+        (void)waitSnapshot();
+        (void)unlink(snapshotTmp.c_str());
+    }
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::addGenre(int genreId) {
+    TRACE_SPAN("DSpotify::addGenre");
     if (genreId <= 0) {
         return StatusType::INVALID_INPUT;
     }
@@ -17,15 +130,25 @@ StatusType DSpotify::addGenre(int genreId) {
         return StatusType::FAILURE;
     }
     try {
-        auto g = make_shared<Genre>(genreId);
+        auto g = newGenre(genreId);
+        // the heap keeps a raw pointer: only add g once the table owns it, into room
+        // reserved up front so that insert cannot fail afterwards
+        largest.reserve(1);
         genres->insert(genreId, g);
+        largest.insert(g.get());
     } catch (bad_alloc&) {
         return StatusType::ALLOCATION_ERROR;
     }
+    updateVersions([&](ReadViewVersions& v) {
+        v.putGenre(genreId, 0);
+    });
+    mutated();
     return StatusType::SUCCESS;
 }
 
-StatusType DSpotify::addSong(int songId, int genreId) {
+template<class W>
+StatusType BasicDSpotify<W>::addSong(int songId, int genreId) {
+    TRACE_SPAN("DSpotify::addSong");
     if (songId <= 0 || genreId <= 0) {
         return StatusType::INVALID_INPUT;
     }
@@ -37,7 +160,7 @@ StatusType DSpotify::addSong(int songId, int genreId) {
         return StatusType::FAILURE;
     }
     try {
-        auto song = make_shared<Song>(songId, 1);
+        auto song = newSong(songId);
         auto t1 = g->root_in_songs.lock() ; 
         if (t1 != nullptr) 
            {
@@ -45,7 +168,15 @@ StatusType DSpotify::addSong(int songId, int genreId) {
             song->merges        -= t1->merges;
             song->parent         = t1;
             songs->insert(songId, song);
+            linkMember(g.get(), song.get());
             g->songCount += 1;
+            largest.update(g.get());
+            updateVersions([&](ReadViewVersions& v) {
+                song->viewRecord = v.addRecord(t1->viewRecord, song->merges, genreId, false);
+                v.putSong(songId, song->viewRecord);
+                v.putGenre(genreId, g->songCount);
+            });
+            mutated();
             return StatusType::SUCCESS;
           }
           else {
@@ -53,6 +184,14 @@ StatusType DSpotify::addSong(int songId, int genreId) {
           g->root_in_songs    = song;
           g->songCount        = 1;
           songs->insert(songId, song);
+          linkMember(g.get(), song.get());
+          largest.update(g.get());
+          updateVersions([&](ReadViewVersions& v) {
+              song->viewRecord = v.addRecord(-1, song->merges, genreId, false);
+              v.putSong(songId, song->viewRecord);
+              v.putGenre(genreId, 1);
+          });
+          mutated();
           return StatusType::SUCCESS;
       }
     } catch (bad_alloc&) {
@@ -60,8 +199,287 @@ StatusType DSpotify::addSong(int songId, int genreId) {
     }
 }
 
+namespace {
+    // runs work(0) .. work(parts - 1), on parts - 1 new threads and the calling thread.
+    // parts whose thread could not be started run on the calling thread afterwards.
+    // false if any part ran out of memory
+    template<class F>
+    bool runParts(int parts, F work) {
+        atomic<bool> failed(false);
+        auto guarded = [&](int p) {
+            try {
+                work(p);
+            } catch (bad_alloc&) {
+                failed = true;
+            }
+        };
+        thread* workers = nullptr;
+        int started = 0;
+        try {
+            workers = new thread[parts - 1];
+            for (; started < parts - 1; started++) {
+                workers[started] = thread(guarded, started + 1);
+            }
+        } catch (bad_alloc&) {
+        } catch (system_error&) {
+        }
+        guarded(0);
+        for (int t = 0; t < started; t++) {
+            workers[t].join();
+        }
+        delete[] workers;
+        for (int p = started + 1; p < parts; p++) {
+            guarded(p);
+        }
+        return !failed;
+    }
+
+    // groups the records 0..n-1 by part(i), which is in [0, parts) or -1 to leave the
+    // record out, without reordering them: the records of part p are
+    // order[start[p] .. start[p + 1]). counting and scattering are split across parts threads
+    template<class F>
+    bool groupByPart(int n, int parts, F part, unique_ptr<int[]>& order, unique_ptr<int[]>& start) {
+        long long chunk = ((long long)n + parts - 1) / parts;
+        auto sliceEnd = [&](int t) {
+            return (int)min<long long>(n, (t + 1) * chunk);
+        };
+        // counts[t * parts + p]: records of part p in thread t's slice, then where it writes them
+        unique_ptr<int[]> counts(new int[(size_t)parts * parts]());
+        bool ok = runParts(parts, [&](int t) {
+            int* count = &counts[(size_t)t * parts];
+            for (int i = (int)(t * chunk); i < sliceEnd(t); i++) {
+                int p = part(i);
+                if (p >= 0) {
+                    count[p]++;
+                }
+            }
+        });
+        start.reset(new int[parts + 1]);
+        int total = 0;
+        for (int p = 0; p < parts; p++) {
+            start[p] = total;
+            for (int t = 0; t < parts; t++) {
+                int c = counts[(size_t)t * parts + p];
+                counts[(size_t)t * parts + p] = total;
+                total += c;
+            }
+        }
+        start[parts] = total;
+        order.reset(new int[total]);
+        return ok && runParts(parts, [&](int t) {
+            int* next = &counts[(size_t)t * parts];
+            for (int i = (int)(t * chunk); i < sliceEnd(t); i++) {
+                int p = part(i);
+                if (p >= 0) {
+                    order[next[p]++] = i;
+                }
+            }
+        });
+    }
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::buildFromCatalog(const int* genreIds, int numGenres, const int* songIds, const int* songGenres,
+                                      int numSongs, int threads) {
+    TRACE_SPAN("DSpotify::buildFromCatalog");
+    if (numGenres < 0 || numSongs < 0 || threads <= 0 || (numGenres > 0 && genreIds == nullptr)
+        || (numSongs > 0 && (songIds == nullptr || songGenres == nullptr))) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (songs->len != 0 || genres->len != 0) {
+        return StatusType::FAILURE;
+    }
+    int records = numSongs > numGenres ? numSongs : numGenres;
+    if (threads > records) {
+        threads = records > 0 ? records : 1;
+    }
+    bool ok = true;
+    try {
+        ok = genres->presize(numGenres) && songs->presize(numSongs);
+        unique_ptr<int[]> order;
+        unique_ptr<int[]> start;
+        unique_ptr<int[]> added(new int[threads]());
+
+        // genres: each thread inserts the ones of its shard, the first of equal ids wins
+        ok = ok && groupByPart(numGenres, threads, [&](int i) {
+            return genreIds[i] > 0 ? genres->shardOf(genreIds[i], threads) : -1;
+        }, order, start);
+        ok = ok && runParts(threads, [&](int t) {
+            for (int k = start[t]; k < start[t + 1]; k++) {
+                int genreId = genreIds[order[k]];
+                added[t] += genres->insertShard(genreId, newGenre(genreId));
+            }
+        });
+        int total = 0;
+        for (int t = 0; t < threads; t++) {
+            total += added[t];
+            added[t] = 0;
+        }
+        genres->commitShards(total);
+
+        // songs: the same by song shard. accepted[i] is the Song of record i, nullptr when
+        // addSong would have rejected it
+        unique_ptr<Song*[]> accepted(new Song*[numSongs]());
+        unique_ptr<Genre*[]> genreOf(new Genre*[numSongs]);
+        ok = ok && groupByPart(numSongs, threads, [&](int i) {
+            return songIds[i] > 0 && songGenres[i] > 0 ? songs->shardOf(songIds[i], threads) : -1;
+        }, order, start);
+        ok = ok && runParts(threads, [&](int t) {
+            // the buckets are cold and random: every record's bucket is prefetched 2 * ahead
+            // records early, its first chain node ahead records early, as in resolveRange
+            const int ahead = 16;
+            const int ring = 64;
+            typename SongTable::Probe probes[ring];
+            SongTable& table = *songs;
+            for (int k = start[t]; k < start[t + 1] && k < start[t] + 2 * ahead; k++) {
+                __builtin_prefetch(table.probeStart(songIds[order[k]], &probes[k % ring]));
+            }
+            for (int k = start[t]; k < start[t + 1]; k++) {
+                if (k + 2 * ahead < start[t + 1]) {
+                    __builtin_prefetch(table.probeStart(songIds[order[k + 2 * ahead]], &probes[(k + 2 * ahead) % ring]));
+                }
+                if (k + ahead < start[t + 1]) {
+                    shared_ptr<Song>* found = nullptr;
+                    const void* next = table.probeStep(songIds[order[k + ahead]], &probes[(k + ahead) % ring], &found);
+                    if (next != nullptr) {
+                        __builtin_prefetch(next);
+                    }
+                }
+                int i = order[k];
+                if (!genres->contains(songGenres[i])) {
+                    continue;
+                }
+                auto song = newSong(songIds[i]);
+                if (songs->insertShard(songIds[i], song)) {
+                    accepted[i] = song.get();
+                    genreOf[i] = genres->find(songGenres[i]).get();
+                    added[t]++;
+                }
+            }
+        });
+        total = 0;
+        for (int t = 0; t < threads; t++) {
+            total += added[t];
+        }
+        songs->commitShards(total);
+
+        // forests: regrouped by genre, so every genre's songs are hung under its root by
+        // one thread, in the order addSong would have done it
+        ok = ok && groupByPart(numSongs, threads, [&](int i) {
+            return accepted[i] != nullptr ? genres->shardOf(genreOf[i]->id, threads) : -1;
+        }, order, start);
+        ok = ok && runParts(threads, [&](int t) {
+            for (int k = start[t]; k < start[t + 1]; k++) {
+                int i = order[k];
+                Song* song = accepted[i];
+                Genre* g = genreOf[i];
+                if (g->firstMember == nullptr) {
+                    song->genre_root = genres->find(g->id);
+                    g->root_in_songs = songs->find(song->id);
+                } else {
+                    song->parent = g->root_in_songs.lock();
+                    song->merges -= song->parent->merges;
+                }
+                linkMember(g, song);
+                g->songCount += 1;
+            }
+        });
+
+        if (ok) {
+            largest.reserve(genres->len);
+            for (auto it = genres->begin(); it != genres->end(); ++it) {
+                largest.insert(it.value().get());
+            }
+        }
+    } catch (bad_alloc&) {
+        ok = false;
+    }
+    if (!ok) {
+        songs->clear();
+        genres->clear();
+        return StatusType::ALLOCATION_ERROR;
+    }
+    if (genres->len + songs->len > 0) {
+        updateVersions([&](ReadViewVersions& v) {
+            for (auto it = genres->begin(); it != genres->end(); ++it) {
+                v.putGenre(it.key(), it.value()->songCount);
+            }
+            adoptSongs(v, *songs);
+        });
+        mutated(genres->len + songs->len);
+    }
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::absorb(BasicDSpotify* other) {
+    TRACE_SPAN("DSpotify::absorb");
+    if (other == nullptr || other == this) {
+        return StatusType::INVALID_INPUT;
+    }
+    for (auto it = other->genres->begin(); it != other->genres->end(); ++it) {
+        if (genres->contains(it.key())) {
+            return StatusType::FAILURE;
+        }
+    }
+    for (auto it = other->songs->begin(); it != other->songs->end(); ++it) {
+        if (songs->contains(it.key())) {
+            return StatusType::FAILURE;
+        }
+    }
+    // the objects themselves move as they are: parents, roots and member lists are
+    // pointers, only the tables and the heap refer to them by catalog
+    int movedGenres = 0;
+    long long movedSongs = 0;
+    try {
+        largest.reserve(other->genres->len);
+        for (auto it = other->genres->begin(); it != other->genres->end(); ++it, movedGenres++) {
+            genres->insert(it.key(), it.value());
+        }
+        for (auto it = other->songs->begin(); it != other->songs->end(); ++it, movedSongs++) {
+            songs->insert(it.key(), it.value());
+        }
+    } catch (bad_alloc&) {
+        // other was not touched, take back exactly what was inserted
+        for (auto it = other->genres->begin(); movedGenres > 0; ++it, movedGenres--) {
+            genres->deleteEntry(it.key());
+        }
+        for (auto it = other->songs->begin(); movedSongs > 0; ++it, movedSongs--) {
+            songs->deleteEntry(it.key());
+        }
+        return StatusType::ALLOCATION_ERROR;
+    }
+    // reserved above, none of these allocates
+    other->largest.clear();
+    for (auto it = other->genres->begin(); it != other->genres->end(); ++it) {
+        largest.insert(it.value().get());
+    }
+    long long moved = other->genres->len + other->songs->len;
+    if (moved > 0) {
+        // the moved songs' records belong to other's versions until adopted here
+        updateVersions([&](ReadViewVersions& v) {
+            for (auto it = other->genres->begin(); it != other->genres->end(); ++it) {
+                v.putGenre(it.key(), it.value()->songCount);
+            }
+            adoptSongs(v, *other->songs);
+        });
+        other->updateVersions([&](ReadViewVersions& v) {
+            v.clear();
+        });
+    }
+    other->songs->clear();
+    other->genres->clear();
+    if (moved > 0) {
+        other->invalidateSongCache();
+        mutated(moved);
+        other->mutated(moved);
+    }
+    return StatusType::SUCCESS;
+}
 
-StatusType DSpotify::mergeGenres(int g1, int g2, int g3) {
+template<class W>
+StatusType BasicDSpotify<W>::mergeGenres(int g1, int g2, int g3) {
+    TRACE_SPAN("DSpotify::mergeGenres");
     // invalid if any ≤0 or any duplicates
     if (g1 <= 0 || g2 <= 0 || g3 <= 0
         || g1 == g2 || g2 == g3 || g1 == g3) {
@@ -72,52 +490,800 @@ StatusType DSpotify::mergeGenres(int g1, int g2, int g3) {
         return StatusType::FAILURE;
     }
     int ok = 0;
+    Genre* genre1 = genres->find(g1).get();
+    Genre* genre2 = genres->find(g2).get();
+    auto rootRecord = [](Genre* g) {
+        auto root = g->root_in_songs.lock();
+        return root ? root->viewRecord : -1;
+    };
+    int root1 = rootRecord(genre1);
+    int root2 = rootRecord(genre2);
     try {
-        ok = uf->Modefied_Union(g1, g2, g3, genres);
+        // the heap must not fail to grow once the union has happened
+        largest.reserve(1);
+        shared_ptr<Genre> made = newGenre(g3);
+        // the union drops both counts to 0 at once, while update() only restores the order
+        // after a single change: both leave the heap while their counts match their places
+        largest.remove(genre1);
+        largest.remove(genre2);
+        ok = uf->Modefied_Union(g1, g2, g3, genres, made);
     } catch (bad_alloc&) {
+        if (genre1->heapIndex < 0) {
+            largest.insert(genre1);
+            largest.insert(genre2);
+        }
         return StatusType::ALLOCATION_ERROR;
     }
+    // the room reserved above covers all three, none of these allocates
+    largest.insert(genre1);
+    largest.insert(genre2);
+    if (ok) {
+        // g3 took the sum of g1 and g2
+        Genre* genre3 = genres->find(g3).get();
+        largest.insert(genre3);
+        invalidateSongCache();
+        updateVersions([&](ReadViewVersions& v) {
+            v.merge(root1, root2, rootRecord(genre3), g3);
+            v.putGenre(g1, 0);
+            v.putGenre(g2, 0);
+            v.putGenre(g3, genre3->songCount);
+        });
+        mutated();
+    }
     return ok ? StatusType::SUCCESS : StatusType::FAILURE;
 }
 
-output_t<int> DSpotify::getSongGenre(int songId) {
+template<class W>
+StatusType BasicDSpotify<W>::removeSong(int songId) {
+    TRACE_SPAN("DSpotify::removeSong");
+    if (songId <= 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!songs->contains(songId)) {
+        return StatusType::FAILURE;
+    }
+    // compress first: the song then hangs directly under its root, and any tombstones
+    // that were on its path are no longer referenced by it
+    uf->Modefied_find(songId, songs);
+    shared_ptr<Song> song = songs->find(songId);
+    shared_ptr<Song> root = song->parent ? song->parent : song;
+    shared_ptr<Genre> g = root->genre_root;
+    if (g) {
+        unlinkMember(g.get(), song.get());
+        g->songCount -= 1;
+        largest.update(g.get());
+        if (g->songCount == 0) {
+            g->root_in_songs.reset();
+        }
+    }
+    if (songCache && songCacheSlot(songId)->songId == songId) {
+        songCacheSlot(songId)->epoch = 0;
+    }
+    // from here on only the song's children (if any) keep it alive
+    songs->deleteEntry(songId);
+    updateVersions([&](ReadViewVersions& v) {
+        v.eraseSong(songId);
+        if (g) {
+            v.putGenre(g->id, g->songCount);
+        }
+        v.removeRecord(song->viewRecord);
+    });
+    mutated();
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::removeGenre(int genreId) {
+    TRACE_SPAN("DSpotify::removeGenre");
+    if (genreId <= 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!genres->contains(genreId)) {
+        return StatusType::FAILURE;
+    }
+    shared_ptr<Genre> g = genres->find(genreId);
+    if (g->songCount > 0) {
+        return StatusType::FAILURE;
+    }
+    largest.remove(g.get());
+    genres->deleteEntry(genreId);
+    updateVersions([&](ReadViewVersions& v) {
+        v.eraseGenre(genreId);
+    });
+    mutated();
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+output_t<int> BasicDSpotify<W>::getSongGenre(int songId) {
+    TRACE_SPAN("DSpotify::getSongGenre");
     if (songId <= 0) {
         return output_t<int>(StatusType::INVALID_INPUT);
     }
+    if (songCache) {
+        SongCacheEntry* e = songCacheSlot(songId);
+        if (e->songId == songId && e->epoch == songCacheEpoch) {
+            songCacheHits++;
+            return output_t<int>(e->genreId);
+        }
+    }
     if (!songs->contains(songId)) {
         return output_t<int>(StatusType::FAILURE);
     }
     int genreId = uf->Modefied_find(songId, songs);
+    if (songCache) {
+        rememberSong(songId, songs->find(songId).get());
+    }
     return output_t<int>(genreId); 
 }
 
-output_t<int> DSpotify::getNumberOfSongsByGenre(int genreId) {
+template<class W>
+output_t<int> BasicDSpotify<W>::getNumberOfSongsByGenre(int genreId) {
+    TRACE_SPAN("DSpotify::getNumberOfSongsByGenre");
+    return narrowed(songCountOf(genreId));
+}
+
+template<class W>
+output_t<typename W::count_type> BasicDSpotify<W>::songCountOf(int genreId) {
     if (genreId <= 0) {
-        return output_t<int>(StatusType::INVALID_INPUT);
+        return output_t<count_type>(StatusType::INVALID_INPUT);
     }
     auto g = genres->find(genreId);
     if (!g) {
-        return output_t<int>(StatusType::FAILURE);
+        return output_t<count_type>(StatusType::FAILURE);
     }
-    return output_t<int>(g->songCount);  
+    return output_t<count_type>(g->songCount);  
+}
+
+template<class W>
+output_t<int> BasicDSpotify<W>::getNumberOfGenreChanges(int songId) {
+    TRACE_SPAN("DSpotify::getNumberOfGenreChanges");
+    return narrowed(genreChangesOf(songId));
 }
 
-output_t<int> DSpotify::getNumberOfGenreChanges(int songId) {
+template<class W>
+output_t<typename W::count_type> BasicDSpotify<W>::genreChangesOf(int songId) {
     if (songId <= 0) {
-        return output_t<int>(StatusType::INVALID_INPUT);
+        return output_t<count_type>(StatusType::INVALID_INPUT);
+    }
+    if (songCache) {
+        SongCacheEntry* e = songCacheSlot(songId);
+        if (e->songId == songId && e->epoch == songCacheEpoch) {
+            songCacheHits++;
+            return output_t<count_type>(e->changes);
+        }
     }
     if (!songs->contains(songId)) {
-        return output_t<int>(StatusType::FAILURE);
+        return output_t<count_type>(StatusType::FAILURE);
     }
     // path-compress and update merges counter
     uf->Modefied_find(songId, songs);
     auto s = songs->find(songId);
+    if (songCache) {
+        rememberSong(songId, s.get());
+    }
     auto cur = s->parent ;
-    int sum = 0 ;  
+    count_type sum = 0 ;  
     if(cur){
       sum += cur->merges ; 
       cur = cur->parent ; 
     }
 
-    return output_t<int>(s->merges + sum );     
+    return output_t<count_type>(s->merges + sum);     
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::setSongCacheSize(int entries) {
+    if (entries < 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    // at least two entries: a shift by 32 would be undefined
+    int shift = 31;
+    while (shift > 2 && (1LL << (32 - shift)) < entries) {
+        shift--;
+    }
+    try {
+        songCache.reset(entries > 0 ? new SongCacheEntry[(size_t)1 << (32 - shift)]() : nullptr);
+    } catch (bad_alloc&) {
+        songCache.reset();
+        return StatusType::ALLOCATION_ERROR;
+    }
+    songCacheShift = shift;
+    songCacheEpoch = 1;
+    songCacheHits = 0;
+    songCacheMisses = 0;
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+void BasicDSpotify<W>::songCacheStats(long long* hits, long long* misses) const {
+    *hits = songCacheHits;
+    *misses = songCacheMisses;
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::advanceSongCacheEpoch(uint32_t epoch) {
+    if (!songCache) {
+        return StatusType::FAILURE;
+    }
+    if (epoch <= songCacheEpoch) {
+        return StatusType::INVALID_INPUT;
+    }
+    songCacheEpoch = epoch;
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+void BasicDSpotify<W>::rememberSong(int songId, const Song* song) {
+    SongCacheEntry* e = songCacheSlot(songId);
+    count_type changes = 0;
+    int genreId = uf->Modefied_find_readonly(song, &changes);
+    songCacheMisses++;
+    if (!fitsInt(changes)) {
+        return;
+    }
+    e->songId = songId;
+    e->genreId = genreId;
+    e->changes = (int)changes;
+    e->epoch = songCacheEpoch;
+}
+
+template<class W>
+void BasicDSpotify<W>::invalidateSongCache() {
+    if (!songCache) {
+        return;
+    }
+    if (++songCacheEpoch == 0) {
+        // wrapped around: entries of the old epoch 1 would look valid again
+        memset(songCache.get(), 0, sizeof(SongCacheEntry) << (32 - songCacheShift));
+        songCacheEpoch = 1;
+    }
 }
+
+template<class W>
+output_t<int> BasicDSpotify<W>::getLargestGenres(int k, int* genreIds) {
+    TRACE_SPAN("DSpotify::getLargestGenres");
+    if (k <= 0 || genreIds == nullptr) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    try {
+        return output_t<int>(largest.top(k, genreIds));
+    } catch (bad_alloc&) {
+        return output_t<int>(StatusType::ALLOCATION_ERROR);
+    }
+}
+
+namespace {
+    // one lookup of resolveRange, advanced one load at a time (AMAC style state machine)
+    template<class W>
+    struct SongWalk {
+        enum Stage { PROBE, SONG, SONG_VALUE, GENRE };
+        size_t i;   // index into ids
+        Stage stage;
+        typename BasicSongTable<W>::Probe probe;
+        shared_ptr<BasicSong<W>>* value;
+        const BasicSong<W>* cur;
+        const BasicGenre<W>* genre;
+        typename W::count_type sum;
+    };
+}
+
+template<class W>
+void BasicDSpotify<W>::resolveRange(const int* ids, size_t begin, size_t end, int* songGenres, int* songChanges,
+                            int width, atomic<bool>* overflow) {
+    typedef SongWalk<W> SongWalk;
+    const static int max_width = 64;
+    SongWalk walks[max_width];
+    SongTable& table = *songs;
+    size_t next = begin;
+    int active = 0;
+    // starts walk on the next valid id, false when there is none left
+    auto start = [&](SongWalk& walk) {
+        while (next < end) {
+            size_t i = next++;
+            if (ids[i] <= 0) {
+                songGenres[i] = 0;
+                songChanges[i] = 0;
+                continue;
+            }
+            walk.i = i;
+            walk.stage = SongWalk::PROBE;
+            walk.sum = 0;
+            __builtin_prefetch(table.probeStart(ids[i], &walk.probe));
+            return true;
+        }
+        return false;
+    };
+    // writes the answers of a walk that reached its root
+    auto finish = [&](const SongWalk& walk, int genreId) {
+        songGenres[walk.i] = genreId;
+        if (fitsInt(walk.sum)) {
+            songChanges[walk.i] = (int)walk.sum;
+        } else {
+            songChanges[walk.i] = -1;
+            *overflow = true;
+        }
+    };
+    for (; active < width && active < max_width; active++) {
+        if (!start(walks[active])) {
+            break;
+        }
+    }
+    // round robin over the walks in flight. each step does the load prefetched by the
+    // previous step of the same walk and prefetches the next one
+    while (active > 0) {
+        for (int w = 0; w < active; w++) {
+            SongWalk& walk = walks[w];
+            bool done = false;
+            switch (walk.stage) {
+            case SongWalk::PROBE: {
+                const void* addr = table.probeStep(ids[walk.i], &walk.probe, &walk.value);
+                if (addr != nullptr) {
+                    __builtin_prefetch(addr);
+                } else if (walk.value == nullptr) {
+                    songGenres[walk.i] = 0;
+                    songChanges[walk.i] = 0;
+                    done = true;
+                } else {
+                    // the shared_ptr itself (dense array) or the Song it points to
+                    walk.stage = SongWalk::SONG_VALUE;
+                    __builtin_prefetch(walk.value);
+                }
+                break;
+            }
+            case SongWalk::SONG_VALUE:
+                walk.cur = walk.value->get();
+                walk.stage = SongWalk::SONG;
+                __builtin_prefetch(walk.cur);
+                break;
+            case SongWalk::SONG:
+                // same sums as Modefied_find_readonly
+                walk.sum += walk.cur->merges;
+                if (walk.cur->parent != nullptr) {
+                    walk.cur = walk.cur->parent.get();
+                    __builtin_prefetch(walk.cur);
+                } else if (walk.cur->genre_root != nullptr) {
+                    walk.genre = walk.cur->genre_root.get();
+                    walk.stage = SongWalk::GENRE;
+                    __builtin_prefetch(walk.genre);
+                } else {
+                    finish(walk, 0);
+                    done = true;
+                }
+                break;
+            case SongWalk::GENRE:
+                finish(walk, walk.genre->id);
+                done = true;
+                break;
+            }
+            if (done && !start(walk)) {
+                // no ids left: the last walk in flight takes this slot
+                walks[w] = walks[--active];
+                w--;
+            }
+        }
+    }
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::resolveSongs(const int* ids, size_t n, int* songGenres, int* songChanges, int threads,
+                                  bool compress, int interleave) {
+    TRACE_SPAN("DSpotify::resolveSongs");
+    if (ids == nullptr || songGenres == nullptr || songChanges == nullptr || threads <= 0 || interleave <= 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if ((size_t)threads > n) {
+        threads = n > 0 ? (int)n : 1;
+    }
+    size_t chunk = (n + threads - 1) / threads;
+    atomic<bool> overflow(false);
+    thread* workers = nullptr;
+    int started = 0;
+    try {
+        workers = new thread[threads - 1];
+        for (; started < threads - 1; started++) {
+            size_t begin = (started + 1) * chunk;
+            size_t end = begin + chunk < n ? begin + chunk : n;
+            workers[started] = thread(&BasicDSpotify::resolveRange, this, ids, begin, end, songGenres, songChanges,
+                                      interleave, &overflow);
+        }
+    } catch (bad_alloc&) {
+        threads = 0;
+    } catch (system_error&) {
+        threads = 0;
+    }
+    // the calling thread takes the first chunk
+    resolveRange(ids, 0, chunk < n ? chunk : n, songGenres, songChanges, interleave, &overflow);
+    for (int t = 0; t < started; t++) {
+        workers[t].join();
+    }
+    delete[] workers;
+    if (threads == 0) {
+        // could not start every worker, the chunks nobody took are done here
+        resolveRange(ids, (started + 1) * chunk < n ? (started + 1) * chunk : n, n, songGenres, songChanges,
+                     interleave, &overflow);
+    }
+    if (compress) {
+        for (size_t i = 0; i < n; i++) {
+            if (songGenres[i] != 0) {
+                uf->Modefied_find(ids[i], songs);
+            }
+        }
+    }
+    return overflow ? StatusType::FAILURE : StatusType::SUCCESS;
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::forEachSongInGenre(int genreId, void (*callback)(int songId, void* ctx), void* ctx) {
+    TRACE_SPAN("DSpotify::forEachSongInGenre");
+    if (genreId <= 0 || callback == nullptr) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!genres->contains(genreId)) {
+        return StatusType::FAILURE;
+    }
+    Song* first = genres->find(genreId)->firstMember;
+    if (first == nullptr) {
+        return StatusType::SUCCESS;
+    }
+    Song* s = first;
+    do {
+        Song* next = s->nextMember;
+        callback(s->id, ctx);
+        s = next;
+    } while (s != first);
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+output_t<int> BasicDSpotify<W>::getGenreSongsPage(int genreId, int cursor, int maxSongs, int* songIds, int* nextCursor) {
+    TRACE_SPAN("DSpotify::getGenreSongsPage");
+    if (genreId <= 0 || cursor < 0 || maxSongs <= 0 || songIds == nullptr || nextCursor == nullptr) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    if (!genres->contains(genreId)) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    Song* first = genres->find(genreId)->firstMember;
+    *nextCursor = 0;
+    if (first == nullptr) {
+        // a cursor into an empty genre means its songs went away meanwhile
+        return cursor == 0 ? output_t<int>(0) : output_t<int>(StatusType::FAILURE);
+    }
+    Song* s = first;
+    if (cursor != 0) {
+        if (!songs->contains(cursor) || uf->Modefied_find(cursor, songs) != genreId) {
+            return output_t<int>(StatusType::FAILURE);
+        }
+        s = songs->find(cursor).get();
+    }
+    int written = 0;
+    while (written < maxSongs) {
+        songIds[written++] = s->id;
+        s = s->nextMember;
+        if (s == first) {
+            return output_t<int>(written);
+        }
+    }
+    *nextCursor = s->id;
+    return output_t<int>(written);
+}
+
+template<class W>
+void BasicDSpotify<W>::mutated(long long count) {
+    epoch += count;
+    sincePublish += count;
+    if (publishInterval > 0 && sincePublish >= publishInterval) {
+        // on failure readers simply keep the previous view. sincePublish starts over either
+        // way, so the next attempt comes an interval later and not on every mutation
+        (void)publishReadView();
+    }
+}
+
+template<class W>
+template<class F>
+void BasicDSpotify<W>::updateVersions(F update) {
+    if (!versions || versionsStale) {
+        return;
+    }
+    try {
+        if (failVersionUpdates > 0) {
+            failVersionUpdates--;
+            throw bad_alloc();
+        }
+        update(*versions);
+        versions->collect();
+    } catch (bad_alloc&) {
+        // out of step with the catalog now: readers keep the last view until a rebuild
+        versionsStale = true;
+    }
+}
+
+template<class W>
+void BasicDSpotify<W>::adoptSongs(ReadViewVersions& v, SongTable& from) {
+    // every song hangs right under its root after this. their records are reset first:
+    // they may still be those of other versions (stale ones, or an absorbed catalog's)
+    for (auto it = from.begin(); it != from.end(); ++it) {
+        uf->Modefied_find(it.key(), songs);
+        Song* song = it.value().get();
+        song->viewRecord = -1;
+        if (song->parent) {
+            song->parent->viewRecord = -1;
+        }
+    }
+    for (auto it = from.begin(); it != from.end(); ++it) {
+        Song* song = it.value().get();
+        Song* root = song->parent ? song->parent.get() : song;
+        if (root->viewRecord < 0) {
+            // a root that is not in the table anymore was removed, songs still hang under it
+            bool removed = !songs->contains(root->id) || songs->find(root->id).get() != root;
+            root->viewRecord = v.addRecord(-1, root->merges, root->genre_root ? root->genre_root->id : 0, removed);
+        }
+        if (song != root) {
+            song->viewRecord = v.addRecord(root->viewRecord, song->merges, 0, false);
+        }
+        v.putSong(it.key(), song->viewRecord);
+    }
+}
+
+template<class W>
+bool BasicDSpotify<W>::rebuildVersions() {
+    TRACE_SPAN("DSpotify::rebuildVersions");
+    versionRebuilds++;
+    try {
+        if (failVersionUpdates > 0) {
+            failVersionUpdates--;
+            throw bad_alloc();
+        }
+        unique_ptr<ReadViewVersions> fresh(new ReadViewVersions());
+        for (auto it = genres->begin(); it != genres->end(); ++it) {
+            fresh->putGenre(it.key(), it.value()->songCount);
+        }
+        adoptSongs(*fresh, *songs);
+        versions.swap(fresh);
+    } catch (bad_alloc&) {
+        return false;
+    }
+    versionsStale = false;
+    return true;
+}
+
+template<class W>
+shared_ptr<const ReadView> BasicDSpotify<W>::openReadView() const {
+    return atomic_load(&published);
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::publishReadView() {
+    TRACE_SPAN("DSpotify::publishReadView");
+    sincePublish = 0;
+    if ((!versions || versionsStale) && !rebuildVersions()) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    try {
+        versions->retire(atomic_exchange(&published, versions->publish(epoch)));
+    } catch (bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    viewsPublished++;
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::setReadViewInterval(int mutations) {
+    if (mutations < 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (mutations > 0 && !versions && !rebuildVersions()) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    publishInterval = mutations;
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+void BasicDSpotify<W>::readViewStats(long long* published, long long* rebuilds) const {
+    *published = viewsPublished;
+    *rebuilds = versionRebuilds;
+}
+
+template<class W>
+void BasicDSpotify<W>::failReadViewUpdates(int n) {
+    failVersionUpdates = n;
+}
+
+namespace {
+    // a dump line is shorter than this: a tag and at most three 20 digit numbers
+    const ptrdiff_t snapshot_line_max = 96;
+    const size_t snapshot_buffer_size = 1 << 16;
+
+    char* appendText(char* p, const char* text) {
+        while (*text != '\0') {
+            *p++ = *text++;
+        }
+        return p;
+    }
+
+    // decimal digits of v at p, returns the end. no locale and no allocation
+    char* appendNumber(char* p, long long v) {
+        unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+        if (v < 0) {
+            *p++ = '-';
+        }
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = (char)('0' + u % 10);
+            u /= 10;
+        } while (u != 0);
+        while (n > 0) {
+            *p++ = digits[--n];
+        }
+        return p;
+    }
+
+    bool writeAll(int fd, const char* from, const char* to) {
+        while (from < to) {
+            ssize_t n = write(fd, from, to - from);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            from += n;
+        }
+        return true;
+    }
+}
+
+template<class W>
+bool BasicDSpotify<W>::writeSnapshot(int fd, char* buf, size_t size) const {
+    char* const end = buf + size;
+    char* p = buf;
+    bool ok = true;
+    // room for one more line, writing out the buffer when there is not
+    auto room = [&]() {
+        if (ok && end - p < snapshot_line_max) {
+            ok = writeAll(fd, buf, p);
+            p = buf;
+        }
+        return ok;
+    };
+    p = appendText(p, "DSPOTIFY-SNAPSHOT 1 ");
+    p = appendNumber(p, epoch);
+    *p++ = ' ';
+    p = appendNumber(p, (long long)genres->len);
+    *p++ = ' ';
+    p = appendNumber(p, (long long)songs->len);
+    *p++ = '\n';
+    // value() instead of *it: copying the shared_ptrs would write their use counts
+    for (auto it = genres->begin(); room() && it != genres->end(); ++it) {
+        p = appendText(p, "G ");
+        p = appendNumber(p, it.key());
+        *p++ = ' ';
+        p = appendNumber(p, (long long)it.value()->songCount);
+        *p++ = '\n';
+    }
+    for (auto it = songs->begin(); room() && it != songs->end(); ++it) {
+        count_type changes = 0;
+        int genre = uf->Modefied_find_readonly(it.value().get(), &changes);
+        p = appendText(p, "S ");
+        p = appendNumber(p, it.key());
+        *p++ = ' ';
+        p = appendNumber(p, genre);
+        *p++ = ' ';
+        p = appendNumber(p, (long long)changes);
+        *p++ = '\n';
+    }
+    return ok && writeAll(fd, buf, p);
+}
+
+template<class W>
+bool BasicDSpotify<W>::writeSnapshotFile(const char* tmp, const char* path, char* buf, size_t size) const {
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = writeSnapshot(fd, buf, size);
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        (void)unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::saveSnapshot(const char* path) {
+    TRACE_SPAN("DSpotify::saveSnapshot");
+    if (path == nullptr) {
+        return StatusType::INVALID_INPUT;
+    }
+    try {
+        string tmp = string(path) + ".tmp";
+        unique_ptr<char[]> buf(new char[snapshot_buffer_size]);
+        return writeSnapshotFile(tmp.c_str(), path, buf.get(), snapshot_buffer_size) ? StatusType::SUCCESS
+                                                                                     : StatusType::FAILURE;
+    } catch (bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+}
+
+template<class W>
+StatusType BasicDSpotify<W>::backgroundSnapshot(const char* path) {
+    TRACE_SPAN("DSpotify::backgroundSnapshot");
+    if (path == nullptr) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (snapshotState() == SnapshotState::RUNNING) {
+        return StatusType::FAILURE;
+    }
+    // everything the child needs is allocated here, before the fork
+    unique_ptr<char[]> buf;
+    try {
+        snapshotTmp = string(path) + ".tmp";
+        buf.reset(new char[snapshot_buffer_size]);
+    } catch (bad_alloc&) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        // EAGAIN / ENOMEM: no room for another process or its page tables
+        return StatusType::ALLOCATION_ERROR;
+    }
+    if (pid == 0) {
+        // child: only this thread exists here, and a lock another thread of the parent held
+        // at the fork (malloc's, stdio's, a Pool's, the tracer's) stays held forever. so
+        // the child only uses open/write/rename from the buffer above, and _exit skips the
+        // destructors and atexit handlers of the parent's objects
+        _exit(writeSnapshotFile(snapshotTmp.c_str(), path, buf.get(), snapshot_buffer_size) ? 0 : 1);
+    }
+    snapshotPid = pid;
+    snapshotLast = SnapshotState::RUNNING;
+    return StatusType::SUCCESS;
+}
+
+template<class W>
+void BasicDSpotify<W>::snapshotFinished(int status) {
+    snapshotPid = -1;
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    snapshotLast = ok ? SnapshotState::DONE : SnapshotState::FAILED;
+}
+
+template<class W>
+SnapshotState BasicDSpotify<W>::snapshotState() {
+    if (snapshotPid > 0) {
+        int status = 0;
+        pid_t r = waitpid(snapshotPid, &status, WNOHANG);
+        if (r == snapshotPid) {
+            snapshotFinished(status);
+        } else if (r < 0) {
+            // somebody else reaped it (e.g. SIGCHLD ignored), its result is lost
+            snapshotPid = -1;
+            snapshotLast = SnapshotState::FAILED;
+        }
+    }
+    return snapshotLast;
+}
+
+template<class W>
+SnapshotState BasicDSpotify<W>::waitSnapshot() {
+    if (snapshotPid > 0) {
+        int status = 0;
+        pid_t r;
+        do {
+            r = waitpid(snapshotPid, &status, 0);
+        } while (r < 0 && errno == EINTR);
+        if (r == snapshotPid) {
+            snapshotFinished(status);
+        } else {
+            snapshotPid = -1;
+            snapshotLast = SnapshotState::FAILED;
+        }
+    }
+    return snapshotLast;
+}
+
+template class BasicDSpotify<dspotify::Compact>;
+template class BasicDSpotify<dspotify::Wide>;
@@ -16,14 +16,118 @@
 #include "wet2util.h"
 #include "uwu.hpp"
 #include "unionfind.h"
+#include "genreheap.h"
+#include "readview.h"
+#include "hugepages.h"
+#include <sys/types.h>
+#include <atomic>
+
+// progress of DSpotify::backgroundSnapshot
+enum struct SnapshotState {
+    IDLE    = 0, // none was started yet
+    RUNNING = 1,
+    DONE    = 2, // the last one was written completely
+    FAILED  = 3, // the last one could not be written, the file is left untouched
+};
+
+// W chooses the integer widths of the counts and table indices (see widths.h). DSpotify
+// below is the compact instantiation; both are compiled in dspotify25b2.cpp
+template<class W>
+class BasicDSpotify {
+public:
+    // the engine's objects and tables at these widths
+    typedef BasicSong<W> Song;
+    typedef BasicGenre<W> Genre;
+    typedef BasicSongTable<W> SongTable;
+    typedef BasicGenreTable<W> GenreTable;
+    typedef typename W::count_type count_type;
 
-class DSpotify {
 private:
-      shared_ptr< HashTable<int,shared_ptr<Song>>> songs;
+      shared_ptr< SongTable> songs;
     
     // Hash table to store genre information: genreId -> Genre*
-     shared_ptr< HashTable<int,shared_ptr< Genre>>> genres;
-    shared_ptr<UnionFind<int>> uf  ; 
+     shared_ptr< GenreTable> genres;
+    shared_ptr<UnionFind<int,W>> uf  ; 
+    // genres ordered by songCount, kept in sync by addGenre, addSong and mergeGenres
+    BasicGenreHeap<W> largest;
+
+    // number of successful mutations so far, the epoch of the next published view
+    long long epoch;
+    // latest published view, only accessed through atomic_load/atomic_exchange
+    shared_ptr<const ReadView> published;
+    // publish automatically after this many mutations, 0 = only on publishReadView()
+    int publishInterval;
+    long long sincePublish;
+    // the catalog as versioned maps, from the first publishReadView / setReadViewInterval
+    // on (nullptr before) changed by every mutation along with the catalog. stale once an
+    // update ran out of memory: it is then rebuilt by the next publish
+    unique_ptr<ReadViewVersions> versions;
+    bool versionsStale;
+    int failVersionUpdates;   // see failReadViewUpdates
+    long long viewsPublished;
+    long long versionRebuilds;
+
+    // called after every successful mutation, with how many there were for bulk ones
+    void mutated(long long count = 1);
+    // runs update on versions, if there are any in step with the catalog
+    template<class F>
+    void updateVersions(F update);
+    // versions built from scratch, O(songs + genres). false (nothing changed) on bad_alloc
+    bool rebuildVersions();
+    // gives the songs of table `from` (all in songs by now) records in v, and the roots
+    // they hang under. compresses their paths first, so a root is the only ancestor
+    void adoptSongs(ReadViewVersions& v, SongTable& from);
+
+    // requested backing for the tables and the Song/Genre objects. the pools are only
+    // created when it is not DEFAULT, otherwise objects come from make_shared as before
+    hugepages::Backing pages;
+    shared_ptr<hugepages::Pool> songPool;
+    shared_ptr<hugepages::Pool> genrePool;
+    shared_ptr<Song> newSong(int songId);
+    shared_ptr<Genre> newGenre(int genreId);
+
+    // background snapshot child, -1 when none is running, and the file it writes first
+    pid_t snapshotPid;
+    SnapshotState snapshotLast;
+    string snapshotTmp;
+    // writes the dump to fd through buf (size bytes) without mutating anything (no path
+    // compression, no shared_ptr copies), so a forked child only shares pages with its
+    // parent and never copies them. only write(2), no allocation, stdio or locks
+    bool writeSnapshot(int fd, char* buf, size_t size) const;
+    // the dump into tmp, renamed to path once complete. tmp is removed on failure
+    bool writeSnapshotFile(const char* tmp, const char* path, char* buf, size_t size) const;
+    // turns a waitpid status of the snapshot child into its final state
+    void snapshotFinished(int status);
+
+    // direct-mapped cache of the answers to getSongGenre / getNumberOfGenreChanges, indexed
+    // by a hash of the song id. an entry is valid while its epoch is songCacheEpoch:
+    // mergeGenres changes the answers of whole genres at once, so it bumps the epoch
+    // (invalidating every entry in O(1)), removeSong clears the song's own entry. 16 bytes
+    // per entry, so four share a cache line and none straddles two
+    struct SongCacheEntry {
+        int songId;
+        int genreId;
+        int changes;
+        uint32_t epoch;
+    };
+    unique_ptr<SongCacheEntry[]> songCache; // nullptr while the cache is off
+    int songCacheShift;                     // 32 - log2(entries)
+    uint32_t songCacheEpoch;                // never 0, the epoch of an empty entry
+    long long songCacheHits;
+    long long songCacheMisses;
+    SongCacheEntry* songCacheSlot(int songId) const {
+        return &songCache[((uint32_t)songId * 2654435761u) >> songCacheShift];
+    }
+    // stores the answers of song (just compressed, so its walk is at most one step).
+    // a song whose change count does not fit the entry's int is not cached
+    void rememberSong(int songId, const Song* song);
+    // every entry becomes stale
+    void invalidateSongCache();
+
+    // read-only resolution of ids[begin..end) for resolveSongs, `width` lookups in flight.
+    // sets *overflow when a change count did not fit songChanges' int
+    void resolveRange(const int* ids, size_t begin, size_t end, int* songGenres, int* songChanges,
+                      int width, atomic<bool>* overflow);
 
     //
     // Here you may add anything you want
@@ -31,9 +135,9 @@ private:
     
 public:
     // <DO-NOT-MODIFY> {
-    DSpotify();
+    BasicDSpotify();
 
-    virtual ~DSpotify();
+    virtual ~BasicDSpotify();
 
     StatusType addGenre(int genreId);
 
@@ -47,6 +151,134 @@ public:
 
     output_t<int> getNumberOfGenreChanges(int songId);
     // } </DO-NOT-MODIFY>
+
+    // getNumberOfSongsByGenre and getNumberOfGenreChanges at the engine's count width. the
+    // int versions above answer FAILURE for a count that does not fit an int instead of
+    // truncating it, which only the wide engine can reach
+    output_t<count_type> songCountOf(int genreId);
+    output_t<count_type> genreChangesOf(int songId);
+
+    // like DSpotify(), but the song and genre tables and the Song/Genre objects are placed
+    // on huge pages (see hugepages.h) once they are large enough to benefit
+    explicit BasicDSpotify(hugepages::Backing pageBacking);
+    // weakest backing the song table and the Song objects actually got. the table stays on
+    // regular pages (DEFAULT) until its bucket array spans a huge page
+    hugepages::Backing pageBacking() const;
+
+    // songs with ids 1..maxSongId and genres with ids 1..maxGenreId are then kept in flat
+    // arrays indexed by id with a presence bit each, so looking them up needs no hashing.
+    // ids outside the ranges still work, they are hashed as before. 0 leaves that table
+    // fully hashed. only allowed on an empty catalog (FAILURE otherwise)
+    StatusType setDenseIdRange(int maxSongId, int maxGenreId);
+
+    // fills an empty catalog in one go with `threads` threads, giving exactly the catalog
+    // of addGenre(genreIds[i]) for every genre followed by addSong(songIds[i], songGenres[i])
+    // for every song, in order. records those calls would reject (non-positive ids,
+    // duplicates, songs of unknown genres) are skipped just the same. the songs are split
+    // by their hash table shard to be inserted, then by genre to be hung under their genre's
+    // root. FAILURE if the catalog is not empty; on ALLOCATION_ERROR it is left empty
+    StatusType buildFromCatalog(const int* genreIds, int numGenres, const int* songIds, const int* songGenres,
+                                int numSongs, int threads);
+
+    // moves every song and genre of other (with their forests, member lists and change
+    // counts) into this catalog and leaves other empty, as if they had always been added
+    // here. O(size of other). FAILURE if the two share a song or a genre id; on FAILURE and
+    // ALLOCATION_ERROR neither catalog is changed
+    StatusType absorb(BasicDSpotify* other);
+
+    // writes a consistent text dump of the catalog to path, blocking until it is written:
+    //   DSPOTIFY-SNAPSHOT 1 <epoch> <genres> <songs>
+    //   G <genreId> <songCount>                  one line per genre
+    //   S <songId> <genreId> <genreChanges>      one line per song
+    // the dump goes to path.tmp first and is renamed to path once complete
+    StatusType saveSnapshot(const char* path);
+    // the same dump, written by a fork()ed child from its copy-on-write image of the
+    // catalog, so the caller only pauses for the fork and may keep mutating right away.
+    // call it from the writer thread while no other call on this catalog runs (resolveSongs
+    // workers included), or the child dumps a half made change. other threads of the
+    // process may hold any lock: the child neither allocates nor uses stdio. destroying the
+    // catalog does not wait for a running one: the child is killed and reaped (which only
+    // waits for the kernel to tear it down), path stays as it was and path.tmp is removed.
+    // FAILURE while the previous one is still running
+    StatusType backgroundSnapshot(const char* path);
+    // state of the last background snapshot, never blocks
+    SnapshotState snapshotState();
+    // blocks until the running background snapshot (if any) finished and returns its state
+    SnapshotState waitSnapshot();
+
+    // writes the ids of the k genres with the most songs into genreIds, largest first
+    // (ties: smaller id first). returns how many ids were written, fewer than k when
+    // there are fewer genres. O(k log k)
+    output_t<int> getLargestGenres(int k, int* genreIds);
+
+    // bulk getSongGenre + getNumberOfGenreChanges for n songs, split across `threads`
+    // threads. the forest is only read while the threads run, so nothing else may mutate
+    // this DSpotify meanwhile. unknown or non-positive ids get genre 0 and 0 changes.
+    // when compress is set, a single sequential path compression pass follows.
+    // each thread keeps `interleave` lookups in flight (at most 64): every lookup is a
+    // chain of dependent loads (bucket, chain nodes, songs up to the root, genre), so the
+    // lookups take turns, each prefetching its next load and letting the others run while
+    // it arrives. 1 walks one song at a time. a change count that does not fit an int is
+    // written as -1 and the call answers FAILURE once all songs are resolved.
+    StatusType resolveSongs(const int* ids, size_t n, int* songGenres, int* songChanges, int threads,
+                            bool compress = false, int interleave = 16);
+
+    // removes a song from the catalog and from its genre's song count. a removed song that
+    // other songs still hang under stays in the forest as a tombstone (keeping its merges, so
+    // their change counts are unaffected) and is freed once nothing points to it anymore.
+    StatusType removeSong(int songId);
+    // removes a genre that has no songs. FAILURE if the genre still has songs
+    StatusType removeGenre(int genreId);
+
+    // calls callback once for every song currently in the genre, in no particular order.
+    // O(songs in the genre). callback must not mutate this DSpotify
+    StatusType forEachSongInGenre(int genreId, void (*callback)(int songId, void* ctx), void* ctx);
+    // paged listing of the same songs: writes up to maxSongs ids into songIds and returns
+    // how many. start with cursor 0 and pass the returned *nextCursor to get the next page,
+    // *nextCursor is 0 after the last page. O(page size). FAILURE if the genre or the
+    // cursor's song changed between pages (the cursor song was removed or merged away)
+    output_t<int> getGenreSongsPage(int genreId, int cursor, int maxSongs, int* songIds, int* nextCursor);
+
+    // caches the answers of up to `entries` songs (rounded up to a power of two, 0 turns the
+    // cache off), so repeated getSongGenre / getNumberOfGenreChanges of a song skip the
+    // table probe and the walk to its root until the next mergeGenres. resets the counters
+    StatusType setSongCacheSize(int entries);
+    // how many getSongGenre / getNumberOfGenreChanges of existing songs the cache answered
+    // and how many it missed since the last setSongCacheSize
+    void songCacheStats(long long* hits, long long* misses) const;
+    // for tests: moves the cache's epoch forward to `epoch`, keeping the entries, so the
+    // wrap-around after 2^32 - 1 mergeGenres can be reached in a few. INVALID_INPUT unless
+    // epoch is above the current one, FAILURE while the cache is off
+    StatusType advanceSongCacheEpoch(uint32_t epoch);
+
+    // latest published point-in-time view. never blocks and may be called from any thread
+    // while the writer thread keeps mutating. the view stays valid for as long as the
+    // caller holds it, even after newer ones were published.
+    shared_ptr<const ReadView> openReadView() const;
+    // publishes the current state to openReadView(). writer thread only, O(1): from the
+    // first call (or setReadViewInterval) on, every mutation also updates versioned maps of
+    // the catalog in O(log n), and a publish only freezes their current version (see
+    // ReadView). that first call builds them, O(songs + genres). ALLOCATION_ERROR (the
+    // previous view stays published) when memory ran out
+    StatusType publishReadView();
+    // publish automatically every `mutations` successful mutations (0 turns it off). builds
+    // the versioned maps if there are none yet. a publish that failed is retried an
+    // interval later: an update of the maps that ran out of memory leaves them out of step,
+    // and the next publish rebuilds them, O(songs + genres), once
+    StatusType setReadViewInterval(int mutations);
+    // views published and full builds of the versioned maps since the catalog was made
+    void readViewStats(long long* published, long long* rebuilds) const;
+    // for tests: the next n updates or rebuilds of the versioned maps fail as if memory ran
+    // out, so the failure paths (a stale update, a failed publish) are reached without
+    // exhausting memory
+    void failReadViewUpdates(int n);
 };
 
+// the driver's engine: 32-bit counts and table indices
+typedef BasicDSpotify<dspotify::Compact> DSpotify;
+
+// both are instantiated once, in dspotify25b2.cpp
+extern template class BasicDSpotify<dspotify::Compact>;
+extern template class BasicDSpotify<dspotify::Wide>;
+
 #endif // DSPOTIFY25SPRING_WET2_H_
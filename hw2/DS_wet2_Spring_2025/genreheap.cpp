@@ -0,0 +1,178 @@
+#include "genreheap.h"
+#include <assert.h>
+
+template<class W>
+BasicGenreHeap<W>::BasicGenreHeap() : heap(nullptr), len(0), capacity(0)
+{}
+
+template<class W>
+BasicGenreHeap<W>::~BasicGenreHeap() {
+    delete[] heap;
+}
+
+template<class W>
+bool BasicGenreHeap<W>::before(const Genre* a, const Genre* b) {
+    if(a->songCount != b->songCount) {
+	return a->songCount > b->songCount;
+    }
+    return a->id < b->id;
+}
+
+template<class W>
+void BasicGenreHeap<W>::place(int i, Genre* g) {
+    heap[i] = g;
+    g->heapIndex = i;
+}
+
+template<class W>
+void BasicGenreHeap<W>::siftUp(int i) {
+    Genre* g = heap[i];
+    while(i > 0) {
+	int parent = (i - 1) / 2;
+	if(!before(g, heap[parent])) {
+	    break;
+	}
+	place(i, heap[parent]);
+	i = parent;
+    }
+    place(i, g);
+}
+
+template<class W>
+void BasicGenreHeap<W>::siftDown(int i) {
+    Genre* g = heap[i];
+    while(true) {
+	int child = 2 * i + 1;
+	if(child >= len) {
+	    break;
+	}
+	if(child + 1 < len && before(heap[child + 1], heap[child])) {
+	    child++;
+	}
+	if(!before(heap[child], g)) {
+	    break;
+	}
+	place(i, heap[child]);
+	i = child;
+    }
+    place(i, g);
+}
+
+template<class W>
+void BasicGenreHeap<W>::reserve(int extra) {
+    if(len + extra <= capacity) {
+	return;
+    }
+    int newCap = capacity > 0 ? 2 * capacity : 8;
+    while(newCap < len + extra) {
+	newCap *= 2;
+    }
+    Genre** bigger = new Genre*[newCap];
+    for(int i = 0; i < len; i++) {
+	bigger[i] = heap[i];
+    }
+    delete[] heap;
+    heap = bigger;
+    capacity = newCap;
+}
+
+template<class W>
+void BasicGenreHeap<W>::insert(Genre* g) {
+    assert(g->heapIndex == -1);
+    reserve(1);
+    place(len, g);
+    len++;
+    siftUp(len - 1);
+}
+
+template<class W>
+void BasicGenreHeap<W>::remove(Genre* g) {
+    int i = g->heapIndex;
+    assert(i >= 0 && i < len && heap[i] == g);
+    len--;
+    g->heapIndex = -1;
+    if(i == len) {
+	return;
+    }
+    place(i, heap[len]);
+    update(heap[i]);
+}
+
+template<class W>
+void BasicGenreHeap<W>::update(Genre* g) {
+    int i = g->heapIndex;
+    assert(i >= 0 && i < len && heap[i] == g);
+    if(i > 0 && before(g, heap[(i - 1) / 2])) {
+	siftUp(i);
+    } else {
+	siftDown(i);
+    }
+}
+
+template<class W>
+void BasicGenreHeap<W>::clear() {
+    for(int i = 0; i < len; i++) {
+	heap[i]->heapIndex = -1;
+    }
+    len = 0;
+}
+
+template<class W>
+int BasicGenreHeap<W>::size() const {
+    return len;
+}
+
+template<class W>
+int BasicGenreHeap<W>::top(int k, int* out) const {
+    if(k > len) {
+	k = len;
+    }
+    if(k <= 0) {
+	return 0;
+    }
+    // best-first walk of the heap: the next largest genre is always the best
+    // candidate whose parent was already reported. candidates is a small heap of
+    // positions in `heap`, it never holds more than k+1 entries.
+    int* candidates = new int[k + 1];
+    int count = 0;
+    int written = 0;
+    candidates[count++] = 0;
+    while(written < k) {
+	int best = candidates[0];
+	out[written++] = heap[best]->id;
+	// pop the best candidate
+	candidates[0] = candidates[--count];
+	for(int i = 0;;) {
+	    int child = 2 * i + 1;
+	    if(child >= count) {
+		break;
+	    }
+	    if(child + 1 < count && before(heap[candidates[child + 1]], heap[candidates[child]])) {
+		child++;
+	    }
+	    if(!before(heap[candidates[child]], heap[candidates[i]])) {
+		break;
+	    }
+	    int tmp = candidates[i];
+	    candidates[i] = candidates[child];
+	    candidates[child] = tmp;
+	    i = child;
+	}
+	// push its children
+	for(int child = 2 * best + 1; child <= 2 * best + 2 && child < len; child++) {
+	    int i = count++;
+	    candidates[i] = child;
+	    while(i > 0 && before(heap[candidates[i]], heap[candidates[(i - 1) / 2]])) {
+		int tmp = candidates[i];
+		candidates[i] = candidates[(i - 1) / 2];
+		candidates[(i - 1) / 2] = tmp;
+		i = (i - 1) / 2;
+	    }
+	}
+    }
+    delete[] candidates;
+    return written;
+}
+
+template class BasicGenreHeap<dspotify::Compact>;
+template class BasicGenreHeap<dspotify::Wide>;
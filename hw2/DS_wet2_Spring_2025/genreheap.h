@@ -0,0 +1,48 @@
+#ifndef GENREHEAP_H
+#define GENREHEAP_H
+
+#include "uwu.hpp"
+
+// Indexed binary max-heap of genres ordered by songCount (ties: smaller id first).
+// Every genre stores its own position in heapIndex, so a genre whose songCount
+// changed is fixed in O(log n) without searching for it.
+// The heap does not own the genres, they are kept alive by DSpotify's genres table.
+// W is the engine's widths (see widths.h), instantiated in genreheap.cpp.
+template<class W>
+class BasicGenreHeap
+{
+public:
+    typedef BasicGenre<W> Genre;
+
+    BasicGenreHeap();
+    ~BasicGenreHeap();
+    BasicGenreHeap(const BasicGenreHeap &other) = delete;
+    BasicGenreHeap& operator=(const BasicGenreHeap &other) = delete;
+
+    // make sure the next `extra` inserts do not allocate. throws bad_alloc
+    void reserve(int extra);
+    // add a genre that is not in the heap yet. throws bad_alloc
+    void insert(Genre* g);
+    // remove a genre that is in the heap
+    void remove(Genre* g);
+    // restore the heap order after g->songCount was changed
+    void update(Genre* g);
+    // remove every genre (their heapIndex becomes -1), keeping the room. never allocates
+    void clear();
+    int size() const;
+    // write the ids of the (at most) k largest genres into out, largest first.
+    // returns how many ids were written. O(k log k), the heap is not modified.
+    int top(int k, int* out) const;
+
+private:
+    Genre** heap;
+    int len;
+    int capacity;
+
+    static bool before(const Genre* a, const Genre* b);
+    void place(int i, Genre* g);
+    void siftUp(int i);
+    void siftDown(int i);
+};
+
+#endif /* GENREHEAP_H */
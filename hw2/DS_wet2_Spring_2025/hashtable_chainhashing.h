@@ -4,6 +4,14 @@
 #include <iostream>
 #include <assert.h>
 #include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include "trace.h"
+#include "hugepages.h"
 
 
 namespace hashtable{
@@ -46,20 +54,110 @@ namespace hashtable{
 	}
 	return copy_head;
     }
+    // sorted index over the nodes of one long chain, only used by hardened tables.
+    // lets lookups in a flooded bucket binary search instead of walking the list. only
+    // lookups are logarithmic: it is a flat array, so adding or removing a node shifts
+    // the nodes after it, O(bin size), and flooding one bucket with n keys costs O(n^2)
+    // in total (a memmove per insert). an erase also walks the chain to unlink its node.
+    // see bench_hashflood's degenerate rows
+    template<class K,class V,class Index>
+    struct Bin {
+	Node<K,V>** nodes;
+	Index size;
+	Index capacity;
+    };
+    // array of n value-initialized T. arrays of at least one huge page are mmapped with the
+    // wanted backing, everything else (and a failed mapping) comes from new[].
+    // *mapped tells freeArray how it was allocated
+    template<class T>
+    T* allocArray(size_t n,hugepages::Backing want,bool* mapped,hugepages::Backing* got) {
+	*mapped = false;
+	*got = hugepages::Backing::DEFAULT;
+	if(want != hugepages::Backing::DEFAULT && n * sizeof(T) >= hugepages::huge_page_size) {
+	    void* p = hugepages::allocate(n * sizeof(T),want,got);
+	    if(p != nullptr) {
+		T* arr = static_cast<T*>(p);
+		for(size_t i = 0; i<n; i++) {
+		    new (&arr[i]) T();
+		}
+		*mapped = true;
+		return arr;
+	    }
+	    *got = hugepages::Backing::DEFAULT;
+	}
+	return new T[n]();
+    }
+    template<class T>
+    void freeArray(T* arr,size_t n,bool mapped) {
+	if(!mapped) {
+	    delete[] arr;
+	    return;
+	}
+	for(size_t i = 0; i<n; i++) {
+	    arr[i].~T();
+	}
+	hugepages::release(arr,n * sizeof(T));
+    }
+    // splitmix64 finalizer, every input bit affects every output bit
+    inline uint64_t mix64(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+    }
+    // position of key on the dense number line: the key itself, which only an int key has
+    inline long long denseKey(int key) {
+	return key;
+    }
+    template<class K>
+    long long denseKey(const K&) {
+	return INT64_MIN;
+    }
 }
-template<class K,class V>
+// Index is the type of len, capacity and every bucket / dense position (see widths.h)
+template<class K,class V,class Index = int>
 class HashTable
 {
 public:
     // NOTE(Salim): should we replace int with size_t? it could convey the meaning better.
     const static int min_capacity = 5;
-    int len;
-    int capacity;
+    // a hardened table indexes chains longer than this with a sorted Bin
+    const static int treeify_threshold = 8;
+    const static int untreeify_threshold = 6;
+    // chain walks at least this long show up in the trace
+    const static int long_chain = 32;
+    Index len;
+    Index capacity;
     hashtable::Node<K,V>* table;
     int (*key2int)(const K&);
+    // hardened mode: seeded mixing hash instead of the Fibonacci hash, and long chains
+    // get a sorted Bin so a flooded bucket costs O(log n) per lookup instead of O(n).
+    // inserts and erases in such a bucket stay O(n), see Bin
+    bool hardened;
+    uint64_t seed;
+    hashtable::Bin<K,V,Index>* bins; // one per bucket, nullptr unless hardened
+    // where the bucket array lives. arrays of at least one huge page are mmapped with the
+    // requested backing, smaller ones come from new[]. chain nodes are always from new
+    hugepages::Backing backing;
+    hugepages::Backing obtained; // of the current array
+    bool tableMapped;
+    // dense mode (int keys only): keys in [denseMin, denseMin + denseCount) are stored in a
+    // flat array indexed by key - denseMin, with a presence bitmap, and never hashed. the
+    // key itself is the index, not key2int(key), so iterators give it back exactly. all
+    // other keys go to the chains as usual. len counts both
+    int denseMin;
+    Index denseCount; // 0 when there is no dense range
+    Index denseLen;   // how many of the len entries are in the dense array
+    V* dense;
+    uint64_t* present;
+    bool denseMapped;
+    hugepages::Backing denseObtained;
     //! Default constructor
     HashTable();
-    HashTable(int (*key2int_f)(const K&),int s_capacity = 0);
+    HashTable(int (*key2int_f)(const K&),Index s_capacity = 0,bool hardened_mode = false,
+	      hugepages::Backing page_backing = hugepages::Backing::DEFAULT);
     //! Copy constructor
     HashTable(const HashTable &other);
     
@@ -84,6 +182,23 @@ public:
     void insert_record(const K key,const V& val);
     // returns the value corresponding to the key. assumes the key exists
     V& find(const K key);
+    // batched lookup: out[i] points to the value of keys[i], or nullptr if the key is missing.
+    // bucket positions are computed and prefetched for a whole group before any chain is walked,
+    // so the memory latency of independent lookups overlaps.
+    void findMany(const K* keys,size_t n,V** out);
+    // one lookup split into steps that each read one new cache line, for engines that
+    // interleave many lookups and prefetch between steps (see DSpotify::resolveRange).
+    // probeStart hashes the key and returns the address the first probeStep reads.
+    // probeStep returns the address the next step reads, or nullptr once it is done and
+    // *out points to the value (nullptr if the key is missing)
+    struct Probe {
+	Index pos; // bucket, or index into the dense array
+	int stage; // 0 before the bucket head / presence bit was read
+	bool isDense;
+	hashtable::Node<K,V>* node;
+    };
+    const void* probeStart(const K& key,Probe* p) const;
+    const void* probeStep(const K& key,Probe* p,V** out);
     // delete value that corresponds to a key. Return true if the key existed
     bool deleteEntry(const K key);
     // resize hashtable if there are too many elements or too few elements relative to the capacity
@@ -96,6 +211,31 @@ public:
     hashtable::Node<K,V>* insertAssumeCapacity_record(const K key,const V& val,bool *exists);
 
 
+    // backing the bigger of the bucket array and the dense array actually got (DEFAULT
+    // while it is too small to be mapped)
+    hugepages::Backing pageBacking() const {
+	if(denseCount > 0 && (size_t)denseCount * sizeof(V) > (size_t)capacity * sizeof(hashtable::Node<K,V>)) {
+	    return denseObtained;
+	}
+	return obtained;
+    }
+    // store the keys in [lo, lo + count) directly addressed (count = 0 turns it off). only
+    // for K = int, and only allowed while the table is empty. returns false if the table is not empty or
+    // the arrays could not be allocated, the table is unchanged then
+    bool setDenseRange(int lo,Index count);
+    // bulk loading from several threads. presize(n) gives an empty table the buckets for n
+    // entries, so inserting them never resizes. threads may then call insertShard at the
+    // same time as long as every shard (see shardOf) is inserted into by one of them only,
+    // and once all of them are done commitShards(inserted) accounts for what they added
+    bool presize(Index entries);
+    // which of `shards` disjoint parts of the buckets and of the dense array key falls in
+    int shardOf(const K& key,int shards) const;
+    // like insertAssumeCapacity, but len is left to commitShards. false if key exists
+    bool insertShard(const K key,const V& val);
+    void commitShards(Index inserted);
+    // removes every entry, keeping the bucket array and the dense range. never allocates
+    void clear();
+
     class Iterator;
     Iterator begin();
     Iterator end();
@@ -104,9 +244,82 @@ public:
     void printToBoth();
 protected:
 private:
-   int hashKey(const K& key) const {
+    // switch to hardened mode with the given seed. only valid while the table is empty
+    void harden(uint64_t s);
+    static uint64_t randomSeed();
+    hashtable::Node<K,V>* binFind(Index pos,const K& key) const;
+    // keep bins in sync after n was linked into / unlinked from chain pos
+    void binAdd(Index pos,hashtable::Node<K,V>* n);
+    void binRemove(Index pos,hashtable::Node<K,V>* n);
+    void freeBins();
+    // rebuild the bins of every long chain, after the chains were copied
+    void rebuildBins();
+    void treeify(Index pos);
+    // bucket array of cap empty heads. *mapped tells freeTable how it was allocated
+    hashtable::Node<K,V>* allocTable(Index cap,bool* mapped,hugepages::Backing* got) const;
+    static void freeTable(hashtable::Node<K,V>* t,Index cap,bool mapped);
+    void freeDense();
+    // take over the buckets (and bins) of other, which gets ours. used by resize, so the
+    // dense array stays where it is
+    void adoptBuckets(HashTable& other);
+    // index of key in the dense array, -1 if it is outside the dense range
+    Index denseIndex(const K& key) const {
+	if(denseCount == 0) {
+	    return -1;
+	}
+	long long i = hashtable::denseKey(key) - denseMin;
+	return (i >= 0 && i < (long long)denseCount) ? (Index)i : -1;
+    }
+    bool densePresent(Index i) const {
+	return (present[i >> 6] >> (i & 63)) & 1;
+    }
+    // first present dense index >= i, -1 if there is none. skips empty words at once
+    Index nextDense(Index i) const {
+	Index words = (denseCount + 63) / 64;
+	if(i >= denseCount) {
+	    return -1;
+	}
+	Index w = i >> 6;
+	uint64_t bits = present[w] & (~(uint64_t)0 << (i & 63));
+	while(bits == 0) {
+	    if(++w == words) {
+		return -1;
+	    }
+	    bits = present[w];
+	}
+	return w * 64 + (Index)__builtin_ctzll(bits);
+    }
+    // inserts into / erases from the dense array. return false if nothing changed
+    bool denseInsert(Index i,const V& val);
+    bool denseErase(Index i);
+    // first node with this key in chain pos, nullptr if there is none
+    hashtable::Node<K,V>* lookup(Index pos,const K& key) const {
+	if(bins != nullptr && bins[pos].nodes != nullptr) {
+	    return binFind(pos,key);
+	}
+	int steps = 0;
+	for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr; it = it->next, steps++) {
+	    if(key == it->key) {
+		if(steps >= long_chain) {
+		    TRACE_INSTANT("HashTable::long_chain", pos, steps);
+		}
+		return it;
+	    }
+	}
+	if(steps >= long_chain) {
+	    TRACE_INSTANT("HashTable::long_chain", pos, steps);
+	}
+	return nullptr;
+    }
+   Index hashKey(const K& key) const {
+    if(hardened) {
+	return (Index)(hashtable::mix64((uint64_t)(int64_t)key2int(key) ^ seed) % (uint64_t)capacity);
+    }
     static long double multiplier = 0.5 * (sqrt(5) - 1);
-    int hash = floor(capacity * (multiplier * key2int(key)));
+    // only the fractional part of key*multiplier is scaled by capacity: scaling the whole
+    // product overflows int once capacity*key passes 2^31 and every large key lands in one bucket
+    long double scaled = multiplier * key2int(key);
+    Index hash = (Index)(capacity * (scaled - floorl(scaled)));
     return (hash % capacity + capacity) % capacity; // Adjust to ensure non-negative hash
 }
 };
@@ -115,79 +328,489 @@ template<class K>
 int identity(const K& key) {
     return key;
 }
-template<class K,class V>
-HashTable<K,V>::HashTable() : HashTable(identity)
+template<class K,class V,class Index>
+HashTable<K,V,Index>::HashTable() : HashTable(identity)
 {}
 
-template<class K,class V>
-HashTable<K,V>::HashTable(int (*key2int_f)(const K&),int s_capacity) : len(0),capacity(s_capacity),table(nullptr),key2int(key2int_f)
+template<class K,class V,class Index>
+HashTable<K,V,Index>::HashTable(int (*key2int_f)(const K&),Index s_capacity,bool hardened_mode,hugepages::Backing page_backing) : len(0),capacity(s_capacity),table(nullptr),key2int(key2int_f),hardened(false),seed(0),bins(nullptr),backing(page_backing),obtained(hugepages::Backing::DEFAULT),tableMapped(false),denseMin(0),denseCount(0),denseLen(0),dense(nullptr),present(nullptr),denseMapped(false),denseObtained(hugepages::Backing::DEFAULT)
 {
     if(capacity < min_capacity) {
 	capacity = min_capacity;
     }
-    table = new hashtable::Node<K,V>[capacity];
-    for(int i = 0; i<capacity;i++) {
+    table = allocTable(capacity,&tableMapped,&obtained);
+    if(hardened_mode) {
+	try {
+	    harden(randomSeed());
+	} catch(...) {
+	    freeTable(table,capacity,tableMapped);
+	    throw;
+	}
+    }
+}
+
+template<class K,class V,class Index>
+hashtable::Node<K,V>* HashTable<K,V,Index>::allocTable(Index cap,bool* mapped,hugepages::Backing* got) const {
+    hashtable::Node<K,V>* t = hashtable::allocArray<hashtable::Node<K,V>>(cap,backing,mapped,got);
+    for(Index i = 0; i<cap; i++) {
+	t[i].next = nullptr;
+    }
+    return t;
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::freeTable(hashtable::Node<K,V>* t,Index cap,bool mapped) {
+    hashtable::freeArray(t,cap,mapped);
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::freeDense() {
+    if(dense != nullptr) {
+	hashtable::freeArray(dense,denseCount,denseMapped);
+    }
+    delete[] present;
+    dense = nullptr;
+    present = nullptr;
+    denseCount = 0;
+    denseLen = 0;
+    denseMapped = false;
+    denseObtained = hugepages::Backing::DEFAULT;
+}
+
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::setDenseRange(int lo,Index count) {
+    static_assert(std::is_same<K,int>::value, "the dense range is addressed by int keys");
+    if(len != 0 || count < 0) {
+	return false;
+    }
+    V* new_dense = nullptr;
+    uint64_t* new_present = nullptr;
+    bool mapped = false;
+    hugepages::Backing got = hugepages::Backing::DEFAULT;
+    if(count > 0) {
+	try {
+	    new_dense = hashtable::allocArray<V>(count,backing,&mapped,&got);
+	    new_present = new uint64_t[(count + 63) / 64]();
+	} catch(std::bad_alloc&) {
+	    if(new_dense != nullptr) {
+		hashtable::freeArray(new_dense,count,mapped);
+	    }
+	    return false;
+	}
+    }
+    freeDense();
+    denseMin = lo;
+    denseCount = count;
+    dense = new_dense;
+    present = new_present;
+    denseMapped = mapped;
+    denseObtained = got;
+    return true;
+}
+
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::presize(Index entries) {
+    if(len != 0) {
+	return false;
+    }
+    // the capacity resizeHashTable would neither grow nor shrink at `entries`
+    Index newCap = entries / 2 + 1;
+    if(newCap <= capacity) {
+	return true;
+    }
+    TRACE_SPAN_ARGS("HashTable::presize", capacity, newCap);
+    try {
+	HashTable<K,V,Index> newTable(key2int,newCap,false,backing);
+	if(hardened) {
+	    newTable.harden(seed);
+	}
+	adoptBuckets(newTable);
+	return true;
+    } catch(...) {
+	return false;
+    }
+}
+
+template<class K,class V,class Index>
+int HashTable<K,V,Index>::shardOf(const K& key,int shards) const {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	// whole presence words per shard, the bits of one word are set with a plain |=
+	Index words = (denseCount + 63) / 64;
+	return (int)((long long)(d >> 6) * shards / words);
+    }
+    return (int)((long long)hashKey(key) * shards / capacity);
+}
+
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::insertShard(const K key,const V& val) {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	if(densePresent(d)) {
+	    return false;
+	}
+	dense[d] = val;
+	present[d >> 6] |= (uint64_t)1 << (d & 63);
+	return true;
+    }
+    Index pos = hashKey(key);
+    if(lookup(pos,key) != nullptr) {
+	return false;
+    }
+    hashtable::Node<K,V>* n = new hashtable::Node<K,V>();
+    n->key = key;
+    n->value = val;
+    n->next = table[pos].next;
+    table[pos].next = n;
+    binAdd(pos,n);
+    return true;
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::commitShards(Index inserted) {
+    len += inserted;
+    denseLen = 0;
+    for(Index w = 0; w < (denseCount + 63) / 64; w++) {
+	denseLen += __builtin_popcountll(present[w]);
+    }
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::clear() {
+    for(Index i = 0; i<capacity; i++) {
+	hashtable::deleteList(table[i].next);
 	table[i].next = nullptr;
+	if(bins != nullptr) {
+	    delete[] bins[i].nodes;
+	    bins[i].nodes = nullptr;
+	    bins[i].size = 0;
+	    bins[i].capacity = 0;
+	}
+    }
+    for(Index i = nextDense(0); denseLen > 0 && i >= 0; i = nextDense(i + 1)) {
+	dense[i] = V();
+    }
+    for(Index w = 0; w < (denseCount + 63) / 64; w++) {
+	present[w] = 0;
     }
+    len = 0;
+    denseLen = 0;
 }
 
-template<class K,class V>
-HashTable<K,V>& HashTable<K,V>::operator=(const HashTable &other) {
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::denseInsert(Index i,const V& val) {
+    if(densePresent(i)) {
+	return false;
+    }
+    dense[i] = val;
+    present[i >> 6] |= (uint64_t)1 << (i & 63);
+    denseLen++;
+    len++;
+    return true;
+}
+
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::denseErase(Index i) {
+    if(!densePresent(i)) {
+	return false;
+    }
+    dense[i] = V();
+    present[i >> 6] &= ~((uint64_t)1 << (i & 63));
+    denseLen--;
+    len--;
+    return true;
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::adoptBuckets(HashTable& other) {
+    std::swap(table,other.table);
+    std::swap(capacity,other.capacity);
+    std::swap(bins,other.bins);
+    std::swap(tableMapped,other.tableMapped);
+    std::swap(obtained,other.obtained);
+}
+
+template<class K,class V,class Index>
+uint64_t HashTable<K,V,Index>::randomSeed() {
+    uint64_t s = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    try {
+	std::random_device rd;
+	s ^= ((uint64_t)rd() << 32) ^ rd();
+    } catch(...) {
+	// no entropy source, the clock alone still differs per instance and per run
+    }
+    // atomic: tables of different DSpotify objects may be created from several threads
+    static std::atomic<uint64_t> counter(0);
+    return hashtable::mix64(s + (++counter) * 0x9e3779b97f4a7c15ULL);
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::harden(uint64_t s) {
+    assert(len == 0);
+    if(bins == nullptr) {
+	bins = new hashtable::Bin<K,V,Index>[capacity];
+	for(Index i = 0; i<capacity; i++) {
+	    bins[i].nodes = nullptr;
+	    bins[i].size = 0;
+	    bins[i].capacity = 0;
+	}
+    }
+    hardened = true;
+    seed = s;
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::freeBins() {
+    if(bins == nullptr) {
+	return;
+    }
+    for(Index i = 0; i<capacity; i++) {
+	delete[] bins[i].nodes;
+    }
+    delete[] bins;
+    bins = nullptr;
+}
+
+template<class K,class V,class Index>
+hashtable::Node<K,V>* HashTable<K,V,Index>::binFind(Index pos,const K& key) const {
+    const hashtable::Bin<K,V,Index>& bin = bins[pos];
+    Index lo = 0;
+    Index hi = bin.size;
+    while(lo < hi) {
+	Index mid = lo + (hi - lo) / 2;
+	if(bin.nodes[mid]->key < key) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    if(lo < bin.size && bin.nodes[lo]->key == key) {
+	return bin.nodes[lo];
+    }
+    return nullptr;
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::treeify(Index pos) {
+    hashtable::Bin<K,V,Index>& bin = bins[pos];
+    int count = 0;
+    for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr; it = it->next) {
+	count++;
+    }
+    bin.nodes = new hashtable::Node<K,V>*[count * 2];
+    bin.capacity = count * 2;
+    bin.size = 0;
+    for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr; it = it->next) {
+	bin.nodes[bin.size++] = it;
+    }
+    std::sort(bin.nodes,bin.nodes + bin.size,[](const hashtable::Node<K,V>* a,const hashtable::Node<K,V>* b) {
+	return a->key < b->key;
+    });
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::binAdd(Index pos,hashtable::Node<K,V>* n) {
+    if(bins == nullptr) {
+	return;
+    }
+    hashtable::Bin<K,V,Index>& bin = bins[pos];
+    try {
+	if(bin.nodes == nullptr) {
+	    int count = 0;
+	    for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr && count <= treeify_threshold; it = it->next) {
+		count++;
+	    }
+	    if(count > treeify_threshold) {
+		treeify(pos);
+	    }
+	    return;
+	}
+	if(bin.size == bin.capacity) {
+	    hashtable::Node<K,V>** bigger = new hashtable::Node<K,V>*[bin.capacity * 2];
+	    std::copy(bin.nodes,bin.nodes + bin.size,bigger);
+	    delete[] bin.nodes;
+	    bin.nodes = bigger;
+	    bin.capacity *= 2;
+	}
+	Index i = bin.size;
+	while(i > 0 && n->key < bin.nodes[i-1]->key) {
+	    bin.nodes[i] = bin.nodes[i-1];
+	    i--;
+	}
+	bin.nodes[i] = n;
+	bin.size++;
+    } catch(std::bad_alloc&) {
+	// a chain without a bin is still correct, just slower to search
+	delete[] bin.nodes;
+	bin.nodes = nullptr;
+	bin.size = 0;
+	bin.capacity = 0;
+    }
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::binRemove(Index pos,hashtable::Node<K,V>* n) {
+    if(bins == nullptr || bins[pos].nodes == nullptr) {
+	return;
+    }
+    hashtable::Bin<K,V,Index>& bin = bins[pos];
+    Index lo = 0;
+    Index hi = bin.size;
+    while(lo < hi) {
+	Index mid = lo + (hi - lo) / 2;
+	if(bin.nodes[mid]->key < n->key) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    Index i = lo;
+    while(i < bin.size && bin.nodes[i] != n) {
+	i++;
+    }
+    if(i < bin.size) {
+	std::copy(bin.nodes + i + 1,bin.nodes + bin.size,bin.nodes + i);
+	bin.size--;
+    }
+    if(bin.size < untreeify_threshold) {
+	delete[] bin.nodes;
+	bin.nodes = nullptr;
+	bin.size = 0;
+	bin.capacity = 0;
+    }
+}
+
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::rebuildBins() {
+    if(bins == nullptr) {
+	return;
+    }
+    for(Index i = 0; i<capacity; i++) {
+	int count = 0;
+	for(hashtable::Node<K,V>* it = table[i].next; it != nullptr && count <= treeify_threshold; it = it->next) {
+	    count++;
+	}
+	if(count > treeify_threshold) {
+	    try {
+		treeify(i);
+	    } catch(std::bad_alloc&) {
+		bins[i].nodes = nullptr;
+		bins[i].size = 0;
+		bins[i].capacity = 0;
+	    }
+	}
+    }
+}
+
+template<class K,class V,class Index>
+HashTable<K,V,Index>& HashTable<K,V,Index>::operator=(const HashTable &other) {
     if(this==&other) {
 	return *this;
     }
-    int old_len = len;
-    int old_capacity = capacity;
+    Index old_len = len;
+    Index old_capacity = capacity;
     hashtable::Node<K,V>* old_table = table;
-    table = new hashtable::Node<K,V>[other.capacity];
+    bool old_mapped = tableMapped;
+    hugepages::Backing old_obtained = obtained;
+    table = allocTable(other.capacity,&tableMapped,&obtained);
+    hashtable::Bin<K,V,Index>* new_bins = nullptr;
+    V* new_dense = nullptr;
+    uint64_t* new_present = nullptr;
+    bool new_dense_mapped = false;
+    hugepages::Backing new_dense_got = hugepages::Backing::DEFAULT;
     try {
+	if(other.denseCount > 0) {
+	    new_dense = hashtable::allocArray<V>(other.denseCount,backing,&new_dense_mapped,&new_dense_got);
+	    new_present = new uint64_t[(other.denseCount + 63) / 64];
+	    std::copy(other.dense,other.dense + other.denseCount,new_dense);
+	    std::copy(other.present,other.present + (other.denseCount + 63) / 64,new_present);
+	}
+	if(other.bins != nullptr) {
+	    new_bins = new hashtable::Bin<K,V,Index>[other.capacity];
+	    for(Index i = 0; i<other.capacity; i++) {
+		new_bins[i].nodes = nullptr;
+		new_bins[i].size = 0;
+		new_bins[i].capacity = 0;
+	    }
+	}
 	len = other.len;
 	capacity = other.capacity;
-	for(int i = 0; i<other.capacity; i++) {
+	for(Index i = 0; i<other.capacity; i++) {
 	    hashtable::Node<K,V>* lst = copyList(other.table[i].next);
 	    table[i].next = lst;
 	}
 	if(old_table != nullptr) {
-	    for(int i = 0;i<old_capacity;i++) {
+	    for(Index i = 0;i<old_capacity;i++) {
 		deleteList(old_table[i].next);
 	    }
-	    delete[] old_table;
+	    freeTable(old_table,old_capacity,old_mapped);
+	}
+	if(bins != nullptr) {
+	    for(Index i = 0; i<old_capacity; i++) {
+		delete[] bins[i].nodes;
+	    }
+	    delete[] bins;
 	}
+	bins = new_bins;
+	hardened = other.hardened;
+	seed = other.seed;
+	rebuildBins();
+	freeDense();
+	denseMin = other.denseMin;
+	denseCount = other.denseCount;
+	denseLen = other.denseLen;
+	dense = new_dense;
+	present = new_present;
+	denseMapped = new_dense_mapped;
+	denseObtained = new_dense_got;
 	return *this;
     } catch(...) {
 	len = old_len;
 	capacity = old_capacity;
-	for (int i = 0; i<other.capacity; ++i) {
+	for (Index i = 0; i<other.capacity; ++i) {
 	    deleteList(table[i].next);
 	}
+	freeTable(table,other.capacity,tableMapped);
+	delete[] new_bins;
+	if(new_dense != nullptr) {
+	    hashtable::freeArray(new_dense,other.denseCount,new_dense_mapped);
+	}
+	delete[] new_present;
 	table = old_table;
+	tableMapped = old_mapped;
+	obtained = old_obtained;
 	throw;
     }
 }
-template<class K,class V>
-HashTable<K,V>::~HashTable() noexcept {
-    for (int i = 0; i<capacity; ++i) {
+template<class K,class V,class Index>
+HashTable<K,V,Index>::~HashTable() noexcept {
+    freeBins();
+    for (Index i = 0; i<capacity; ++i) {
 	    hashtable::Node<K,V>* iter = table[i].next;
 	    deleteList(iter);
 	}
-    delete[] table;
+    freeTable(table,capacity,tableMapped);
+    freeDense();
 }
 
-template<class K,class V>
-bool HashTable<K,V>::contains(const K key) const {
-    int pos = hashKey(key);
-    assert(pos>=0 && pos<capacity);
-    for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr; it = it->next) {
-	if(key == it->key) {
-	    return true;
-	}
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::contains(const K key) const {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	return densePresent(d);
     }
-    return false;
+    Index pos = hashKey(key);
+    assert(pos>=0 && pos<capacity);
+    return lookup(pos,key) != nullptr;
 }
 
-template<class K,class V>
-int HashTable<K,V>::howManyContains(const K key ) const {
-    int pos = hashKey(key);
+template<class K,class V,class Index>
+int HashTable<K,V,Index>::howManyContains(const K key ) const {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	return densePresent(d) ? 1 : 0;
+    }
+    Index pos = hashKey(key);
     int count = 0 ; 
     assert(pos>=0 && pos<capacity);
     for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr; it = it->next) {
@@ -198,9 +821,16 @@ int HashTable<K,V>::howManyContains(const K key ) const {
     return count ; 
 }
 
-template<class K,class V>
-hashtable::Node<K,V>* HashTable<K,V>::insertAssumeCapacity(const K key,const V& val,bool *exists) {
-    int pos = hashKey(key);
+template<class K,class V,class Index>
+hashtable::Node<K,V>* HashTable<K,V,Index>::insertAssumeCapacity(const K key,const V& val,bool *exists) {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	if(!denseInsert(d,val) && exists != nullptr) {
+	    *exists = true;
+	}
+	return nullptr;
+    }
+    Index pos = hashKey(key);
     assert(pos>=0 && pos<capacity);
     if(contains(key)) {
 	if(exists != nullptr) {
@@ -208,6 +838,17 @@ hashtable::Node<K,V>* HashTable<K,V>::insertAssumeCapacity(const K key,const V&
 	}
 	return nullptr;
     }
+    if(hardened) {
+	// hardened chains grow at the head, so a flooded bucket is never walked to its end
+	hashtable::Node<K,V>* n = new hashtable::Node<K,V>();
+	n->key = key;
+	n->value = val;
+	n->next = table[pos].next;
+	table[pos].next = n;
+	len++;
+	binAdd(pos,n);
+	return n;
+    }
     hashtable::Node<K,V>* last = &table[pos];
     for(long long __guard = 1000000000000; last->next != nullptr; last = last->next, __guard--) {
 	assert(last->next->key != key);
@@ -232,8 +873,8 @@ hashtable::Node<K,V>* HashTable<K,V>::insertAssumeCapacity(const K key,const V&
     return n;
 } 
 
-template<class K,class V>
-void HashTable<K,V>::insert(const K key,const V& val) {
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::insert(const K key,const V& val) {
     if(!resizeHashTable()) {
 #ifndef NDEBUG
 	std::cout << "failed to resize table while doing insert";
@@ -245,10 +886,28 @@ void HashTable<K,V>::insert(const K key,const V& val) {
     (void)insertAssumeCapacity(key,val,nullptr);
 }
 
-template<class K,class V>
-hashtable::Node<K,V>* HashTable<K,V>::insertAssumeCapacity_record(const K key,const V& val,bool *exists) {
-    int pos = hashKey(key);
+template<class K,class V,class Index>
+hashtable::Node<K,V>* HashTable<K,V,Index>::insertAssumeCapacity_record(const K key,const V& val,bool *exists) {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	if(!denseInsert(d,val) && exists != nullptr) {
+	    *exists = true;
+	}
+	return nullptr;
+    }
+    Index pos = hashKey(key);
     assert(pos>=0 && pos<capacity);
+    if(hardened) {
+	// hardened chains grow at the head, so a flooded bucket is never walked to its end
+	hashtable::Node<K,V>* n = new hashtable::Node<K,V>();
+	n->key = key;
+	n->value = val;
+	n->next = table[pos].next;
+	table[pos].next = n;
+	len++;
+	binAdd(pos,n);
+	return n;
+    }
     hashtable::Node<K,V>* last = &table[pos];
     for(long long __guard = 1000000000000; last->next != nullptr; last = last->next, __guard--) {
 	assert(last->next->key != key);
@@ -273,8 +932,8 @@ hashtable::Node<K,V>* HashTable<K,V>::insertAssumeCapacity_record(const K key,co
     return n;
 } 
 
-template<class K,class V>//Rawi : added here ?
-void HashTable<K,V>::insert_record(const K key,const V& val) {
+template<class K,class V,class Index>//Rawi : added here ?
+void HashTable<K,V,Index>::insert_record(const K key,const V& val) {
     if(!resizeHashTable_record()) {
 #ifndef NDEBUG
 	std::cout << "failed to resize table while doing insert";
@@ -285,10 +944,15 @@ void HashTable<K,V>::insert_record(const K key,const V& val) {
     // Node<K,V>* node = insertAssumeCapacity(key,val,&exists);
     (void)insertAssumeCapacity_record(key,val,nullptr);
 }
-template<class K,class V>
-V& HashTable<K,V>::findByValue(const K key , const V val) {
+template<class K,class V,class Index>
+V& HashTable<K,V,Index>::findByValue(const K key , const V val) {
     assert(contains(key) && "key is not found in find function");
-    int pos = hashKey(key);
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	assert(val == dense[d]);
+	return dense[d];
+    }
+    Index pos = hashKey(key);
     assert(pos>=0 and pos<capacity);
     for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr; it = it->next) {
 	if(key == it->key ) {
@@ -302,99 +966,235 @@ V& HashTable<K,V>::findByValue(const K key , const V val) {
     return table[pos].value;
 }
 
-template<class K,class V>
-V& HashTable<K,V>::find(const K key) {
+template<class K,class V,class Index>
+V& HashTable<K,V,Index>::find(const K key) {
     assert(contains(key) && "key is not found in find function");
-    int pos = hashKey(key);
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	return dense[d];
+    }
+    Index pos = hashKey(key);
     assert(pos>=0 and pos<capacity);
-    for(hashtable::Node<K,V>* it = table[pos].next; it != nullptr; it = it->next) {
-	if(key == it->key) {
-	    return it->value;
-	}
+    hashtable::Node<K,V>* it = lookup(pos,key);
+    if(it != nullptr) {
+	return it->value;
     }
     assert(false && "reach Undefined state in find");
     return table[pos].value;
 }
-template<class K,class V>
-bool HashTable<K,V>::deleteValue(const K key ,const V val) {
-  int pos = hashKey(key);
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::findMany(const K* keys,size_t n,V** out) {
+    const static size_t group = 16;
+    Index pos[group];
+    for(size_t base = 0; base < n; base += group) {
+	size_t cnt = (n - base < group) ? n - base : group;
+	// pass 1: hash every key of the group and prefetch its bucket head. keys in the
+	// dense range are resolved right away (pos -1), the bitmap word is one load
+	for(size_t j = 0; j<cnt; j++) {
+	    Index d = denseIndex(keys[base+j]);
+	    if(d >= 0) {
+		pos[j] = -1;
+		out[base+j] = densePresent(d) ? &dense[d] : nullptr;
+		continue;
+	    }
+	    pos[j] = hashKey(keys[base+j]);
+	    assert(pos[j]>=0 && pos[j]<capacity);
+	    __builtin_prefetch(&table[pos[j]]);
+	}
+	// pass 2: the heads are (hopefully) in cache now, prefetch the first chain node
+	for(size_t j = 0; j<cnt; j++) {
+	    if(pos[j] >= 0) {
+		__builtin_prefetch(table[pos[j]].next);
+	    }
+	}
+	// pass 3: resolve, prefetching the next node of each chain as we walk it
+	for(size_t j = 0; j<cnt; j++) {
+	    if(pos[j] < 0) {
+		continue;
+	    }
+	    const K& key = keys[base+j];
+	    out[base+j] = nullptr;
+	    if(bins != nullptr && bins[pos[j]].nodes != nullptr) {
+		hashtable::Node<K,V>* it = binFind(pos[j],key);
+		out[base+j] = it != nullptr ? &it->value : nullptr;
+		continue;
+	    }
+	    for(hashtable::Node<K,V>* it = table[pos[j]].next; it != nullptr; it = it->next) {
+		__builtin_prefetch(it->next);
+		if(key == it->key) {
+		    out[base+j] = &it->value;
+		    break;
+		}
+	    }
+	}
+    }
+}
+template<class K,class V,class Index>
+const void* HashTable<K,V,Index>::probeStart(const K& key,Probe* p) const {
+    p->stage = 0;
+    p->node = nullptr;
+    Index d = denseIndex(key);
+    p->isDense = d >= 0;
+    if(p->isDense) {
+	p->pos = d;
+	return &present[d >> 6];
+    }
+    p->pos = hashKey(key);
+    assert(p->pos>=0 && p->pos<capacity);
+    return &table[p->pos];
+}
+template<class K,class V,class Index>
+const void* HashTable<K,V,Index>::probeStep(const K& key,Probe* p,V** out) {
+    *out = nullptr;
+    if(p->isDense) {
+	if(p->stage == 0) {
+	    if(!densePresent(p->pos)) {
+		return nullptr;
+	    }
+	    p->stage = 1;
+	    return &dense[p->pos];
+	}
+	*out = &dense[p->pos];
+	return nullptr;
+    }
+    if(p->stage == 0) {
+	p->stage = 1;
+	if(bins != nullptr && bins[p->pos].nodes != nullptr) {
+	    // flooded bucket: its sorted bin is searched in one go
+	    hashtable::Node<K,V>* it = binFind(p->pos,key);
+	    *out = it != nullptr ? &it->value : nullptr;
+	    return nullptr;
+	}
+	p->node = table[p->pos].next;
+	return p->node;
+    }
+    if(p->node == nullptr) {
+	return nullptr;
+    }
+    if(key == p->node->key) {
+	*out = &p->node->value;
+	return nullptr;
+    }
+    p->node = p->node->next;
+    return p->node;
+}
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::deleteValue(const K key ,const V val) {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	return densePresent(d) && val == dense[d] && denseErase(d);
+    }
+  Index pos = hashKey(key);
     assert(pos>=0 and pos<capacity);
     int found = false;
     for(hashtable::Node<K,V>* it = &table[pos]; it->next != nullptr; it = it->next) {
 	if(key == it->next->key && val == it->next->value) {
 	    hashtable::Node<K,V>* entry = it->next;
 	    it->next = entry->next;
+	    binRemove(pos,entry);
 	    found = true;
 	    delete entry;
 	    break;
 	}
     }
-  
-    len-- ; 
+    if(found) {
+	len--;
+	// shrink once the table is mostly empty. if that fails the table just stays bigger
+	(void)resizeHashTable();
+    }
     return found;
 }
-template<class K,class V>
-bool HashTable<K,V>::deleteEntry(const K key) {
-    int pos = hashKey(key);
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::deleteEntry(const K key) {
+    Index d = denseIndex(key);
+    if(d >= 0) {
+	return denseErase(d);
+    }
+    Index pos = hashKey(key);
     assert(pos>=0 and pos<capacity);
     int found = false;
     for(hashtable::Node<K,V>* it = &table[pos]; it->next != nullptr; it = it->next) {
 	if(key == it->next->key) {
 	    hashtable::Node<K,V>* entry = it->next;
 	    it->next = entry->next;
+	    binRemove(pos,entry);
 	    found = true;
 	    delete entry;
 	    break;
 	}
     }
+    if(found) {
+	len--;
+	(void)resizeHashTable();
+    }
     return found;
 }
-template<class K,class V>
-bool HashTable<K,V>::resizeHashTable() {
-    int newCap = min_capacity;
-    if(capacity == 0 || len > 2*capacity) {
-	newCap = capacity > 0 ? 2*capacity : min_capacity;
-    } else if(capacity > min_capacity && len * 4 < capacity) {
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::resizeHashTable() {
+    Index newCap = min_capacity;
+    // only the chained entries load the buckets
+    Index chained = len - denseLen;
+    // in long long: with a 32-bit Index both products wrap around 2^29 chained entries
+    if(capacity == 0 || chained > 2*(long long)capacity) {
+	if(capacity > 0 && 2*(long long)capacity != (long long)(Index)(2*(long long)capacity)) {
+	    return true; // the buckets cannot be indexed any wider, the bins absorb the longer chains
+	}
+	newCap = capacity > 0 ? (Index)(2*(long long)capacity) : min_capacity;
+    } else if(capacity > min_capacity && chained * 4LL < capacity) {
 	newCap = capacity/2;
     } else {
 	return true;
     }
+    TRACE_SPAN_ARGS("HashTable::resize", capacity, newCap);
     try {
-	HashTable<K,V> newTable(key2int,newCap);
-	for(int i = 0;i<this->capacity;i++) {
+	HashTable<K,V,Index> newTable(key2int,newCap,false,backing);
+	if(hardened) {
+	    newTable.harden(seed);
+	}
+	for(Index i = 0;i<this->capacity;i++) {
 	    for(hashtable::Node<K,V>* it = this->table[i].next;it != nullptr ; it=it->next) {
 		bool exists = false;
 		(void)newTable.insertAssumeCapacity(it->key,it->value,&exists);
 		assert(!exists && "two keys found while doing resize");
 	    }
 	}
-	*this = newTable;
+	adoptBuckets(newTable);
 	return true;
     } catch(...) {
 	return false;
     }
 }
 
-template<class K,class V>
-bool HashTable<K,V>::resizeHashTable_record() {
-    int newCap = min_capacity;
-    if(capacity == 0 || len > 2*capacity) {
-	newCap = capacity > 0 ? 2*capacity : min_capacity;
-    } else if(capacity > min_capacity && len * 4 < capacity) {
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::resizeHashTable_record() {
+    Index newCap = min_capacity;
+    // only the chained entries load the buckets
+    Index chained = len - denseLen;
+    // in long long: with a 32-bit Index both products wrap around 2^29 chained entries
+    if(capacity == 0 || chained > 2*(long long)capacity) {
+	if(capacity > 0 && 2*(long long)capacity != (long long)(Index)(2*(long long)capacity)) {
+	    return true; // the buckets cannot be indexed any wider, the bins absorb the longer chains
+	}
+	newCap = capacity > 0 ? (Index)(2*(long long)capacity) : min_capacity;
+    } else if(capacity > min_capacity && chained * 4LL < capacity) {
 	newCap = capacity/2;
     } else {
 	return true;
     }
+    TRACE_SPAN_ARGS("HashTable::resize", capacity, newCap);
     try {
-	HashTable<K,V> newTable(key2int,newCap);
-	for(int i = 0;i<this->capacity;i++) {
+	HashTable<K,V,Index> newTable(key2int,newCap,false,backing);
+	if(hardened) {
+	    newTable.harden(seed);
+	}
+	for(Index i = 0;i<this->capacity;i++) {
 	    for(hashtable::Node<K,V>* it = this->table[i].next;it != nullptr ; it=it->next) {
 		bool exists = false;
 		(void)newTable.insertAssumeCapacity_record(it->key,it->value,&exists);
 		assert(!exists && "two keys found while doing resize");
 	    }
 	}
-	*this = newTable;
+	adoptBuckets(newTable);
 	return true;
     } catch(...) {
 	return false;
@@ -402,36 +1202,46 @@ bool HashTable<K,V>::resizeHashTable_record() {
 }
 
 
-template<class K,class V>
-typename HashTable<K,V>::Iterator HashTable<K,V>::begin() {
-    int pos = 0;
-    while(table[pos].next == nullptr) {
+template<class K,class V,class Index>
+typename HashTable<K,V,Index>::Iterator HashTable<K,V,Index>::begin() {
+    // the dense entries come first, in key order
+    if(denseLen > 0) {
+	Iterator it(this,-1);
+	it.dpos = nextDense(0);
+	return it;
+    }
+    Index pos = 0;
+    while(pos < capacity && table[pos].next == nullptr) {
 	pos++;
     }
     return Iterator(this,pos);
 }
-template<class K,class V>
-typename HashTable<K,V>::Iterator HashTable<K,V>::end() {
+template<class K,class V,class Index>
+typename HashTable<K,V,Index>::Iterator HashTable<K,V,Index>::end() {
     return Iterator(this,capacity);
 }
 
-template<class K,class V>
-class HashTable<K,V>::Iterator {
-    const HashTable<K,V>* table;
-    int pos;
+template<class K,class V,class Index>
+class HashTable<K,V,Index>::Iterator {
+    const HashTable<K,V,Index>* table;
+    Index pos;
     hashtable::Node<K,V>* curr;
-    Iterator(const HashTable<K,V>* table,int pos);
-    friend class HashTable<K,V>;
+    Index dpos; // index into the dense array while on a dense entry, -1 otherwise
+    Iterator(const HashTable<K,V,Index>* table,Index pos);
+    friend class HashTable<K,V,Index>;
 public:
     hashtable::pair<K,V> operator*() const;
+    // the current entry without copying the value (operator* copies both)
+    K key() const;
+    V& value() const;
     Iterator& operator++();
     bool operator!=(const Iterator& it) const;
     Iterator(const Iterator&) = default;
     Iterator& operator=(const Iterator&) = default;
 };
 
-template<class K,class V>
-HashTable<K,V>::Iterator::Iterator(const HashTable<K,V>* table1,int pos1) : table(table1), pos(pos1)
+template<class K,class V,class Index>
+HashTable<K,V,Index>::Iterator::Iterator(const HashTable<K,V,Index>* table1,Index pos1) : table(table1), pos(pos1), dpos(-1)
 {
     if(pos < table1->capacity and pos>=0) {
 	curr = table1->table[pos].next;
@@ -440,15 +1250,50 @@ HashTable<K,V>::Iterator::Iterator(const HashTable<K,V>* table1,int pos1) : tabl
     }
 }
 
-template<class K,class V>
-hashtable::pair<K,V> HashTable<K,V>::Iterator::operator*() const {
+template<class K,class V,class Index>
+hashtable::pair<K,V> HashTable<K,V,Index>::Iterator::operator*() const {
+    if(dpos >= 0) {
+	K key = (K)(table->denseMin + dpos);
+	hashtable::pair<K,V> p(key,table->dense[dpos]);
+	return p;
+    }
     assert(curr != nullptr);
     
     hashtable::pair<K,V> p(curr->key,curr->value);
     return p;
 }
-template<class K,class V>
-typename HashTable<K,V>::Iterator& HashTable<K,V>::Iterator::operator++() {
+template<class K,class V,class Index>
+K HashTable<K,V,Index>::Iterator::key() const {
+    if(dpos >= 0) {
+	return (K)(table->denseMin + dpos);
+    }
+    assert(curr != nullptr);
+    return curr->key;
+}
+template<class K,class V,class Index>
+V& HashTable<K,V,Index>::Iterator::value() const {
+    if(dpos >= 0) {
+	return table->dense[dpos];
+    }
+    assert(curr != nullptr);
+    return curr->value;
+}
+template<class K,class V,class Index>
+typename HashTable<K,V,Index>::Iterator& HashTable<K,V,Index>::Iterator::operator++() {
+    if(dpos >= 0) {
+	dpos = table->nextDense(dpos + 1);
+	if(dpos >= 0) {
+	    return *this;
+	}
+	// past the dense array, continue with the first chain
+	for(pos = 0; pos < table->capacity; pos++) {
+	    if(table->table[pos].next != nullptr) {
+		curr = table->table[pos].next;
+		break;
+	    }
+	}
+	return *this;
+    }
     if(curr == nullptr) {
 	return *this;
     }
@@ -468,13 +1313,13 @@ typename HashTable<K,V>::Iterator& HashTable<K,V>::Iterator::operator++() {
     }
     return *this;
 }
-template<class K,class V>
-bool HashTable<K,V>::Iterator::operator!=(const Iterator& iter) const {
-    return table != iter.table or curr != iter.curr;
+template<class K,class V,class Index>
+bool HashTable<K,V,Index>::Iterator::operator!=(const Iterator& iter) const {
+    return table != iter.table or curr != iter.curr or dpos != iter.dpos;
 }
 
-template<class K,class V>
-void HashTable<K,V>::print() {
+template<class K,class V,class Index>
+void HashTable<K,V,Index>::print() {
     // std::cout << "----------CHAIN-TABLE-BEGIN------------\n";
     for(auto it = begin(); it!=end(); ++it) {
 	hashtable::pair<K,V> p = *it;
@@ -0,0 +1,133 @@
+#include "hugepages.h"
+#include <cstddef>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace hugepages {
+    size_t pageSize(Backing b) {
+	if(b == Backing::DEFAULT) {
+	    return (size_t)sysconf(_SC_PAGESIZE);
+	}
+	return huge_page_size;
+    }
+
+    const char* name(Backing b) {
+	switch(b) {
+	case Backing::HUGETLB: return "hugetlb";
+	case Backing::TRANSPARENT: return "transparent";
+	default: return "default";
+	}
+    }
+
+    static size_t roundUp(size_t bytes, size_t to) {
+	return (bytes + to - 1) / to * to;
+    }
+
+    void* allocate(size_t bytes, Backing want, Backing* got) {
+	void* p = MAP_FAILED;
+	size_t len = roundUp(bytes, huge_page_size);
+#ifdef MAP_HUGETLB
+	if(want == Backing::HUGETLB) {
+	    p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	    if(p != MAP_FAILED) {
+		*got = Backing::HUGETLB;
+		return p;
+	    }
+	}
+#endif
+	// no reserved huge pages (or none wanted): regular mapping, then ask for THP
+	p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED) {
+	    return nullptr;
+	}
+	*got = Backing::DEFAULT;
+#ifdef MADV_HUGEPAGE
+	if(want != Backing::DEFAULT && madvise(p, len, MADV_HUGEPAGE) == 0) {
+	    *got = Backing::TRANSPARENT;
+	}
+#endif
+	return p;
+    }
+
+    void release(void* p, size_t bytes) {
+	if(p != nullptr) {
+	    munmap(p, roundUp(bytes, huge_page_size));
+	}
+    }
+
+    Pool::Pool(Backing w, size_t chunk)
+	: want(w), obtained(w), chunkBytes(chunk), slot(0), slotBytes(0), chunks(nullptr),
+	  bump(nullptr), bumpEnd(nullptr), freeList(nullptr)
+    {
+	lock.clear();
+    }
+
+    Pool::~Pool() {
+	while(chunks != nullptr) {
+	    Chunk* next = chunks->next;
+	    release(chunks, chunks->bytes);
+	    chunks = next;
+	}
+    }
+
+    Backing Pool::backing() const {
+	return obtained;
+    }
+
+    bool Pool::grow() {
+	Backing got = Backing::DEFAULT;
+	void* p = hugepages::allocate(chunkBytes, want, &got);
+	if(p == nullptr) {
+	    return false;
+	}
+	Chunk* c = static_cast<Chunk*>(p);
+	c->next = chunks;
+	c->bytes = chunkBytes;
+	chunks = c;
+	bump = static_cast<char*>(p) + roundUp(sizeof(Chunk), alignof(std::max_align_t));
+	bumpEnd = static_cast<char*>(p) + chunkBytes;
+	if(got < obtained) {
+	    obtained = got;
+	}
+	return true;
+    }
+
+    void* Pool::allocate(size_t bytes) {
+	while(lock.test_and_set(std::memory_order_acquire)) {
+	}
+	if(slot == 0) {
+	    slotBytes = bytes;
+	    // every slot must be able to hold the free list link and stay aligned
+	    slot = roundUp(bytes < sizeof(void*) ? sizeof(void*) : bytes, alignof(std::max_align_t));
+	}
+	if(bytes != slotBytes) {
+	    lock.clear(std::memory_order_release);
+	    return ::operator new(bytes);
+	}
+	void* p = nullptr;
+	if(freeList != nullptr) {
+	    p = freeList;
+	    freeList = *static_cast<void**>(p);
+	} else if((bump != nullptr && bump + slot <= bumpEnd) || grow()) {
+	    p = bump;
+	    bump += slot;
+	}
+	lock.clear(std::memory_order_release);
+	if(p == nullptr) {
+	    throw std::bad_alloc();
+	}
+	return p;
+    }
+
+    void Pool::deallocate(void* p, size_t bytes) {
+	if(bytes != slotBytes) {
+	    ::operator delete(p);
+	    return;
+	}
+	while(lock.test_and_set(std::memory_order_acquire)) {
+	}
+	*static_cast<void**>(p) = freeList;
+	freeList = p;
+	lock.clear(std::memory_order_release);
+    }
+}
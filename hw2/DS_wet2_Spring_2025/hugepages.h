@@ -0,0 +1,92 @@
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <new>
+
+// Allocation backend for large, long-lived arrays (HashTable bucket arrays) and for the
+// Song/Genre objects, to cut TLB misses on big catalogs.
+namespace hugepages {
+    // what was asked for, and what was actually obtained
+    enum struct Backing {
+	DEFAULT     = 0, // regular 4K pages from new/malloc
+	TRANSPARENT = 1, // mmap + madvise(MADV_HUGEPAGE): 2M pages whenever the kernel can
+	HUGETLB     = 2, // mmap(MAP_HUGETLB): reserved 2M pages, falls back to TRANSPARENT
+    };
+
+    const static size_t huge_page_size = 2 * 1024 * 1024;
+
+    // page size in bytes that a region with this backing is mapped with
+    size_t pageSize(Backing b);
+    const char* name(Backing b);
+
+    // maps at least `bytes` zero-filled bytes, trying `want` first and falling back to
+    // weaker backings. *got receives what was obtained. returns nullptr on failure
+    void* allocate(size_t bytes, Backing want, Backing* got);
+    // bytes must be the value passed to allocate
+    void release(void* p, size_t bytes);
+
+    // Fixed-size slot allocator carved out of big huge-page backed chunks. The slot size is
+    // taken from the first allocation; other sizes go to operator new. Freed slots are reused,
+    // the chunks are only unmapped with the pool. Thread safe.
+    class Pool
+    {
+    public:
+	explicit Pool(Backing want, size_t chunkBytes = 16 * huge_page_size);
+	~Pool();
+	Pool(const Pool&) = delete;
+	Pool& operator=(const Pool&) = delete;
+
+	void* allocate(size_t bytes);
+	void deallocate(void* p, size_t bytes);
+	// weakest backing among the chunks mapped so far (want, if nothing was mapped yet)
+	Backing backing() const;
+
+    private:
+	struct Chunk {
+	    Chunk* next;
+	    size_t bytes;
+	};
+	Backing want;
+	Backing obtained;
+	size_t chunkBytes;
+	size_t slot;      // bytes per slot
+	size_t slotBytes; // the request size the pool serves
+	Chunk* chunks;
+	char* bump;      // next never-used slot of the newest chunk
+	char* bumpEnd;
+	void* freeList;  // returned slots, linked through their first word
+	std::atomic_flag lock;
+	bool grow();
+    };
+
+    // std allocator over a shared Pool, for allocate_shared
+    template<class T>
+    struct PoolAllocator {
+	typedef T value_type;
+	std::shared_ptr<Pool> pool;
+
+	explicit PoolAllocator(const std::shared_ptr<Pool>& p) : pool(p) {}
+	template<class U>
+	PoolAllocator(const PoolAllocator<U>& other) : pool(other.pool) {}
+
+	T* allocate(size_t n) {
+	    return static_cast<T*>(pool->allocate(n * sizeof(T)));
+	}
+	void deallocate(T* p, size_t n) {
+	    pool->deallocate(p, n * sizeof(T));
+	}
+	template<class U>
+	bool operator==(const PoolAllocator<U>& other) const {
+	    return pool == other.pool;
+	}
+	template<class U>
+	bool operator!=(const PoolAllocator<U>& other) const {
+	    return pool != other.pool;
+	}
+    };
+}
+
+#endif /* HUGEPAGES_H */
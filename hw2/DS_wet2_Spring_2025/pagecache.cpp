@@ -0,0 +1,197 @@
+#include "pagecache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <new>
+
+PageCache::PageCache()
+  : fd(-1), directIO(false), maxPages(0), count(0), memory(nullptr), hand(0), hitCount(0), missCount(0),
+    writeCount(0)
+{}
+
+PageCache::~PageCache() {
+    close();
+}
+
+bool PageCache::open(const char* path, int pages, size_t frames, bool direct) {
+    if (fd >= 0 || path == nullptr || pages <= 0 || frames == 0) {
+        return false;
+    }
+    if (frames > (size_t)pages) {
+        frames = (size_t)pages;
+    }
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+    int f = -1;
+#ifdef O_DIRECT
+    if (direct) {
+        f = ::open(path, flags | O_DIRECT, 0644);
+    }
+#endif
+    // file systems without O_DIRECT (tmpfs) refuse it with EINVAL, use the kernel cache then
+    directIO = f >= 0;
+    if (f < 0) {
+        f = ::open(path, flags, 0644);
+    }
+    if (f < 0) {
+        return false;
+    }
+    // anonymous mapping: page aligned as O_DIRECT needs, and returned to the system on close
+    void* m = mmap(nullptr, frames * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED) {
+        ::close(f);
+        return false;
+    }
+    try {
+        info.reset(new Frame[frames]);
+        frameOf.reset(new int32_t[pages]);
+    } catch (std::bad_alloc&) {
+        munmap(m, frames * page_size);
+        ::close(f);
+        info.reset();
+        return false;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        info[i].page = -1;
+        info[i].referenced = false;
+        info[i].dirty = false;
+    }
+    memset(frameOf.get(), 0xff, sizeof(int32_t) * (size_t)pages);
+    fd = f;
+    maxPages = pages;
+    count = frames;
+    memory = static_cast<char*>(m);
+    hand = 0;
+    hitCount = 0;
+    missCount = 0;
+    writeCount = 0;
+    return true;
+}
+
+void PageCache::close() {
+    if (fd < 0) {
+        return;
+    }
+    (void)flush();
+    munmap(memory, count * page_size);
+    ::close(fd);
+    fd = -1;
+    memory = nullptr;
+    count = 0;
+    info.reset();
+    frameOf.reset();
+}
+
+bool PageCache::writeBack(size_t f) {
+    Frame& fr = info[f];
+    if (!fr.dirty) {
+        return true;
+    }
+    off_t off = (off_t)fr.page * (off_t)page_size;
+    for (size_t done = 0; done < page_size;) {
+        ssize_t n = pwrite(fd, memory + f * page_size + done, page_size - done, off + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += (size_t)n;
+    }
+    fr.dirty = false;
+    writeCount++;
+    return true;
+}
+
+size_t PageCache::victim() {
+    // at most two sweeps: the first may only clear reference bits
+    for (size_t steps = 0; steps < 2 * count + 1; steps++) {
+        size_t f = hand;
+        hand = hand + 1 == count ? 0 : hand + 1;
+        Frame& fr = info[f];
+        if (fr.page >= 0 && fr.referenced) {
+            fr.referenced = false;
+            continue;
+        }
+        if (fr.page >= 0) {
+            if (!writeBack(f)) {
+                return count;
+            }
+            frameOf[fr.page] = -1;
+            fr.page = -1;
+        }
+        return f;
+    }
+    return count;
+}
+
+char* PageCache::page(int pageNo, bool dirty) {
+    if (fd < 0 || pageNo < 0 || pageNo >= maxPages) {
+        return nullptr;
+    }
+    int32_t f = frameOf[pageNo];
+    if (f >= 0) {
+        hitCount++;
+        info[f].referenced = true;
+        info[f].dirty = info[f].dirty || dirty;
+        return memory + (size_t)f * page_size;
+    }
+    missCount++;
+    size_t v = victim();
+    if (v == count) {
+        return nullptr;
+    }
+    char* buf = memory + v * page_size;
+    off_t off = (off_t)pageNo * (off_t)page_size;
+    size_t done = 0;
+    while (done < page_size) {
+        ssize_t n = pread(fd, buf + done, page_size - done, off + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return nullptr;
+        }
+        if (n == 0) {
+            break; // past the end of the file: never written
+        }
+        done += (size_t)n;
+    }
+    memset(buf + done, 0, page_size - done);
+    info[v].page = pageNo;
+    info[v].referenced = true;
+    info[v].dirty = dirty;
+    frameOf[pageNo] = (int32_t)v;
+    return buf;
+}
+
+bool PageCache::flush() {
+    bool ok = true;
+    for (size_t f = 0; f < count; f++) {
+        if (info[f].page >= 0) {
+            ok = writeBack(f) && ok;
+        }
+    }
+    return ok;
+}
+
+bool PageCache::direct() const {
+    return directIO;
+}
+
+size_t PageCache::frames() const {
+    return count;
+}
+
+long long PageCache::hits() const {
+    return hitCount;
+}
+
+long long PageCache::misses() const {
+    return missCount;
+}
+
+long long PageCache::writes() const {
+    return writeCount;
+}
@@ -0,0 +1,67 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+// A bounded number of in-memory frames over the fixed-size pages of one file, for
+// structures larger than RAM. A page is read in on its first use and written back when
+// its frame is evicted (or on flush). The victim is picked by CLOCK: the hand sweeps the
+// frames clearing their reference bits and takes the first frame that was not used since
+// the hand last passed it, so hot pages stay and a scan only cycles through cold ones.
+// Single-threaded; a page pointer stays valid until the next page() call.
+class PageCache
+{
+public:
+    static const size_t page_size = 4096;
+
+    PageCache();
+    // flushes and closes the file
+    ~PageCache();
+    PageCache(const PageCache &other) = delete;
+    PageCache& operator=(const PageCache &other) = delete;
+
+    // creates (or truncates) path for up to `pages` pages and keeps at most `frames` of
+    // them in memory. with direct the file is opened with O_DIRECT when the file system
+    // supports it, so the kernel does not keep a second copy of the pages and only the
+    // frames use memory. false if the file or the memory could not be had
+    bool open(const char* path, int pages, size_t frames, bool direct);
+    void close();
+    // page pageNo, read in on a miss (a page never written reads as zeros). dirty marks it
+    // to be written back, the caller is going to modify it. nullptr on an I/O error
+    char* page(int pageNo, bool dirty);
+    // writes every dirty page back. false on an I/O error
+    bool flush();
+
+    bool direct() const;
+    size_t frames() const;
+    // page() calls served from a frame, page() calls that had to read, pages written back
+    long long hits() const;
+    long long misses() const;
+    long long writes() const;
+
+private:
+    struct Frame {
+        int page;        // -1 while empty
+        bool referenced; // used since the hand last passed
+        bool dirty;
+    };
+    int fd;
+    bool directIO;
+    int maxPages;
+    size_t count;
+    char* memory;                     // count frames of page_size bytes, page aligned
+    std::unique_ptr<Frame[]> info;
+    std::unique_ptr<int32_t[]> frameOf; // frame of every page, -1 when not in memory
+    size_t hand;
+    long long hitCount;
+    long long missCount;
+    long long writeCount;
+
+    bool writeBack(size_t f);
+    // a frame to load a page into, written back first if dirty. count when that failed
+    size_t victim();
+};
+
+#endif /* PAGECACHE_H */
@@ -0,0 +1,203 @@
+#include "readview.h"
+#include <limits.h>
+#include <algorithm>
+
+using readview::Record;
+
+ReadView::ReadView(long long epoch)
+  : publishedAt(epoch), songCount(0)
+{}
+
+long long ReadView::epoch() const {
+    return publishedAt;
+}
+
+int ReadView::numberOfSongs() const {
+    return songCount;
+}
+
+int ReadView::resolve(int32_t r, int64_t* changes) const {
+    int64_t sum = 0;
+    for (;;) {
+        const Record* rec = readview::VersionedMap<Record>::find(records.get(), r);
+        sum += rec->merges;
+        if (rec->parent < 0) {
+            *changes = sum;
+            return rec->genre;
+        }
+        r = rec->parent;
+    }
+}
+
+output_t<int> ReadView::getSongGenre(int songId) const {
+    if (songId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    const int32_t* r = readview::VersionedMap<int32_t>::find(songs.get(), songId);
+    if (r == nullptr) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    int64_t changes = 0;
+    return output_t<int>(resolve(*r, &changes));
+}
+
+output_t<int> ReadView::getNumberOfSongsByGenre(int genreId) const {
+    if (genreId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    const int64_t* count = readview::VersionedMap<int64_t>::find(genres.get(), genreId);
+    if (count == nullptr || *count > INT_MAX) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    return output_t<int>((int)*count);
+}
+
+output_t<int> ReadView::getNumberOfGenreChanges(int songId) const {
+    if (songId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    const int32_t* r = readview::VersionedMap<int32_t>::find(songs.get(), songId);
+    if (r == nullptr) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    int64_t changes = 0;
+    (void)resolve(*r, &changes);
+    if (changes < INT_MIN || changes > INT_MAX) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    return output_t<int>((int)changes);
+}
+
+void ReadView::forEachSong(void (*callback)(int songId, int genreId, int changes, void* ctx), void* ctx) const {
+    readview::VersionedMap<int32_t>::forEach(songs.get(), [&](int songId, int32_t r) {
+        int64_t changes = 0;
+        int genreId = resolve(r, &changes);
+        callback(songId, genreId, changes < INT_MIN || changes > INT_MAX ? -1 : (int)changes, ctx);
+    });
+}
+
+ReadViewVersions::ReadViewVersions()
+  : version(1), freeCount(0), freeCapacity(0), nextRecord(0)
+{}
+
+Record ReadViewVersions::recordAt(int32_t r) const {
+    return *records.find(r);
+}
+
+int32_t ReadViewVersions::addRecord(int32_t parent, int64_t merges, int genreId, bool removed) {
+    Record rec;
+    rec.parent = parent;
+    rec.genre = parent < 0 ? genreId : 0;
+    rec.children = 0;
+    rec.removed = removed ? 1 : 0;
+    rec.merges = merges;
+    int32_t r = freeCount > 0 ? freeRecords[freeCount - 1] : nextRecord;
+    if (parent >= 0) {
+        Record p = recordAt(parent);
+        p.children++;
+        records.put(parent, p, version);
+    }
+    records.put(r, rec, version);
+    if (freeCount > 0) {
+        freeCount--;
+    } else {
+        nextRecord++;
+    }
+    return r;
+}
+
+void ReadViewVersions::merge(int32_t root1, int32_t root2, int32_t newRoot, int genreId3) {
+    if (newRoot < 0) {
+        return;
+    }
+    Record big = recordAt(newRoot);
+    int32_t other = newRoot == root1 ? root2 : root1;
+    if (other >= 0) {
+        // the smaller tree goes under the bigger root, as in Modefied_Union
+        Record small = recordAt(other);
+        small.parent = newRoot;
+        small.merges -= big.merges;
+        small.genre = 0;
+        records.put(other, small, version);
+        big.children++;
+    }
+    big.merges++;
+    big.genre = genreId3;
+    records.put(newRoot, big, version);
+}
+
+void ReadViewVersions::removeRecord(int32_t r) {
+    Record rec = recordAt(r);
+    rec.removed = 1;
+    records.put(r, rec, version);
+    // room for every record id that can come free below, so nothing allocates midway
+    if (freeCapacity < nextRecord) {
+        int capacity = nextRecord + 16;
+        std::unique_ptr<int32_t[]> grown(new int32_t[capacity]);
+        std::copy(freeRecords.get(), freeRecords.get() + freeCount, grown.get());
+        freeRecords.swap(grown);
+        freeCapacity = capacity;
+    }
+    while (rec.removed && rec.children == 0) {
+        (void)records.erase(r, version);
+        freeRecords[freeCount++] = r;
+        if (rec.parent < 0) {
+            break;
+        }
+        r = rec.parent;
+        rec = recordAt(r);
+        rec.children--;
+        records.put(r, rec, version);
+    }
+}
+
+void ReadViewVersions::putSong(int songId, int32_t record) {
+    songs.put(songId, record, version);
+}
+
+void ReadViewVersions::eraseSong(int songId) {
+    (void)songs.erase(songId, version);
+}
+
+void ReadViewVersions::putGenre(int genreId, int64_t songCount) {
+    genres.put(genreId, songCount, version);
+}
+
+void ReadViewVersions::eraseGenre(int genreId) {
+    (void)genres.erase(genreId, version);
+}
+
+void ReadViewVersions::clear() {
+    songs.clear();
+    records.clear();
+    genres.clear();
+    freeCount = 0;
+    nextRecord = 0;
+}
+
+std::shared_ptr<const ReadView> ReadViewVersions::publish(long long epoch) {
+    std::shared_ptr<ReadView> view = std::make_shared<ReadView>(epoch);
+    view->songCount = songs.size();
+    view->songs = songs.snapshot();
+    view->records = records.snapshot();
+    view->genres = genres.snapshot();
+    // every node reachable from the view is frozen from here on
+    version++;
+    return view;
+}
+
+void ReadViewVersions::retire(std::shared_ptr<const ReadView> view) {
+    // a reader still holding the view frees it on its own thread when it lets go
+    if (view.use_count() != 1) {
+        return;
+    }
+    (void)songs.retire(view->songs);
+    (void)records.retire(view->records);
+    (void)genres.retire(view->genres);
+}
+
+void ReadViewVersions::collect() {
+    songs.collect();
+    records.collect();
+    genres.collect();
+}
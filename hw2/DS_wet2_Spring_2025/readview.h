@@ -0,0 +1,352 @@
+#ifndef READVIEW_H
+#define READVIEW_H
+
+#include "wet2util.h"
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <new>
+
+namespace readview {
+    // Persistent trie from int keys to V (a HAMT over the key's own bits, five at a time
+    // from the top, so consecutive keys share their path and no key is deeper than seven
+    // levels). Every node carries the version it was made in. The
+    // writer changes nodes of its open version in place and copies any older node before
+    // changing it, together with the path above it, so the roots taken by earlier versions
+    // keep seeing exactly what they saw. O(log n) per change, and between two versions a
+    // node is copied at most once.
+    template<class V>
+    class VersionedMap
+    {
+    public:
+        struct Entry {
+            int key;
+            V value;
+        };
+        struct Node {
+            uint64_t version;
+            uint32_t nodeMap;   // positions holding a child, in the order of children
+            uint32_t entryMap;  // positions holding an entry, in the order of entries
+            std::unique_ptr<std::shared_ptr<Node>[]> children;
+            std::unique_ptr<Entry[]> entries;
+        };
+        typedef std::shared_ptr<const Node> Root;
+
+        VersionedMap() : root(), len(0), garbageCount(0), garbageCapacity(0), copied(0) {}
+        VersionedMap(const VersionedMap &other) = delete;
+        VersionedMap& operator=(const VersionedMap &other) = delete;
+
+        int size() const {
+            return len;
+        }
+        // the current contents, unchanged by later calls made with a newer version
+        Root snapshot() const {
+            return root;
+        }
+        const V* find(int key) const {
+            return find(root.get(), key);
+        }
+        static const V* find(const Node* n, int key) {
+            for (int level = 0; n != nullptr; level++) {
+                uint32_t bit = position(key, level);
+                if (n->entryMap & bit) {
+                    const Entry& e = n->entries[__builtin_popcount(n->entryMap & (bit - 1))];
+                    return e.key == key ? &e.value : nullptr;
+                }
+                if (!(n->nodeMap & bit)) {
+                    return nullptr;
+                }
+                n = n->children[__builtin_popcount(n->nodeMap & (bit - 1))].get();
+            }
+            return nullptr;
+        }
+        // inserts or overwrites key in `version`, which must be at least the version of
+        // every earlier change. throws bad_alloc and then leaves the map as it was
+        void put(int key, const V& value, uint64_t version) {
+            if (!root) {
+                root = fresh(version);
+            }
+            if (put(root, key, 0, value, version)) {
+                len++;
+            }
+        }
+        // removes key in `version`, false if it was not there. throws bad_alloc
+        bool erase(int key, uint64_t version) {
+            if (find(key) == nullptr) {
+                return false;
+            }
+            erase(root, key, 0, version);
+            len--;
+            return true;
+        }
+        void clear() {
+            root.reset();
+            len = 0;
+        }
+        // takes the nodes of a version nobody reads anymore, to be freed by collect() instead
+        // of all at once. false (r is then left to its destructor) when out of memory
+        bool retire(Root r) {
+            if (!r || !reserve(garbageCount + 1)) {
+                return false;
+            }
+            garbage[garbageCount++] = std::move(r);
+            return true;
+        }
+        // lets go of retired nodes, about as many as the changes since the last call copied,
+        // so a version is freed over the changes of the next ones. a node referred to from
+        // nowhere else hands its children over first, so no step frees more than one node
+        void collect() {
+            long long steps = 33 * copied + 64;
+            copied = 0;
+            while (steps-- > 0 && garbageCount > 0 && reserve(garbageCount + 32)) {
+                std::shared_ptr<const Node> n = std::move(garbage[--garbageCount]);
+                if (n.use_count() == 1) {
+                    // nothing else can reach n, taking its children is safe
+                    Node* owned = const_cast<Node*>(n.get());
+                    for (int i = 0; i < __builtin_popcount(owned->nodeMap); i++) {
+                        garbage[garbageCount++] = std::move(owned->children[i]);
+                    }
+                }
+            }
+        }
+        // calls f(key, value) for every entry under n, in no particular order
+        template<class F>
+        static void forEach(const Node* n, F f) {
+            if (n == nullptr) {
+                return;
+            }
+            for (int i = 0; i < __builtin_popcount(n->entryMap); i++) {
+                f(n->entries[i].key, n->entries[i].value);
+            }
+            for (int i = 0; i < __builtin_popcount(n->nodeMap); i++) {
+                forEach(n->children[i].get(), f);
+            }
+        }
+
+    private:
+        std::shared_ptr<Node> root;
+        int len;
+        // retired nodes not let go of yet
+        std::unique_ptr<Root[]> garbage;
+        int garbageCount;
+        int garbageCapacity;
+        long long copied;   // nodes copied since the last collect()
+
+        bool reserve(int n) {
+            if (n <= garbageCapacity) {
+                return true;
+            }
+            int capacity = std::max(n, 2 * garbageCapacity);
+            Root* grown = new (std::nothrow) Root[capacity];
+            if (grown == nullptr) {
+                return false;
+            }
+            std::move(garbage.get(), garbage.get() + garbageCount, grown);
+            garbage.reset(grown);
+            garbageCapacity = capacity;
+            return true;
+        }
+
+        // the bit for key's slot in a node `level` levels down: bits 34-30 of the key shifted
+        // left by three first, then 29-25 and so on, so two keys part by level 6
+        static uint32_t position(int key, int level) {
+            return 1u << ((((uint64_t)(uint32_t)key << 3) >> (30 - 5 * level)) & 31);
+        }
+        static std::shared_ptr<Node> fresh(uint64_t version) {
+            std::shared_ptr<Node> n = std::make_shared<Node>();
+            n->version = version;
+            n->nodeMap = 0;
+            n->entryMap = 0;
+            return n;
+        }
+        // node may be changed in version: copied first unless it was made in it
+        Node* writable(std::shared_ptr<Node>& slot, uint64_t version) {
+            if (slot->version != version) {
+                copied++;
+                std::shared_ptr<Node> copy = fresh(version);
+                copy->nodeMap = slot->nodeMap;
+                copy->entryMap = slot->entryMap;
+                int c = __builtin_popcount(slot->nodeMap);
+                int e = __builtin_popcount(slot->entryMap);
+                copy->children.reset(c > 0 ? new std::shared_ptr<Node>[c] : nullptr);
+                copy->entries.reset(e > 0 ? new Entry[e] : nullptr);
+                std::copy(slot->children.get(), slot->children.get() + c, copy->children.get());
+                std::copy(slot->entries.get(), slot->entries.get() + e, copy->entries.get());
+                slot = copy;
+            }
+            return slot.get();
+        }
+        // arrays one longer / shorter with the element at index inserted / dropped
+        template<class T>
+        static T* grown(const T* from, int n, int index, const T& x) {
+            T* to = new T[n + 1];
+            std::copy(from, from + index, to);
+            to[index] = x;
+            std::copy(from + index, from + n, to + index + 1);
+            return to;
+        }
+        template<class T>
+        static T* shrunk(const T* from, int n, int index) {
+            T* to = n > 1 ? new T[n - 1] : nullptr;
+            std::copy(from, from + index, to);
+            std::copy(from + index + 1, from + n, to + index);
+            return to;
+        }
+        // true when key was new. every allocation comes before the change it is for
+        bool put(std::shared_ptr<Node>& slot, int key, int level, const V& value, uint64_t version) {
+            Node* n = writable(slot, version);
+            uint32_t bit = position(key, level);
+            int e = __builtin_popcount(n->entryMap & (bit - 1));
+            int c = __builtin_popcount(n->nodeMap & (bit - 1));
+            if (n->entryMap & bit) {
+                if (n->entries[e].key == key) {
+                    n->entries[e].value = value;
+                    return false;
+                }
+                // two keys meet here: both move one level down, where they may meet again
+                Entry old = n->entries[e];
+                std::shared_ptr<Node> child = fresh(version);
+                (void)put(child, old.key, level + 1, old.value, version);
+                (void)put(child, key, level + 1, value, version);
+                std::unique_ptr<std::shared_ptr<Node>[]> children(
+                    grown(n->children.get(), __builtin_popcount(n->nodeMap), c, child));
+                std::unique_ptr<Entry[]> entries(shrunk(n->entries.get(), __builtin_popcount(n->entryMap), e));
+                n->children.swap(children);
+                n->entries.swap(entries);
+                n->nodeMap |= bit;
+                n->entryMap &= ~bit;
+                return true;
+            }
+            if (n->nodeMap & bit) {
+                return put(n->children[c], key, level + 1, value, version);
+            }
+            Entry x = {key, value};
+            n->entries.reset(grown(n->entries.get(), __builtin_popcount(n->entryMap), e, x));
+            n->entryMap |= bit;
+            return true;
+        }
+        // key is known to be there. a child left empty stays, it costs one small node
+        void erase(std::shared_ptr<Node>& slot, int key, int level, uint64_t version) {
+            Node* n = writable(slot, version);
+            uint32_t bit = position(key, level);
+            if (n->entryMap & bit) {
+                int e = __builtin_popcount(n->entryMap & (bit - 1));
+                n->entries.reset(shrunk(n->entries.get(), __builtin_popcount(n->entryMap), e));
+                n->entryMap &= ~bit;
+                return;
+            }
+            erase(n->children[__builtin_popcount(n->nodeMap & (bit - 1))], key, level + 1, version);
+        }
+    };
+
+    // a song of the forest, as in DSpotify: merges is relative to the parent's, and a root
+    // knows its genre. removed songs stay while songs hang under them
+    struct Record {
+        int32_t parent;   // record, -1 for a root
+        int32_t genre;    // genre id while this is a root, 0 otherwise
+        int32_t children; // records whose parent this is
+        int32_t removed;  // the song was removed, its record goes once it has no children
+        int64_t merges;
+    };
+}
+
+// what a ReadView knows about a song: its genre and number of genre changes at publish time
+struct SongEntry {
+    int genre;
+    int changes;
+};
+
+// Immutable point-in-time view of a DSpotify, published by the writer and handed to
+// readers by DSpotify::openReadView(). Nothing in a view changes after it was published,
+// so any number of threads may query it while the writer keeps mutating the DSpotify.
+// A view is freed when the last reader drops its shared_ptr.
+//
+// A view is the roots of three versioned maps (songId -> record, record -> forest record,
+// genreId -> song count) at one version, shared with every other version where nothing
+// changed. Its forest is never path compressed, so a song's answer costs a walk to its
+// root: union by size keeps that O(log n) deep, unless removals left big trees with few
+// songs that then went under small ones.
+class ReadView
+{
+public:
+    // an empty view
+    explicit ReadView(long long epoch);
+    ReadView(const ReadView &other) = delete;
+    ReadView& operator=(const ReadView &other) = delete;
+
+    // number of mutations the DSpotify had gone through when this view was published
+    long long epoch() const;
+    int numberOfSongs() const;
+
+    // FAILURE for a count that does not fit an int, like DSpotify
+    output_t<int> getSongGenre(int songId) const;
+    output_t<int> getNumberOfSongsByGenre(int genreId) const;
+    output_t<int> getNumberOfGenreChanges(int songId) const;
+    // calls callback once for every song in the view, in no particular order. a song whose
+    // change count does not fit an int is passed with -1 changes
+    void forEachSong(void (*callback)(int songId, int genreId, int changes, void* ctx), void* ctx) const;
+
+private:
+    long long publishedAt;
+    int songCount;
+    readview::VersionedMap<int32_t>::Root songs;
+    readview::VersionedMap<readview::Record>::Root records;
+    readview::VersionedMap<int64_t>::Root genres;
+
+    // the genre of the song of record r and its change count
+    int resolve(int32_t r, int64_t* changes) const;
+
+    friend class ReadViewVersions;
+};
+
+// The writer's side: the current state of every map, changed by DSpotify after each of
+// its mutations and published as a ReadView in O(1). Changes made after a publish copy
+// the nodes they touch, never the whole catalog. Every method may throw bad_alloc, and
+// then leaves the state out of step with the DSpotify (DSpotify rebuilds it).
+class ReadViewVersions
+{
+public:
+    ReadViewVersions();
+    ReadViewVersions(const ReadViewVersions &other) = delete;
+    ReadViewVersions& operator=(const ReadViewVersions &other) = delete;
+
+    // a new record: a root of genreId when parent is -1, a child of parent otherwise.
+    // removed for a song that was removed already but still has songs under it
+    int32_t addRecord(int32_t parent, int64_t merges, int genreId, bool removed);
+    // DSpotify::mergeGenres after the union: root1 and root2 were the roots of the two
+    // genres (-1 for an empty one), newRoot is the one that stayed a root, now of genreId3
+    void merge(int32_t root1, int32_t root2, int32_t newRoot, int genreId3);
+    // the song of record r was removed. its record goes (and removed parents with it)
+    // once no record hangs under it
+    void removeRecord(int32_t r);
+
+    void putSong(int songId, int32_t record);
+    void eraseSong(int songId);
+    void putGenre(int genreId, int64_t songCount);
+    void eraseGenre(int genreId);
+    // forgets everything, for an absorbed DSpotify
+    void clear();
+
+    // the current state as a view. later changes go to a new version
+    std::shared_ptr<const ReadView> publish(long long epoch);
+    // a view that was replaced: when the caller held the last reference, its nodes are
+    // freed a few at a time by later collect() calls rather than here. never throws
+    void retire(std::shared_ptr<const ReadView> view);
+    // frees some retired nodes, in proportion to the changes since the last call
+    void collect();
+
+private:
+    readview::VersionedMap<int32_t> songs;
+    readview::VersionedMap<readview::Record> records;
+    readview::VersionedMap<int64_t> genres;
+    uint64_t version;  // the open version, changed in place until the next publish
+    // record ids free for reuse, so they stay below the number of live records
+    std::unique_ptr<int32_t[]> freeRecords;
+    int freeCount;
+    int freeCapacity;
+    int32_t nextRecord;
+
+    readview::Record recordAt(int32_t r) const;
+};
+
+#endif /* READVIEW_H */
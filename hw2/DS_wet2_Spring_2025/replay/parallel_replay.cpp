@@ -0,0 +1,520 @@
+// parallel_replay.cpp
+// Replays a command log in the format read by main25b2.cpp on several threads and prints
+// byte for byte what main25b2.cpp prints for it.
+//
+// Every command only depends on the state of the ids it names: addSong on its song and
+// genre, mergeGenres on its three genres, the queries on their one id. Commands that
+// share an id (directly or through other commands) form a component, and components
+// never interact, so each one lives in its own DSpotify (a catalog) and runs on its own.
+//
+// The log is taken a window of commands at a time:
+//  - plan: a union-find over the ids seen so far (song and genre ids apart) joins the ids
+//    of every command of the window. each component of the window becomes one task with
+//    its commands in log order. a mergeGenres or addSong that joins components which
+//    already had catalogs is their join point: the task first absorbs the smaller
+//    catalogs into the largest (DSpotify::absorb), then runs its commands.
+//  - run: the tasks go to a work-stealing pool, biggest first. meanwhile the main thread
+//    writes the answers of the previous window and parses the next one.
+// The answers are kept per command, so they come out in log order whatever ran first.
+//
+// build: see run_replay_bench.sh
+// usage: ./parallel_replay.out [--threads N=4] [--window W=65536] [--widths compact|wide] [file]
+//        (stdin without file). --widths picks the engine the catalogs use, DSpotify
+//        (compact) by default or BasicDSpotify<dspotify::Wide>
+
+#include "../dspotify25b2.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static const char* statusNames[] = {"SUCCESS", "ALLOCATION_ERROR", "INVALID_INPUT", "FAILURE"};
+
+enum Op { ADD_GENRE, ADD_SONG, MERGE, GET_SONG_GENRE, GET_COUNT, GET_CHANGES, NUM_OPS };
+static const char* opNames[NUM_OPS] = {
+    "addGenre", "addSong", "mergeGenres", "getSongGenre", "getNumberOfSongsByGenre", "getNumberOfGenreChanges"
+};
+static const int opArgs[NUM_OPS] = {1, 2, 3, 1, 1, 1};
+
+struct Command {
+    int op;
+    int args[3];
+};
+
+struct Result {
+    StatusType status;
+    int ans;
+};
+
+static Result answer(StatusType status) {
+    return Result{status, 0};
+}
+
+static Result answer(output_t<int> res) {
+    return Result{res.status(), res.status() == StatusType::SUCCESS ? res.ans() : 0};
+}
+
+// the commands of the log, read exactly like main25b2.cpp reads them: the same stream
+// extraction, the arguments of a failed read keep what the stream left in them, and the
+// command of a malformed line still runs before the driver stops
+class Reader {
+public:
+    explicit Reader(std::istream& input) : in(input), d{0, 0, 0}, ended(false) {}
+
+    // appends up to max commands to window. false once the log ended; trailer is then
+    // what the driver prints after the last command ("" at the end of the input)
+    bool read(std::vector<Command>& window, size_t max) {
+	std::string op;
+	while(!ended && window.size() < max) {
+	    if(!(in >> op)) {
+		ended = true;
+		break;
+	    }
+	    Command c;
+	    c.op = -1;
+	    for(int i = 0; i < NUM_OPS; i++) {
+		if(op == opNames[i]) {
+		    c.op = i;
+		}
+	    }
+	    if(c.op < 0) {
+		trailer = "Unknown command: " + op + "\n";
+		ended = true;
+		break;
+	    }
+	    for(int i = 0; i < opArgs[c.op]; i++) {
+		in >> d[i];
+	    }
+	    memcpy(c.args, d, sizeof(d));
+	    window.push_back(c);
+	    if(in.fail()) {
+		trailer = "Invalid input format\n";
+		ended = true;
+	    }
+	}
+	return !ended;
+    }
+
+    std::string trailer;
+
+private:
+    std::istream& in;
+    int d[3];
+    bool ended;
+};
+
+// runs batches of independent tasks. every thread has a queue of task indices; it takes
+// from the front of its own and, once that is empty, steals from the back of the others
+class StealingPool {
+public:
+    explicit StealingPool(int threads) : queues(threads), generation(0), remaining(0), stopping(false) {
+	for(int t = 1; t < threads; t++) {
+	    workers.emplace_back(&StealingPool::work, this, t);
+	}
+    }
+    ~StealingPool() {
+	{
+	    std::lock_guard<std::mutex> guard(lock);
+	    stopping = true;
+	}
+	wake.notify_all();
+	for(std::thread& w : workers) {
+	    w.join();
+	}
+    }
+
+    // starts task(i) for every i < count, in about the order given, and returns at once
+    void start(size_t count, std::function<void(size_t)> body) {
+	task = std::move(body);
+	remaining = count;
+	for(size_t i = 0; i < count; i++) {
+	    Queue& q = queues[i % queues.size()];
+	    std::lock_guard<std::mutex> guard(q.lock);
+	    q.items.push_back(i);
+	}
+	{
+	    std::lock_guard<std::mutex> guard(lock);
+	    generation++;
+	}
+	wake.notify_all();
+    }
+    // helps with the tasks of the last start() and returns once all of them ran
+    void wait() {
+	drain(0);
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [&]() { return remaining == 0; });
+    }
+
+private:
+    struct Queue {
+	std::mutex lock;
+	std::deque<size_t> items;
+    };
+
+    bool take(int self, size_t* i) {
+	for(size_t k = 0; k < queues.size(); k++) {
+	    Queue& q = queues[(self + k) % queues.size()];
+	    std::lock_guard<std::mutex> guard(q.lock);
+	    if(q.items.empty()) {
+		continue;
+	    }
+	    if(k == 0) {
+		*i = q.items.front();
+		q.items.pop_front();
+	    } else {
+		*i = q.items.back();
+		q.items.pop_back();
+	    }
+	    return true;
+	}
+	return false;
+    }
+    void drain(int self) {
+	size_t i;
+	while(take(self, &i)) {
+	    task(i);
+	    if(--remaining == 0) {
+		std::lock_guard<std::mutex> guard(lock);
+		done.notify_all();
+	    }
+	}
+    }
+    void work(int self) {
+	long long seen = 0;
+	for(;;) {
+	    {
+		std::unique_lock<std::mutex> guard(lock);
+		wake.wait(guard, [&]() { return stopping || generation != seen; });
+		if(stopping) {
+		    return;
+		}
+		seen = generation;
+	    }
+	    drain(self);
+	}
+    }
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::function<void(size_t)> task;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    long long generation;
+    std::atomic<size_t> remaining;
+    bool stopping;
+};
+
+// a DSpotify holding one component, ids = how many ids the component had when it was
+// last run (to absorb the smaller catalogs into the larger)
+template<class Engine>
+struct Catalog {
+    Engine ds;
+    long long ids = 0;
+};
+
+// runs the windows on catalogs of type Engine (a BasicDSpotify instantiation)
+template<class Engine>
+class Replayer {
+    typedef ::Catalog<Engine> Catalog;
+
+    // a node of the union-find over ids. only roots carry a catalog (nullptr until one of
+    // the component's commands ran) and the catalogs joined into them this window
+    struct Shard {
+	int parent;
+	long long ids;
+	Catalog* catalog;
+	std::vector<Catalog*> joining;
+	int group; // task of the current window, -1 when none yet
+    };
+
+public:
+    explicit Replayer(int threads) : pool(threads) {
+	songShard.reserve(1 << 20);
+	genreShard.reserve(1 << 16);
+    }
+    ~Replayer() {
+	for(Shard& s : shards) {
+	    delete s.catalog;
+	}
+    }
+
+    // groups the window's commands into tasks, each one component in log order
+    void plan(const std::vector<Command>& window) {
+	shardOf.resize(window.size());
+	for(size_t i = 0; i < window.size(); i++) {
+	    const Command& c = window[i];
+	    int root = -1;
+	    switch(c.op) {
+	    case ADD_GENRE:
+	    case GET_COUNT:
+		root = find(idShard(genreShard, c.args[0]));
+		break;
+	    case ADD_SONG:
+		root = join(find(idShard(songShard, c.args[0])), find(idShard(genreShard, c.args[1])));
+		break;
+	    case MERGE:
+		root = find(idShard(genreShard, c.args[0]));
+		root = join(root, find(idShard(genreShard, c.args[1])));
+		root = join(root, find(idShard(genreShard, c.args[2])));
+		break;
+	    default:
+		root = find(idShard(songShard, c.args[0]));
+		break;
+	    }
+	    shardOf[i] = root;
+	}
+	// a later command may have joined the component of an earlier one
+	groupRoot.clear();
+	for(size_t i = 0; i < window.size(); i++) {
+	    Shard& s = shards[find(shardOf[i])];
+	    if(s.group < 0) {
+		s.group = (int)groupRoot.size();
+		groupRoot.push_back(find(shardOf[i]));
+	    }
+	    shardOf[i] = s.group;
+	}
+	// counting sort of the commands by task, keeping log order within each
+	groupStart.assign(groupRoot.size() + 1, 0);
+	for(size_t i = 0; i < window.size(); i++) {
+	    groupStart[shardOf[i] + 1]++;
+	}
+	for(size_t g = 0; g < groupRoot.size(); g++) {
+	    groupStart[g + 1] += groupStart[g];
+	}
+	order.resize(window.size());
+	std::vector<int> next(groupStart.begin(), groupStart.end() - 1);
+	for(size_t i = 0; i < window.size(); i++) {
+	    order[next[shardOf[i]]++] = (int)i;
+	}
+	for(int root : groupRoot) {
+	    shards[root].group = -1;
+	}
+	// biggest tasks first, so a long one does not start last
+	byWork.resize(groupRoot.size());
+	for(size_t g = 0; g < byWork.size(); g++) {
+	    byWork[g] = (int)g;
+	}
+	std::sort(byWork.begin(), byWork.end(), [&](int a, int b) {
+	    return groupStart[a + 1] - groupStart[a] > groupStart[b + 1] - groupStart[b];
+	});
+    }
+
+    void start(const std::vector<Command>& window, std::vector<Result>& results) {
+	results.resize(window.size());
+	const std::vector<Command>* cmds = &window;
+	std::vector<Result>* out = &results;
+	pool.start(byWork.size(), [this, cmds, out](size_t k) {
+	    runGroup(byWork[k], *cmds, *out);
+	});
+    }
+
+    void wait() {
+	pool.wait();
+    }
+
+private:
+    int idShard(std::unordered_map<int, int>& ids, int id) {
+	auto it = ids.find(id);
+	if(it != ids.end()) {
+	    return it->second;
+	}
+	int s = (int)shards.size();
+	shards.push_back(Shard{s, 1, nullptr, {}, -1});
+	ids.emplace(id, s);
+	return s;
+    }
+    int find(int s) {
+	int root = s;
+	while(shards[root].parent != root) {
+	    root = shards[root].parent;
+	}
+	while(shards[s].parent != root) {
+	    int next = shards[s].parent;
+	    shards[s].parent = root;
+	    s = next;
+	}
+	return root;
+    }
+    // unions two roots by size. the catalogs of the absorbed one join at its next run
+    int join(int a, int b) {
+	if(a == b) {
+	    return a;
+	}
+	if(shards[a].ids < shards[b].ids) {
+	    std::swap(a, b);
+	}
+	Shard& big = shards[a];
+	Shard& small = shards[b];
+	big.ids += small.ids;
+	small.parent = a;
+	if(small.catalog != nullptr) {
+	    big.joining.push_back(small.catalog);
+	    small.catalog = nullptr;
+	}
+	big.joining.insert(big.joining.end(), small.joining.begin(), small.joining.end());
+	small.joining.clear();
+	return a;
+    }
+
+    void runGroup(int g, const std::vector<Command>& window, std::vector<Result>& results) {
+	Shard& s = shards[groupRoot[g]];
+	Catalog* keep = s.catalog;
+	for(Catalog* c : s.joining) {
+	    if(keep == nullptr || c->ids > keep->ids) {
+		keep = c;
+	    }
+	}
+	if(keep == nullptr) {
+	    keep = new Catalog();
+	}
+	if(s.catalog != nullptr && s.catalog != keep) {
+	    s.joining.push_back(s.catalog);
+	}
+	for(Catalog* c : s.joining) {
+	    if(c == keep) {
+		continue;
+	    }
+	    // the components were disjoint, only running out of memory can fail this
+	    if(keep->ds.absorb(&c->ds) != StatusType::SUCCESS) {
+		fprintf(stderr, "parallel_replay: could not join two catalogs\n");
+		exit(1);
+	    }
+	    delete c;
+	}
+	s.joining.clear();
+	s.catalog = keep;
+	keep->ids = s.ids;
+	Engine& ds = keep->ds;
+	for(int k = groupStart[g]; k < groupStart[g + 1]; k++) {
+	    int i = order[k];
+	    const Command& c = window[i];
+	    switch(c.op) {
+	    case ADD_GENRE:
+		results[i] = answer(ds.addGenre(c.args[0]));
+		break;
+	    case ADD_SONG:
+		results[i] = answer(ds.addSong(c.args[0], c.args[1]));
+		break;
+	    case MERGE:
+		results[i] = answer(ds.mergeGenres(c.args[0], c.args[1], c.args[2]));
+		break;
+	    case GET_SONG_GENRE:
+		results[i] = answer(ds.getSongGenre(c.args[0]));
+		break;
+	    case GET_COUNT:
+		results[i] = answer(ds.getNumberOfSongsByGenre(c.args[0]));
+		break;
+	    case GET_CHANGES:
+		results[i] = answer(ds.getNumberOfGenreChanges(c.args[0]));
+		break;
+	    }
+	}
+    }
+
+    StealingPool pool;
+    std::vector<Shard> shards;
+    std::unordered_map<int, int> songShard;
+    std::unordered_map<int, int> genreShard;
+    // per window: the task of every command (first its root), the root of every task,
+    // the commands of task g are order[groupStart[g]..groupStart[g+1])
+    std::vector<int> shardOf;
+    std::vector<int> groupRoot;
+    std::vector<int> groupStart;
+    std::vector<int> order;
+    std::vector<int> byWork;
+};
+
+// the lines main25b2.cpp prints for the window
+static void writeAnswers(const std::vector<Command>& window, const std::vector<Result>& results, std::string& out) {
+    out.clear();
+    for(size_t i = 0; i < window.size(); i++) {
+	out += opNames[window[i].op];
+	out += ": ";
+	out += statusNames[(int)results[i].status];
+	// the queries print their answer, the updates only their status
+	if(window[i].op >= GET_SONG_GENRE && results[i].status == StatusType::SUCCESS) {
+	    out += ", ";
+	    out += std::to_string(results[i].ans);
+	}
+	out += '\n';
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+}
+
+// replays the whole log on catalogs of type Engine
+template<class Engine>
+static void replay(Reader& reader, int threads, size_t window) {
+    Replayer<Engine> replayer(threads);
+    // double buffered: window cur runs while prev is written and next is parsed
+    std::vector<Command> cur;
+    std::vector<Command> prev;
+    std::vector<Result> curResults;
+    std::vector<Result> prevResults;
+    std::string out;
+    bool more = reader.read(cur, window);
+    while(!cur.empty()) {
+	replayer.plan(cur);
+	replayer.start(cur, curResults);
+	writeAnswers(prev, prevResults, out);
+	prev.clear();
+	if(more) {
+	    more = reader.read(prev, window);
+	}
+	replayer.wait();
+	std::swap(cur, prev);
+	std::swap(curResults, prevResults);
+    }
+    writeAnswers(prev, prevResults, out);
+    fputs(reader.trailer.c_str(), stdout);
+}
+
+int main(int argc, char** argv) {
+    int threads = 4;
+    size_t window = 65536;
+    const char* file = nullptr;
+    bool wide = false;
+    bool badWidths = false;
+    for(int i = 1; i < argc; i++) {
+	if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+	    threads = atoi(argv[++i]);
+	} else if(strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+	    window = (size_t)atol(argv[++i]);
+	} else if(strcmp(argv[i], "--widths") == 0 && i + 1 < argc) {
+	    i++;
+	    wide = strcmp(argv[i], "wide") == 0;
+	    badWidths = !wide && strcmp(argv[i], "compact") != 0;
+	} else {
+	    file = argv[i];
+	}
+    }
+    if(threads <= 0 || window == 0 || badWidths) {
+	fprintf(stderr, "usage: %s [--threads N] [--window W] [--widths compact|wide] [file]\n", argv[0]);
+	return 1;
+    }
+    std::ifstream fileIn;
+    if(file != nullptr) {
+	fileIn.open(file);
+	if(!fileIn) {
+	    fprintf(stderr, "cannot open %s\n", file);
+	    return 1;
+	}
+    }
+    Reader reader(file != nullptr ? fileIn : std::cin);
+    if(wide) {
+	replay<BasicDSpotify<dspotify::Wide>>(reader, threads, window);
+    } else {
+	replay<DSpotify>(reader, threads, window);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/bash
+# Builds parallel_replay and the sequential driver against the engine sources, checks that
+# parallel replay prints exactly the driver's output for every input (with the compact and
+# the wide engine), then times both on generated logs with many genres.
+# usage: ./run_replay_bench.sh [ops=2000000] [threads=1,2,4,8]
+
+cd "$(dirname "$0")"
+SOURCES=$(ls ../*.cpp | grep -v main25b2.cpp)
+FLAGS="-std=c++14 -DNDEBUG -Wall -O2 -pthread"
+OPS=${1:-2000000}
+THREADS=${2:-1,2,4,8}
+
+echo "🔧 Compiling parallel_replay, the driver and gen_workload..."
+g++ $FLAGS -o parallel_replay.out parallel_replay.cpp $SOURCES || { echo "❌ Compilation failed"; exit 1; }
+g++ $FLAGS -o main.out ../main25b2.cpp $SOURCES || { echo "❌ Compilation failed"; exit 1; }
+g++ -std=c++14 -Wall -O2 -o gen_workload.out ../tools/gen_workload.cpp || { echo "❌ Compilation failed"; exit 1; }
+
+# small windows make every component change catalogs often, so joins are exercised too.
+# the last run uses the wide engine, so both BasicDSpotify instantiations are checked
+passed=0
+failed=0
+for i in ../Inputs/*.in ../tests/*.in; do
+  # Inputs/ keep theirs in ExpectedOutputs/, tests/ next to the input
+  expected="${i%.in}.out"
+  case "$i" in ../Inputs/*) expected="../ExpectedOutputs/$(basename "$i" .in).out" ;; esac
+  for opts in "--threads 4" "--threads 4 --window 3" "--threads 4 --window 3 --widths wide"; do
+    if ./parallel_replay.out $opts "$i" | cmp -s - "$expected"; then
+      passed=$((passed+1))
+    else
+      failed=$((failed+1))
+      echo "❌ $i ($opts)"
+    fi
+  done
+done
+echo "inputs: $passed passed, $failed failed"
+
+seconds_since() {
+  awk "BEGIN { printf \"%.2f\", ($(date +%s%N) - $1) / 1e9 }"
+}
+
+mkdir -p Generated
+# many genres, songs spread evenly over them, few merges: many independent components.
+# the second log merges 5x as often, so components keep joining
+for mix in 10:40:1:20:9:20 10:40:5:20:9:16; do
+  log="Generated/replay_${mix//:/_}"
+  ./gen_workload.out --ops "$OPS" --seed 1 --mix "$mix" --genre-skew 0 --no-expected > "$log.in"
+  echo ""
+  echo "🚀 $OPS commands, mix $mix (addGenre:addSong:mergeGenres:getSongGenre:getNumberOfSongsByGenre:getNumberOfGenreChanges)"
+  start=$(date +%s%N)
+  ./main.out < "$log.in" > "$log.out"
+  base=$(seconds_since "$start")
+  echo "main25b2 (sequential): ${base} s"
+  for t in ${THREADS//,/ }; do
+    start=$(date +%s%N)
+    ./parallel_replay.out --threads "$t" "$log.in" > "$log.par"
+    sec=$(seconds_since "$start")
+    same="identical"
+    cmp -s "$log.out" "$log.par" || same="❌ DIFFERENT"
+    echo "parallel_replay, $t threads: ${sec} s ($(awk "BEGIN { printf \"%.2f\", $base / $sec }")x), output $same"
+  done
+done
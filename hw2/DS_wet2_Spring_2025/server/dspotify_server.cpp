@@ -0,0 +1,469 @@
+// dspotify_server.cpp
+// Long-running server that owns one DSpotify and serves any number of clients over a Unix
+// domain socket, so jobs no longer pay process startup and a catalog rebuild each.
+//
+// Protocol: what a client sends is read the way main25b2.cpp reads its input, with
+// `cin >> op` and `cin >> d1 ...`: commands are whitespace-separated tokens, so a line
+// break means nothing ("addSong 1\n3" is one command), a number ends at its first
+// non-digit ("getSongGenre 1x" is getSongGenre 1 followed by the command "x"), and an
+// argument that fails to parse still runs the command with the value the stream stored
+// (0, INT_MAX / INT_MIN on overflow, or the previous command's value once the stream
+// failed). Every command is answered with exactly the line the driver prints
+// ("addSong: SUCCESS\n"), and where the driver stops ("Unknown command: x",
+// "Invalid input format") the server answers the same and closes the connection. The
+// one divergence: a single command spread over more than 64KB of input (padding or
+// leading zeros) is answered "Invalid input format" and closed, so a client cannot make
+// the server buffer without bound. Clients may pipeline: send any number of commands
+// without waiting, the answers come back in order.
+//
+// One epoll loop: every wakeup reads whatever all ready clients sent, parses the complete
+// commands of all of them into one batch and executes the batch in arrival order. Runs of
+// consecutive getSongGenre / getNumberOfGenreChanges in a batch are answered with one
+// interleaved resolveSongs call instead of one walk each. Then the answers are written
+// back. A client that does not read its answers stops being read from while 4MB of
+// answers are pending.
+//
+// build: see run_server_bench.sh
+// usage: ./dspotify_server.out [socket=/tmp/dspotify.sock]
+//        SIGINT / SIGTERM shut it down
+
+#include "../dspotify25b2.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static const char* statusNames[] = {"SUCCESS", "ALLOCATION_ERROR", "INVALID_INPUT", "FAILURE"};
+
+enum Op { ADD_GENRE, ADD_SONG, MERGE, GET_SONG_GENRE, GET_COUNT, GET_CHANGES, NUM_OPS, FATAL = NUM_OPS };
+static const char* opNames[NUM_OPS] = {
+    "addGenre", "addSong", "mergeGenres", "getSongGenre", "getNumberOfSongsByGenre", "getNumberOfGenreChanges"
+};
+static const int opArgs[NUM_OPS] = {1, 2, 3, 1, 1, 1};
+
+static const size_t max_pending_output = 4 << 20;
+static const size_t max_read_burst = 1 << 20;
+static const size_t max_command_bytes = 64 << 10;
+
+struct Conn {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t outPos;     // bytes of out already written
+    bool eof;          // the client closed its side
+    bool done;         // a fatal command was answered, nothing after it is executed
+    bool readPaused;   // too much output pending
+    bool touched;      // already on this round's list
+    std::string fatal; // the answer to the command that ends the connection
+    int d[3];          // like the driver's d1..d3: a failed extraction may leave one as it was
+};
+
+struct Request {
+    Conn* conn;
+    int op;
+    int args[3];
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void onSignal(int) {
+    running = 0;
+}
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void appendStatus(std::string& out, int op, StatusType st) {
+    out += opNames[op];
+    out += ": ";
+    out += statusNames[(int)st];
+    out += '\n';
+}
+
+static void appendOutput(std::string& out, int op, output_t<int> res) {
+    if(res.status() != StatusType::SUCCESS) {
+	appendStatus(out, op, res.status());
+	return;
+    }
+    out += opNames[op];
+    out += ": SUCCESS, ";
+    out += std::to_string(res.ans());
+    out += '\n';
+}
+
+enum Scan { SCANNED, NEED_MORE, ENDED, FAILED };
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// skips whitespace like the stream's sentry. false when the buffered input ran out
+static bool skipSpace(const std::string& in, size_t* p) {
+    while(*p < in.size() && isSpace(in[*p])) {
+	(*p)++;
+    }
+    return *p < in.size();
+}
+
+// `in >> v` from *p: an optional sign and the digits after it. FAILED (the stream's
+// failbit) stores 0 without digits and INT_MAX / INT_MIN on overflow, and leaves v alone
+// when the input ended first. NEED_MORE when the number may go on in data not read yet
+static Scan scanInt(const std::string& in, size_t* p, bool eof, int* v) {
+    size_t q = *p;
+    if(!skipSpace(in, &q)) {
+	*p = q;
+	return eof ? FAILED : NEED_MORE;
+    }
+    bool negative = in[q] == '-';
+    if(in[q] == '+' || in[q] == '-') {
+	q++;
+    }
+    long long value = 0;
+    bool overflow = false;
+    size_t digits = 0;
+    for(; q < in.size() && in[q] >= '0' && in[q] <= '9'; q++, digits++) {
+	value = overflow ? value : value * 10 + (in[q] - '0');
+	overflow = overflow || value > 2147483648LL;
+    }
+    if(q == in.size() && !eof) {
+	return NEED_MORE;
+    }
+    *p = q;
+    if(digits == 0) {
+	*v = 0;
+	return FAILED;
+    }
+    value = negative ? -value : value;
+    if(overflow || value > 2147483647LL || value < -2147483648LL) {
+	*v = negative ? -2147483647 - 1 : 2147483647;
+	return FAILED;
+    }
+    *v = (int)value;
+    return SCANNED;
+}
+
+// scans the command at *p into batch, as the driver's loop would read it: the command
+// itself (run even when an argument failed to parse, like the driver does) and, for the
+// commands that end the driver, a FATAL request answered with conn->fatal. only the
+// whitespace in front of the command is consumed unless it returns SCANNED. ENDED: only
+// whitespace is left and the client closed its side
+static Scan scanCommand(Conn* conn, size_t* p, std::vector<Request>& batch) {
+    const std::string& in = conn->in;
+    size_t q = *p;
+    if(!skipSpace(in, &q)) {
+	*p = q;
+	return conn->eof ? ENDED : NEED_MORE;
+    }
+    // whitespace before a command belongs to no command, drop it even if we have to wait
+    *p = q;
+    size_t nameStart = q;
+    while(q < in.size() && !isSpace(in[q])) {
+	q++;
+    }
+    if(q == in.size() && !conn->eof) {
+	return NEED_MORE;
+    }
+    std::string name = in.substr(nameStart, q - nameStart);
+    Request req;
+    req.conn = conn;
+    req.op = FATAL;
+    for(int op = 0; op < NUM_OPS; op++) {
+	if(name == opNames[op]) {
+	    req.op = op;
+	}
+    }
+    if(req.op == FATAL) {
+	conn->fatal = "Unknown command: " + name + "\n";
+	batch.push_back(req);
+	*p = q;
+	return SCANNED;
+    }
+    int d[3] = {conn->d[0], conn->d[1], conn->d[2]};
+    Scan st = SCANNED;
+    for(int i = 0; i < opArgs[req.op] && st == SCANNED; i++) {
+	st = scanInt(in, &q, conn->eof, &d[i]);
+    }
+    if(st == NEED_MORE) {
+	return NEED_MORE;
+    }
+    memcpy(conn->d, d, sizeof(d));
+    memcpy(req.args, d, sizeof(d));
+    batch.push_back(req);
+    if(st == FAILED) {
+	conn->fatal = "Invalid input format\n";
+	req.op = FATAL;
+	batch.push_back(req);
+    }
+    *p = q;
+    return SCANNED;
+}
+
+// moves every complete command of conn->in into batch
+static void parseInput(Conn* conn, std::vector<Request>& batch) {
+    size_t start = 0;
+    while(!conn->done) {
+	Scan st = scanCommand(conn, &start, batch);
+	if(st != SCANNED) {
+	    if(st == NEED_MORE && conn->in.size() - start > max_command_bytes) {
+		// the driver would keep reading, but this much for one command is not a client
+		Request req;
+		req.conn = conn;
+		req.op = FATAL;
+		conn->fatal = "Invalid input format\n";
+		batch.push_back(req);
+		conn->done = true;
+	    }
+	    break;
+	}
+	if(batch.back().op == FATAL) {
+	    conn->done = true;
+	}
+    }
+    conn->in.erase(0, start);
+}
+
+// executes the batch in order. consecutive getSongGenre / getNumberOfGenreChanges are
+// read-only, so a run of them is resolved at once with interleaved walks
+static void execute(DSpotify* ds, std::vector<Request>& batch, std::vector<int>& ids,
+                    std::vector<int>& songGenres, std::vector<int>& songChanges) {
+    size_t i = 0;
+    while(i < batch.size()) {
+	Request& req = batch[i];
+	if(req.op == GET_SONG_GENRE || req.op == GET_CHANGES) {
+	    size_t end = i;
+	    ids.clear();
+	    while(end < batch.size() && (batch[end].op == GET_SONG_GENRE || batch[end].op == GET_CHANGES)) {
+		ids.push_back(batch[end].args[0]);
+		end++;
+	    }
+	    songGenres.resize(ids.size());
+	    songChanges.resize(ids.size());
+	    ds->resolveSongs(ids.data(), ids.size(), songGenres.data(), songChanges.data(), 1);
+	    for(size_t j = i; j < end; j++) {
+		Request& r = batch[j];
+		if(r.args[0] <= 0) {
+		    appendStatus(r.conn->out, r.op, StatusType::INVALID_INPUT);
+		} else if(songGenres[j - i] == 0) {
+		    // every song that exists has a genre
+		    appendStatus(r.conn->out, r.op, StatusType::FAILURE);
+		} else {
+		    appendOutput(r.conn->out, r.op, output_t<int>(r.op == GET_SONG_GENRE ? songGenres[j - i] : songChanges[j - i]));
+		}
+	    }
+	    i = end;
+	    continue;
+	}
+	switch(req.op) {
+	case ADD_GENRE:
+	    appendStatus(req.conn->out, req.op, ds->addGenre(req.args[0]));
+	    break;
+	case ADD_SONG:
+	    appendStatus(req.conn->out, req.op, ds->addSong(req.args[0], req.args[1]));
+	    break;
+	case MERGE:
+	    appendStatus(req.conn->out, req.op, ds->mergeGenres(req.args[0], req.args[1], req.args[2]));
+	    break;
+	case GET_COUNT:
+	    appendOutput(req.conn->out, req.op, ds->getNumberOfSongsByGenre(req.args[0]));
+	    break;
+	case FATAL:
+	    req.conn->out += req.conn->fatal;
+	    break;
+	}
+	i++;
+    }
+    batch.clear();
+}
+
+// writes as much pending output as the socket takes. false on a write error
+static bool flush(Conn* conn) {
+    while(conn->outPos < conn->out.size()) {
+	ssize_t n = write(conn->fd, conn->out.data() + conn->outPos, conn->out.size() - conn->outPos);
+	if(n < 0) {
+	    if(errno == EINTR) {
+		continue;
+	    }
+	    return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+	conn->outPos += n;
+    }
+    conn->out.clear();
+    conn->outPos = 0;
+    return true;
+}
+
+// reads what is available, at most max_read_burst bytes so one fast client cannot keep
+// the loop to itself (epoll reports the rest next round). false on a read error
+static bool readAll(Conn* conn) {
+    char buf[65536];
+    for(size_t total = 0; total < max_read_burst;) {
+	ssize_t n = read(conn->fd, buf, sizeof(buf));
+	if(n > 0) {
+	    conn->in.append(buf, n);
+	    total += n;
+	    continue;
+	}
+	if(n == 0) {
+	    // a last command without trailing whitespace still counts, see scanCommand
+	    conn->eof = true;
+	    return true;
+	}
+	if(errno == EINTR) {
+	    continue;
+	}
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "/tmp/dspotify.sock";
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(listener < 0 || strlen(path) >= sizeof(addr.sun_path)) {
+	perror("socket");
+	return 1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if(bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 512) != 0 || !setNonBlocking(listener)) {
+	perror("bind/listen");
+	return 1;
+    }
+    int ep = epoll_create1(0);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // the listener
+    epoll_ctl(ep, EPOLL_CTL_ADD, listener, &ev);
+
+    // held open for the moment we run out of descriptors, see the accept loop
+    int spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    DSpotify* ds = new DSpotify();
+    std::vector<Request> batch;
+    std::vector<Conn*> touched;
+    std::vector<int> ids;
+    std::vector<int> songGenres;
+    std::vector<int> songChanges;
+    const int max_events = 256;
+    epoll_event events[max_events];
+    long long served = 0;
+
+    while(running) {
+	int n = epoll_wait(ep, events, max_events, -1);
+	if(n < 0) {
+	    if(errno == EINTR) {
+		continue;
+	    }
+	    perror("epoll_wait");
+	    break;
+	}
+	for(int e = 0; e < n; e++) {
+	    Conn* conn = static_cast<Conn*>(events[e].data.ptr);
+	    if(conn == nullptr) {
+		for(;;) {
+		    int fd = accept(listener, nullptr, nullptr);
+		    if(fd < 0 && (errno == EMFILE || errno == ENFILE) && spareFd >= 0) {
+			// the pending connection keeps the level-triggered listener ready, and
+			// without a free descriptor we would wake up for it forever. free the
+			// spare one, accept and close the client, take the spare back
+			close(spareFd);
+			fd = accept(listener, nullptr, nullptr);
+			if(fd >= 0) {
+			    close(fd);
+			}
+			spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+			if(fd < 0) {
+			    break; // nobody was waiting: accept checks descriptors first
+			}
+			continue;
+		    }
+		    if(fd < 0) {
+			break;
+		    }
+		    setNonBlocking(fd);
+		    Conn* c = new Conn();
+		    c->fd = fd;
+		    c->outPos = 0;
+		    c->eof = false;
+		    c->done = false;
+		    c->readPaused = false;
+		    c->touched = false;
+		    memset(c->d, 0, sizeof(c->d));
+		    epoll_event cev;
+		    cev.events = EPOLLIN;
+		    cev.data.ptr = c;
+		    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev);
+		}
+		continue;
+	    }
+	    bool ok = true;
+	    if(events[e].events & EPOLLOUT) {
+		ok = flush(conn);
+	    }
+	    if(ok && !conn->eof && !conn->done && !conn->readPaused && (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+		ok = readAll(conn);
+	    }
+	    if(!ok) {
+		// the client is gone, drop whatever it still had queued
+		conn->done = true;
+		conn->in.clear();
+		conn->out.clear();
+		conn->outPos = 0;
+	    }
+	    size_t before = batch.size();
+	    parseInput(conn, batch);
+	    served += batch.size() - before;
+	    if(!conn->touched) {
+		conn->touched = true;
+		touched.push_back(conn);
+	    }
+	}
+	execute(ds, batch, ids, songGenres, songChanges);
+	for(Conn* conn : touched) {
+	    conn->touched = false;
+	    bool ok = flush(conn);
+	    bool pending = conn->outPos < conn->out.size();
+	    if(!ok || ((conn->eof || conn->done) && !pending)) {
+		epoll_ctl(ep, EPOLL_CTL_DEL, conn->fd, nullptr);
+		close(conn->fd);
+		delete conn;
+		continue;
+	    }
+	    bool pause = pending && conn->out.size() - conn->outPos >= max_pending_output;
+	    uint32_t wanted = pending ? (uint32_t)EPOLLOUT : 0;
+	    if(!conn->eof && !conn->done && !pause) {
+		wanted |= EPOLLIN;
+	    }
+	    epoll_event cev;
+	    cev.events = wanted;
+	    cev.data.ptr = conn;
+	    epoll_ctl(ep, EPOLL_CTL_MOD, conn->fd, &cev);
+	    conn->readPaused = pause;
+	}
+	touched.clear();
+    }
+    std::cerr << "dspotify_server: " << served << " requests served\n";
+    close(listener);
+    if(spareFd >= 0) {
+	close(spareFd);
+    }
+    unlink(path);
+    delete ds;
+    return 0;
+}
@@ -0,0 +1,253 @@
+// loadgen.cpp
+// Load generator for dspotify_server. Fills the catalog over one connection, then for each
+// concurrency level opens that many connections (one thread each) that pipeline requests
+// with a fixed number in flight, and reports throughput and the latency percentiles of a
+// request (from its write to its answer).
+// The request mix: 70% getSongGenre, 10% getNumberOfGenreChanges,
+// 10% getNumberOfSongsByGenre, 10% addSong of new songs.
+//
+// With --replay it instead sends a whole input file (main25b2.cpp format) over one
+// connection and prints the answers, so they can be diffed against the driver's.
+//
+// usage: ./loadgen.out [socket=/tmp/dspotify.sock] [songs=200000] [requests=400000] [depth=32] [levels=1,4,16,64]
+//        ./loadgen.out [socket=/tmp/dspotify.sock] --replay file
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// retries for a second while the server is still starting (socket not bound or not
+// listening yet)
+static int connectTo(const char* path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    for(int attempt = 0;; attempt++) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+	    return fd;
+	}
+	bool starting = errno == ECONNREFUSED || errno == ENOENT;
+	if(fd >= 0) {
+	    close(fd);
+	}
+	if(!starting || attempt == 100) {
+	    perror("connect");
+	    exit(1);
+	}
+	usleep(10000);
+    }
+}
+
+static bool writeAll(int fd, const char* data, size_t len) {
+    while(len > 0) {
+	ssize_t n = write(fd, data, len);
+	if(n <= 0) {
+	    return false;
+	}
+	data += n;
+	len -= n;
+    }
+    return true;
+}
+
+// reads answers into buf and returns how many complete lines arrived, consuming them
+// (their text is kept in lines when it is not null). 0 on EOF
+static size_t readLines(int fd, std::string& buf, std::string* lines) {
+    char chunk[65536];
+    for(;;) {
+	size_t count = 0;
+	size_t start = 0;
+	size_t nl;
+	while((nl = buf.find('\n', start)) != std::string::npos) {
+	    if(lines != nullptr) {
+		lines->append(buf, start, nl + 1 - start);
+	    }
+	    count++;
+	    start = nl + 1;
+	}
+	buf.erase(0, start);
+	if(count > 0) {
+	    return count;
+	}
+	ssize_t n = read(fd, chunk, sizeof(chunk));
+	if(n <= 0) {
+	    return 0;
+	}
+	buf.append(chunk, n);
+    }
+}
+
+// sends every line of file and prints the answers. the file is written from a second
+// thread so a large one cannot fill both socket buffers
+static int replay(const char* path, const char* file) {
+    std::ifstream in(file);
+    if(!in) {
+	std::cerr << "cannot open " << file << "\n";
+	return 1;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string requests = text.str();
+    int fd = connectTo(path);
+    std::thread sender([&]() {
+	writeAll(fd, requests.data(), requests.size());
+	shutdown(fd, SHUT_WR);
+    });
+    std::string buf;
+    std::string lines;
+    while(readLines(fd, buf, &lines) > 0) {
+	std::cout << lines;
+	lines.clear();
+    }
+    std::cout << buf;
+    sender.join();
+    close(fd);
+    return 0;
+}
+
+// sends the lines of requests pipelined, depth at a time, and waits for every answer
+static void sendAll(int fd, const std::vector<std::string>& requests, size_t depth) {
+    std::string buf;
+    size_t sent = 0;
+    size_t answered = 0;
+    while(answered < requests.size()) {
+	std::string out;
+	while(sent < requests.size() && sent - answered < depth) {
+	    out += requests[sent++];
+	}
+	if(!out.empty() && !writeAll(fd, out.data(), out.size())) {
+	    return;
+	}
+	size_t got = readLines(fd, buf, nullptr);
+	if(got == 0) {
+	    return;
+	}
+	answered += got;
+    }
+}
+
+static std::atomic<int> nextSongId(0);
+
+// one client: `count` requests of the mix, at most depth in flight. latencies in microseconds
+static void client(const char* path, int seed, int count, size_t depth, int songs, int genres,
+                   std::vector<double>* latencies) {
+    int fd = connectTo(path);
+    std::mt19937 rng(seed);
+    std::vector<Clock::time_point> sentAt(count);
+    std::string buf;
+    int sent = 0;
+    int answered = 0;
+    latencies->reserve(count);
+    while(answered < count) {
+	std::string out;
+	int first = sent;
+	while(sent < count && (size_t)(sent - answered) < depth) {
+	    int pick = rng() % 10;
+	    if(pick < 7) {
+		out += "getSongGenre " + std::to_string(1 + rng() % songs) + "\n";
+	    } else if(pick == 7) {
+		out += "getNumberOfGenreChanges " + std::to_string(1 + rng() % songs) + "\n";
+	    } else if(pick == 8) {
+		out += "getNumberOfSongsByGenre " + std::to_string(1 + rng() % genres) + "\n";
+	    } else {
+		out += "addSong " + std::to_string(nextSongId++) + " " + std::to_string(1 + rng() % genres) + "\n";
+	    }
+	    sent++;
+	}
+	Clock::time_point now = Clock::now();
+	for(int i = first; i < sent; i++) {
+	    sentAt[i] = now;
+	}
+	if(!out.empty() && !writeAll(fd, out.data(), out.size())) {
+	    break;
+	}
+	size_t got = readLines(fd, buf, nullptr);
+	if(got == 0) {
+	    break;
+	}
+	now = Clock::now();
+	for(size_t i = 0; i < got; i++, answered++) {
+	    latencies->push_back(std::chrono::duration<double, std::micro>(now - sentAt[answered]).count());
+	}
+    }
+    close(fd);
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if(sorted.empty()) {
+	return 0;
+    }
+    size_t i = (size_t)(p * (sorted.size() - 1));
+    return sorted[i];
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "/tmp/dspotify.sock";
+    if(argc > 3 && strcmp(argv[2], "--replay") == 0) {
+	return replay(path, argv[3]);
+    }
+    const int songs = argc > 2 ? atoi(argv[2]) : 200000;
+    const int requests = argc > 3 ? atoi(argv[3]) : 400000;
+    const size_t depth = argc > 4 ? atoi(argv[4]) : 32;
+    std::vector<int> levels;
+    std::stringstream levelList(argc > 5 ? argv[5] : "1,4,16,64");
+    for(std::string item; std::getline(levelList, item, ',');) {
+	levels.push_back(atoi(item.c_str()));
+    }
+    const int genres = std::max(1, songs / 100);
+
+    std::vector<std::string> setup;
+    for(int g = 1; g <= genres; g++) {
+	setup.push_back("addGenre " + std::to_string(g) + "\n");
+    }
+    for(int s = 1; s <= songs; s++) {
+	setup.push_back("addSong " + std::to_string(s) + " " + std::to_string(1 + s % genres) + "\n");
+    }
+    int fd = connectTo(path);
+    auto start = Clock::now();
+    sendAll(fd, setup, 1024);
+    close(fd);
+    std::cout << "catalog of " << songs << " songs, " << genres << " genres: "
+	      << std::chrono::duration<double>(Clock::now() - start).count() << " s\n";
+    nextSongId = songs + 1;
+
+    std::cout << "depth " << depth << ", " << requests << " requests per level\n";
+    for(int clients : levels) {
+	std::vector<std::vector<double>> perClient(clients);
+	std::vector<std::thread> threads;
+	start = Clock::now();
+	for(int c = 0; c < clients; c++) {
+	    threads.emplace_back(client, path, c + 1, requests / clients, depth, songs, genres, &perClient[c]);
+	}
+	for(std::thread& t : threads) {
+	    t.join();
+	}
+	double sec = std::chrono::duration<double>(Clock::now() - start).count();
+	std::vector<double> all;
+	for(const std::vector<double>& l : perClient) {
+	    all.insert(all.end(), l.begin(), l.end());
+	}
+	std::sort(all.begin(), all.end());
+	std::cout << clients << " clients: " << all.size() / sec / 1e3 << " k req/s, latency us p50 "
+		  << percentile(all, 0.5) << " p90 " << percentile(all, 0.9) << " p99 " << percentile(all, 0.99)
+		  << " p99.9 " << percentile(all, 0.999) << "\n";
+    }
+    return 0;
+}
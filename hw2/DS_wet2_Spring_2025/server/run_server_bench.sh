@@ -0,0 +1,82 @@
+#!/bin/bash
+# Builds dspotify_server and loadgen against the engine sources (everything except the
+# read-only driver main25b2.cpp), checks that replaying inputs through a fresh server gives
+# the driver's expected outputs and that malformed input is answered like the driver
+# answers it, then runs the load generator.
+# usage: ./run_server_bench.sh [replayed_inputs=all] [loadgen args after the socket ...]
+
+cd "$(dirname "$0")"
+SOURCES=$(ls ../*.cpp | grep -v main25b2.cpp)
+FLAGS="-std=c++14 -DNDEBUG -Wall -O2 -pthread"
+SOCKET=/tmp/dspotify_bench.sock
+
+echo "🔧 Compiling dspotify_server and loadgen..."
+g++ $FLAGS -o dspotify_server.out dspotify_server.cpp $SOURCES || { echo "❌ Compilation failed"; exit 1; }
+g++ $FLAGS -o loadgen.out loadgen.cpp || { echo "❌ Compilation failed"; exit 1; }
+g++ $FLAGS -o driver.out ../*.cpp || { echo "❌ Compilation failed"; exit 1; }
+
+start_server() {
+  ./dspotify_server.out $SOCKET 2>/dev/null &
+  SERVER=$!
+  for _ in $(seq 50); do
+    [ -S $SOCKET ] && return
+    sleep 0.1
+  done
+}
+
+stop_server() {
+  kill $SERVER
+  wait $SERVER 2>/dev/null
+}
+
+REPLAYED=${1:-$(ls ../Inputs/*.in | wc -l)}
+shift
+passed=0
+failed=0
+for i in $(ls ../Inputs/*.in | head -n "$REPLAYED"); do
+  b=$(basename "$i" .in)
+  start_server
+  if ./loadgen.out $SOCKET --replay "$i" | diff -q - "../ExpectedOutputs/$b.out" > /dev/null; then
+    passed=$((passed+1))
+  else
+    failed=$((failed+1))
+    echo "❌ $b"
+  fi
+  stop_server
+done
+echo "replay: $passed passed, $failed failed"
+
+# the driver reads whitespace-separated tokens with cin >>, not lines. each case must get
+# the answers the driver prints for the same input
+CASES=(
+  'addGenre 5 6\n'
+  'addGenre 5\ngetSongGenre 1x\n'
+  'addGenre 99999999999\naddGenre 3\n'
+  'addGenre 3\naddSong 1\n3\ngetSongGenre 1\n'
+  'addGenre 3 addSong 1 3 getNumberOfSongsByGenre 3'
+  'addGenre 3\naddSong 1 -x\n'
+  'addGenre 3\nmergeGenres 3 4\n'
+  'addGenre +7\naddGenre -0\ngetNumberOfSongsByGenre 7\n'
+  '\n\n   \n'
+)
+CASE_FILE=/tmp/dspotify_bench_case.in
+passed=0
+failed=0
+for c in "${CASES[@]}"; do
+  printf "$c" > $CASE_FILE
+  start_server
+  if ./loadgen.out $SOCKET --replay $CASE_FILE | diff -q - <(./driver.out < $CASE_FILE) > /dev/null; then
+    passed=$((passed+1))
+  else
+    failed=$((failed+1))
+    echo "❌ case '$c'"
+  fi
+  stop_server
+done
+rm -f $CASE_FILE
+echo "driver input cases: $passed passed, $failed failed"
+
+echo "🚀 Running loadgen"
+start_server
+./loadgen.out $SOCKET "$@"
+stop_server
@@ -0,0 +1,457 @@
+#include "shareddspotify.h"
+#include "hashtable_chainhashing.h"
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// layout of the segment: Header, song buckets, genre buckets, song slots, genre slots.
+// buckets hold the first slot of their chain, slots chain through next. -1 is "none".
+// fields the readers look at are only touched with relaxed atomic loads and stores, the
+// seqlock orders them
+struct SharedDSpotify::Header {
+    uint64_t magic;  // written last by create(), attach() refuses a segment without it
+    uint64_t seed;   // hash seed, like a hardened HashTable
+    std::atomic<uint64_t> seq;
+    int32_t maxSongs;
+    int32_t maxGenres;
+    int32_t songBucketCount;  // powers of two
+    int32_t genreBucketCount;
+    int32_t songs;   // used slots
+    int32_t genres;
+    uint64_t songBucketOff;
+    uint64_t genreBucketOff;
+    uint64_t songSlotOff;
+    uint64_t genreSlotOff;
+    uint64_t bytes;
+};
+
+struct SharedDSpotify::SongSlot {
+    int32_t id;
+    int32_t parent;  // song slot, -1 for a root
+    int32_t merges;  // same relative counter as Song::merges
+    int32_t genre;   // genre slot while this song is the root of a genre, -1 otherwise
+    int32_t next;
+};
+
+struct SharedDSpotify::GenreSlot {
+    int32_t id;
+    int32_t root;    // song slot of the root of this genre's tree, -1 when empty
+    int32_t songCount;
+    int32_t next;
+};
+
+static const uint64_t segment_magic = 0x5350544644534831ULL;
+
+static inline int32_t ld(const int32_t& x) {
+    return __atomic_load_n(&x, __ATOMIC_RELAXED);
+}
+static inline void st(int32_t& x, int32_t v) {
+    __atomic_store_n(&x, v, __ATOMIC_RELAXED);
+}
+
+static int32_t bucketCountFor(int n) {
+    int32_t b = 1;
+    while (b < n) {
+        b *= 2;
+    }
+    return b;
+}
+
+static uint64_t alignUp(uint64_t off) {
+    return (off + 63) / 64 * 64;
+}
+
+static int bucketOf(int id, uint64_t seed, int32_t count) {
+    return (int)(hashtable::mix64((uint64_t)(int64_t)id ^ seed) & (uint64_t)(count - 1));
+}
+
+SharedDSpotify::SharedDSpotify()
+  : hdr(nullptr), bytes(0), writer(false), songBuckets(nullptr), genreBuckets(nullptr),
+    songSlots(nullptr), genreSlots(nullptr)
+{}
+
+SharedDSpotify::~SharedDSpotify() {
+    detach();
+}
+
+void SharedDSpotify::map(void* base, size_t len, bool rw) {
+    char* b = static_cast<char*>(base);
+    hdr = reinterpret_cast<Header*>(b);
+    bytes = len;
+    writer = rw;
+    songBuckets = reinterpret_cast<int32_t*>(b + hdr->songBucketOff);
+    genreBuckets = reinterpret_cast<int32_t*>(b + hdr->genreBucketOff);
+    songSlots = reinterpret_cast<SongSlot*>(b + hdr->songSlotOff);
+    genreSlots = reinterpret_cast<GenreSlot*>(b + hdr->genreSlotOff);
+}
+
+void SharedDSpotify::detach() {
+    if (hdr != nullptr) {
+        munmap(hdr, bytes);
+    }
+    hdr = nullptr;
+    bytes = 0;
+    writer = false;
+}
+
+bool SharedDSpotify::remove(const char* name) {
+    return shm_unlink(name) == 0;
+}
+
+StatusType SharedDSpotify::create(const char* name, int maxSongs, int maxGenres) {
+    if (name == nullptr || maxSongs <= 0 || maxGenres <= 0 || hdr != nullptr) {
+        return StatusType::INVALID_INPUT;
+    }
+    int32_t songBucketCount = bucketCountFor(maxSongs);
+    int32_t genreBucketCount = bucketCountFor(maxGenres);
+    uint64_t off = alignUp(sizeof(Header));
+    uint64_t songBucketOff = off;
+    off = alignUp(off + sizeof(int32_t) * (uint64_t)songBucketCount);
+    uint64_t genreBucketOff = off;
+    off = alignUp(off + sizeof(int32_t) * (uint64_t)genreBucketCount);
+    uint64_t songSlotOff = off;
+    off = alignUp(off + sizeof(SongSlot) * (uint64_t)maxSongs);
+    uint64_t genreSlotOff = off;
+    off = alignUp(off + sizeof(GenreSlot) * (uint64_t)maxGenres);
+
+    (void)shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return StatusType::FAILURE;
+    }
+    if (ftruncate(fd, (off_t)off) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return StatusType::ALLOCATION_ERROR;
+    }
+    void* base = mmap(nullptr, off, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name);
+        return StatusType::ALLOCATION_ERROR;
+    }
+    // the segment comes zero filled
+    Header* h = static_cast<Header*>(base);
+    h->seed = hashtable::mix64((uint64_t)std::chrono::steady_clock::now().time_since_epoch().count());
+    h->seq.store(0);
+    h->maxSongs = maxSongs;
+    h->maxGenres = maxGenres;
+    h->songBucketCount = songBucketCount;
+    h->genreBucketCount = genreBucketCount;
+    h->songs = 0;
+    h->genres = 0;
+    h->songBucketOff = songBucketOff;
+    h->genreBucketOff = genreBucketOff;
+    h->songSlotOff = songSlotOff;
+    h->genreSlotOff = genreSlotOff;
+    h->bytes = off;
+    map(base, off, true);
+    memset(songBuckets, 0xff, sizeof(int32_t) * (size_t)songBucketCount);
+    memset(genreBuckets, 0xff, sizeof(int32_t) * (size_t)genreBucketCount);
+    __atomic_store_n(&h->magic, segment_magic, __ATOMIC_RELEASE);
+    return StatusType::SUCCESS;
+}
+
+StatusType SharedDSpotify::attach(const char* name) {
+    if (name == nullptr || hdr != nullptr) {
+        return StatusType::INVALID_INPUT;
+    }
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return StatusType::FAILURE;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(Header)) {
+        close(fd);
+        return StatusType::FAILURE;
+    }
+    size_t len = (size_t)sb.st_size;
+    void* base = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    const Header* h = static_cast<const Header*>(base);
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != segment_magic || h->bytes != len) {
+        munmap(base, len);
+        return StatusType::FAILURE;
+    }
+    map(base, len, false);
+    return StatusType::SUCCESS;
+}
+
+bool SharedDSpotify::attached() const {
+    return hdr != nullptr;
+}
+
+bool SharedDSpotify::writable() const {
+    return writer;
+}
+
+size_t SharedDSpotify::segmentBytes() const {
+    return bytes;
+}
+
+long long SharedDSpotify::version() const {
+    if (hdr == nullptr) {
+        return 0;
+    }
+    return (long long)(hdr->seq.load(std::memory_order_acquire) / 2);
+}
+
+void SharedDSpotify::beginWrite() {
+    uint64_t s = hdr->seq.load(std::memory_order_relaxed);
+    hdr->seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedDSpotify::endWrite() {
+    uint64_t s = hdr->seq.load(std::memory_order_relaxed);
+    hdr->seq.store(s + 1, std::memory_order_release);
+}
+
+uint64_t SharedDSpotify::beginRead() const {
+    int spins = 0;
+    for (;;) {
+        uint64_t s = hdr->seq.load(std::memory_order_acquire);
+        if ((s & 1) == 0) {
+            return s;
+        }
+        // the writer is mid-change, let it run if we share its core
+        if (++spins % 64 == 0) {
+            sched_yield();
+        }
+    }
+}
+
+bool SharedDSpotify::endRead(uint64_t seq) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return hdr->seq.load(std::memory_order_relaxed) == seq;
+}
+
+int SharedDSpotify::findSong(int songId) const {
+    int32_t maxSongs = hdr->maxSongs;
+    int steps = 0;
+    for (int i = ld(songBuckets[bucketOf(songId, hdr->seed, hdr->songBucketCount)]); i >= 0; i = ld(songSlots[i].next)) {
+        if (i >= maxSongs || ++steps > maxSongs) {
+            return -2;
+        }
+        if (ld(songSlots[i].id) == songId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int SharedDSpotify::findGenre(int genreId) const {
+    int32_t maxGenres = hdr->maxGenres;
+    int steps = 0;
+    for (int i = ld(genreBuckets[bucketOf(genreId, hdr->seed, hdr->genreBucketCount)]); i >= 0; i = ld(genreSlots[i].next)) {
+        if (i >= maxGenres || ++steps > maxGenres) {
+            return -2;
+        }
+        if (ld(genreSlots[i].id) == genreId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool SharedDSpotify::readRecord(int slot, slotforest::Record* rec) const {
+    if (slot < 0 || slot >= hdr->maxSongs) {
+        return false;
+    }
+    const SongSlot& s = songSlots[slot];
+    rec->parent = ld(s.parent);
+    rec->merges = ld(s.merges);
+    rec->genre = ld(s.genre);
+    return true;
+}
+
+bool SharedDSpotify::writeRecord(int slot, const slotforest::Record& rec) {
+    SongSlot& s = songSlots[slot];
+    st(s.parent, rec.parent);
+    st(s.merges, rec.merges);
+    st(s.genre, rec.genre);
+    return true;
+}
+
+int SharedDSpotify::recordLimit() const {
+    return hdr->maxSongs;
+}
+
+StatusType SharedDSpotify::addGenre(int genreId) {
+    if (genreId <= 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!writer || findGenre(genreId) >= 0) {
+        return StatusType::FAILURE;
+    }
+    if (hdr->genres == hdr->maxGenres) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    beginWrite();
+    int slot = hdr->genres++;
+    GenreSlot& g = genreSlots[slot];
+    int32_t& head = genreBuckets[bucketOf(genreId, hdr->seed, hdr->genreBucketCount)];
+    st(g.id, genreId);
+    st(g.root, -1);
+    st(g.songCount, 0);
+    st(g.next, head);
+    st(head, slot);
+    endWrite();
+    return StatusType::SUCCESS;
+}
+
+StatusType SharedDSpotify::addSong(int songId, int genreId) {
+    if (songId <= 0 || genreId <= 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!writer || findSong(songId) >= 0) {
+        return StatusType::FAILURE;
+    }
+    int gslot = findGenre(genreId);
+    if (gslot < 0) {
+        return StatusType::FAILURE;
+    }
+    if (hdr->songs == hdr->maxSongs) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    beginWrite();
+    int slot = hdr->songs++;
+    SongSlot& s = songSlots[slot];
+    GenreSlot& g = genreSlots[gslot];
+    int32_t& head = songBuckets[bucketOf(songId, hdr->seed, hdr->songBucketCount)];
+    st(s.id, songId);
+    st(s.next, head);
+    (void)SlotForest<SharedDSpotify>(*this).attach(slot, g.root, gslot);
+    if (g.root < 0) {
+        st(g.root, slot);
+    }
+    st(g.songCount, g.songCount + 1);
+    st(head, slot);
+    endWrite();
+    return StatusType::SUCCESS;
+}
+
+StatusType SharedDSpotify::mergeGenres(int genreId1, int genreId2, int genreId3) {
+    if (genreId1 <= 0 || genreId2 <= 0 || genreId3 <= 0
+        || genreId1 == genreId2 || genreId2 == genreId3 || genreId1 == genreId3) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!writer) {
+        return StatusType::FAILURE;
+    }
+    int s1 = findGenre(genreId1);
+    int s2 = findGenre(genreId2);
+    if (s1 < 0 || s2 < 0 || findGenre(genreId3) >= 0) {
+        return StatusType::FAILURE;
+    }
+    if (hdr->genres == hdr->maxGenres) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    beginWrite();
+    int s3 = hdr->genres++;
+    GenreSlot& g1 = genreSlots[s1];
+    GenreSlot& g2 = genreSlots[s2];
+    GenreSlot& g3 = genreSlots[s3];
+    int32_t& head = genreBuckets[bucketOf(genreId3, hdr->seed, hdr->genreBucketCount)];
+    st(g3.id, genreId3);
+    st(g3.root, -1);
+    st(g3.songCount, 0);
+    st(g3.next, head);
+    int root = -1;
+    (void)SlotForest<SharedDSpotify>(*this).merge(g1.root, g1.songCount, g2.root, g2.songCount, s3, &root);
+    st(g3.root, root);
+    st(g3.songCount, g1.songCount + g2.songCount);
+    st(g1.root, -1);
+    st(g1.songCount, 0);
+    st(g2.root, -1);
+    st(g2.songCount, 0);
+    st(head, s3);
+    endWrite();
+    return StatusType::SUCCESS;
+}
+
+output_t<int> SharedDSpotify::getSongGenre(int songId) {
+    if (songId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    if (hdr == nullptr) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    for (;;) {
+        uint64_t seq = writer ? 0 : beginRead();
+        int slot = findSong(songId);
+        int root = -1;
+        int changes = 0;
+        int depth = 0;
+        bool ok = slot != -2 && (slot < 0 || SlotForest<SharedDSpotify>(*this).walk(slot, &root, &changes, &depth));
+        int genre = 0;
+        if (ok && root >= 0) {
+            int gslot = ld(songSlots[root].genre);
+            ok = gslot < hdr->maxGenres;
+            genre = (ok && gslot >= 0) ? ld(genreSlots[gslot].id) : 0;
+        }
+        if (writer || (ok && endRead(seq))) {
+            if (slot < 0) {
+                return output_t<int>(StatusType::FAILURE);
+            }
+            if (writer && depth >= 2) {
+                (void)SlotForest<SharedDSpotify>(*this).compress(slot);
+            }
+            return output_t<int>(genre);
+        }
+    }
+}
+
+output_t<int> SharedDSpotify::getNumberOfSongsByGenre(int genreId) {
+    if (genreId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    if (hdr == nullptr) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    for (;;) {
+        uint64_t seq = writer ? 0 : beginRead();
+        int slot = findGenre(genreId);
+        int count = slot >= 0 ? ld(genreSlots[slot].songCount) : 0;
+        if (writer || endRead(seq)) {
+            if (slot < 0) {
+                return output_t<int>(StatusType::FAILURE);
+            }
+            return output_t<int>(count);
+        }
+    }
+}
+
+output_t<int> SharedDSpotify::getNumberOfGenreChanges(int songId) {
+    if (songId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    if (hdr == nullptr) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    for (;;) {
+        uint64_t seq = writer ? 0 : beginRead();
+        int slot = findSong(songId);
+        int root = -1;
+        int changes = 0;
+        int depth = 0;
+        bool ok = slot != -2 && (slot < 0 || SlotForest<SharedDSpotify>(*this).walk(slot, &root, &changes, &depth));
+        if (writer || (ok && endRead(seq))) {
+            if (slot < 0) {
+                return output_t<int>(StatusType::FAILURE);
+            }
+            if (writer && depth >= 2) {
+                (void)SlotForest<SharedDSpotify>(*this).compress(slot);
+            }
+            return output_t<int>(changes);
+        }
+    }
+}
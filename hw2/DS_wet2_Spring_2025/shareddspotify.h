@@ -0,0 +1,91 @@
+#ifndef SHAREDDSPOTIFY_H
+#define SHAREDDSPOTIFY_H
+
+#include "wet2util.h"
+#include "slotforest.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// The six operations of the original interface over a catalog (genres, songs and the song
+// forest) kept in one POSIX shared-memory segment, so all query-serving processes on a
+// host share a single copy instead of each building its own. One writer process creates
+// the segment and mutates it; any number of reader processes attach it read-only. Each
+// process maps the segment at its own address, so entries refer to each other by slot
+// index, never by pointer. Capacities are fixed when the segment is created.
+//
+// This is not DSpotify kept in shared memory: DSpotify's songs and genres are linked by
+// shared_ptr / weak_ptr and raw pointers and live in growing heap tables. The forest
+// algorithms are shared with SpilledDSpotify through SlotForest, over this segment's slots.
+//
+// Consistency: the writer brackets every change, including the path compression its own
+// queries do, with a seqlock. Readers never compress. They retry a query until the
+// sequence number was the same and even before and after it, so every answer comes from
+// a state between two mutations. A writer that dies in the middle of a change leaves the
+// sequence odd and its readers spinning; recreate the segment then.
+//
+// removeSong/removeGenre and the other DSpotify extensions are not available here.
+class SharedDSpotify
+{
+public:
+    SharedDSpotify();
+    ~SharedDSpotify();
+    SharedDSpotify(const SharedDSpotify &other) = delete;
+    SharedDSpotify& operator=(const SharedDSpotify &other) = delete;
+
+    // creates segment `name` ("/name", see shm_open) for up to maxSongs songs and maxGenres
+    // genres and attaches to it as the writer. an existing segment of that name is
+    // unlinked first, readers still attached to it keep seeing the old one
+    StatusType create(const char* name, int maxSongs, int maxGenres);
+    // attaches to a segment created by a writer, read-only. mutations then return FAILURE
+    StatusType attach(const char* name);
+    void detach();
+    // removes the name; the memory goes away once every process detached
+    static bool remove(const char* name);
+
+    // same semantics as in DSpotify. ALLOCATION_ERROR when the segment is full
+    StatusType addGenre(int genreId);
+    StatusType addSong(int songId, int genreId);
+    StatusType mergeGenres(int genreId1, int genreId2, int genreId3);
+
+    output_t<int> getSongGenre(int songId);
+    output_t<int> getNumberOfSongsByGenre(int genreId);
+    output_t<int> getNumberOfGenreChanges(int songId);
+
+    bool attached() const;
+    bool writable() const;
+    size_t segmentBytes() const;
+    // number of changes the writer completed so far
+    long long version() const;
+
+private:
+    struct Header;
+    struct SongSlot;
+    struct GenreSlot;
+    Header* hdr;
+    size_t bytes;
+    bool writer;
+    // pointers into the mapping, derived from the offsets in the header
+    int32_t* songBuckets;
+    int32_t* genreBuckets;
+    SongSlot* songSlots;
+    GenreSlot* genreSlots;
+
+    void map(void* base, size_t len, bool rw);
+    void beginWrite();
+    void endWrite();
+    // reader side of the seqlock: beginRead waits for an even sequence and returns it,
+    // endRead tells whether nothing was written since
+    uint64_t beginRead() const;
+    bool endRead(uint64_t seq) const;
+    // slot of the song / genre, -1 if missing. a reader may get -2 for a torn read
+    int findSong(int songId) const;
+    int findGenre(int genreId) const;
+    // SlotForest's store: the forest fields of the song slots. a reader gets false for a
+    // slot out of range, which only a torn read produces
+    friend class SlotForest<SharedDSpotify>;
+    bool readRecord(int slot, slotforest::Record* rec) const;
+    bool writeRecord(int slot, const slotforest::Record& rec);
+    int recordLimit() const;
+};
+
+#endif /* SHAREDDSPOTIFY_H */
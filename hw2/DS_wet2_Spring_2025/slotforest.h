@@ -0,0 +1,167 @@
+#ifndef SLOTFOREST_H
+#define SLOTFOREST_H
+
+#include <stdint.h>
+
+// The song forest of the engines whose songs are records addressed by index instead of
+// C++ objects: SharedDSpotify (slots in a shared memory segment) and SpilledDSpotify
+// (records in pages of a file). One implementation of the walk, the path compression,
+// the attaching of a new song and the union of two genres, the same as UnionFind does
+// them for DSpotify's songs. Where the records live is up to Store, the engine itself:
+//
+//   bool readRecord(int r, slotforest::Record* rec)   false for a torn read or an I/O error
+//   bool writeRecord(int r, const slotforest::Record& rec)   false for an I/O error
+//   int recordLimit()     at least the records in use: a longer walk is a torn read
+//   void beginWrite()     bracket the writes of compress(), which callers do not bracket
+//   void endWrite()       themselves (for a seqlock). the other changes are bracketed by
+//                         the caller together with its own writes
+//
+// merges is the same relative counter as Song::merges, and a root knows its genre.
+// Genres are identified by whatever int the store keeps for them (a slot), -1 is none.
+namespace slotforest {
+    struct Record {
+        int32_t parent;  // record, -1 for a root
+        int32_t merges;
+        int32_t genre;   // genre while this is a root, -1 otherwise
+    };
+}
+
+template<class Store>
+class SlotForest
+{
+public:
+    explicit SlotForest(Store& store) : store(store) {}
+
+    // root record of r, r's total number of genre changes and the links walked. false
+    // when the store failed or the path did not end within recordLimit() links
+    bool walk(int r, int* root, int* changes, int* depth) const;
+    // hangs every record on r's path directly under the root, keeping each one's total
+    bool compress(int r);
+    // sets up record r for a new song of a genre whose root is root, or as the genre's
+    // root when root is -1
+    bool attach(int r, int root, int32_t genre);
+    // mergeGenres: the genres had roots root1 / root2 (-1 for an empty one) and count1 /
+    // count2 songs. the smaller tree goes under the bigger root, which becomes the root of
+    // genre3 and is returned in *root (-1 when both were empty)
+    bool merge(int root1, long long count1, int root2, long long count2, int32_t genre3, int* root);
+
+private:
+    Store& store;
+};
+
+template<class Store>
+bool SlotForest<Store>::walk(int r, int* root, int* changes, int* depth) const {
+    int limit = store.recordLimit();
+    int sum = 0;
+    int steps = 0;
+    slotforest::Record rec;
+    for (;;) {
+        if (!store.readRecord(r, &rec)) {
+            return false;
+        }
+        sum += rec.merges;
+        if (rec.parent < 0) {
+            break;
+        }
+        if (++steps > limit) {
+            return false;
+        }
+        r = rec.parent;
+    }
+    *root = r;
+    *changes = sum;
+    *depth = steps;
+    return true;
+}
+
+template<class Store>
+bool SlotForest<Store>::compress(int r) {
+    int root = r;
+    int sum = 0;
+    int depth = 0;
+    slotforest::Record rec;
+    for (;;) {
+        if (!store.readRecord(root, &rec)) {
+            return false;
+        }
+        if (rec.parent < 0) {
+            break;
+        }
+        sum += rec.merges;
+        root = rec.parent;
+        depth++;
+    }
+    if (depth < 2) {
+        return true;
+    }
+    // same as Modefied_find: each song keeps the merges of its old path to the root
+    store.beginWrite();
+    bool ok = true;
+    int sub = 0;
+    for (int cur = r; ok; ) {
+        ok = store.readRecord(cur, &rec);
+        if (!ok || rec.parent == root) {
+            break;
+        }
+        int parent = rec.parent;
+        int orig = rec.merges;
+        rec.merges = sum - sub;
+        rec.parent = root;
+        ok = store.writeRecord(cur, rec);
+        sub += orig;
+        cur = parent;
+    }
+    store.endWrite();
+    return ok;
+}
+
+template<class Store>
+bool SlotForest<Store>::attach(int r, int root, int32_t genre) {
+    slotforest::Record rec;
+    if (root >= 0) {
+        slotforest::Record top;
+        if (!store.readRecord(root, &top)) {
+            return false;
+        }
+        // attach under the existing root
+        rec.parent = root;
+        rec.merges = 1 - top.merges;
+        rec.genre = -1;
+    } else {
+        rec.parent = -1;
+        rec.merges = 1;
+        rec.genre = genre;
+    }
+    return store.writeRecord(r, rec);
+}
+
+template<class Store>
+bool SlotForest<Store>::merge(int root1, long long count1, int root2, long long count2, int32_t genre3, int* root) {
+    *root = root1 >= 0 ? root1 : root2;
+    if (*root < 0) {
+        return true;
+    }
+    slotforest::Record big;
+    if (root1 >= 0 && root2 >= 0) {
+        // the smaller tree goes under the bigger root, as in Modefied_Union
+        *root = count1 >= count2 ? root1 : root2;
+        int small = *root == root1 ? root2 : root1;
+        slotforest::Record under;
+        if (!store.readRecord(*root, &big) || !store.readRecord(small, &under)) {
+            return false;
+        }
+        under.parent = *root;
+        under.merges -= big.merges;
+        under.genre = -1;
+        if (!store.writeRecord(small, under)) {
+            return false;
+        }
+    } else if (!store.readRecord(*root, &big)) {
+        return false;
+    }
+    big.merges++;
+    big.genre = genre3;
+    return store.writeRecord(*root, big);
+}
+
+#endif /* SLOTFOREST_H */
@@ -0,0 +1,443 @@
+#include "spilleddspotify.h"
+#include "hashtable_chainhashing.h"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <new>
+
+// layout of the file: index pages [0, bucketPages), record pages [recordBase, recordBase +
+// record pages), then overflow index pages in the order buckets fill up. 0 is never an
+// overflow page, so a zero filled (never written) index page is an empty bucket
+struct IndexPage {
+    int32_t count;     // used entries
+    int32_t overflow;  // next page of this bucket, 0 for none
+    struct Entry {
+        int32_t id;
+        int32_t record;
+    } entries[(PageCache::page_size - 8) / 8];
+};
+
+struct SpilledDSpotify::SongRecord {
+    int32_t id;
+    slotforest::Record forest;  // genre is a genre slot
+};
+
+static const int entries_per_page = (int)(sizeof(IndexPage::entries) / sizeof(IndexPage::Entry));
+static const int records_per_page = (int)(PageCache::page_size / (sizeof(int32_t) + sizeof(slotforest::Record)));
+static const int pending_capacity = 4096;
+
+static_assert(sizeof(IndexPage) == PageCache::page_size, "an index page is one page");
+
+static int32_t bucketCountFor(int n) {
+    int32_t b = 1;
+    while (b < n) {
+        b *= 2;
+    }
+    return b;
+}
+
+static int bucketOf(int id, uint64_t seed, int32_t count) {
+    return (int)(hashtable::mix64((uint64_t)(int64_t)id ^ seed) & (uint64_t)(count - 1));
+}
+
+SpilledDSpotify::SpilledDSpotify()
+  : maxSongs(0), genreSlotCount(0), songs(0), genres(0), bucketPages(0), recordBase(0), nextOverflow(0), maxPages(0),
+    seed(0), genreBucketCount(0), pendingCount(0)
+{}
+
+SpilledDSpotify::~SpilledDSpotify() {
+    close();
+}
+
+StatusType SpilledDSpotify::create(const char* path, int maxSongs, int maxGenres, size_t cacheBytes, bool direct,
+                                   int indexPages) {
+    if (path == nullptr || maxSongs <= 0 || maxGenres <= 0 || indexPages < 0 || indexPages > (1 << 30) || genreSlots) {
+        return StatusType::INVALID_INPUT;
+    }
+    // buckets about three quarters full, records packed, and room for every overflow page
+    // the index can need: a bucket only links a new page once its last one is full, so
+    // that holds for any number of buckets
+    int32_t buckets = bucketCountFor(indexPages > 0 ? indexPages
+                                     : (maxSongs + entries_per_page * 3 / 4 - 1) / (entries_per_page * 3 / 4));
+    long long recordPages = ((long long)maxSongs + records_per_page - 1) / records_per_page;
+    long long pages = buckets + recordPages + maxSongs / entries_per_page + 1;
+    if (pages > INT32_MAX) {
+        return StatusType::INVALID_INPUT;
+    }
+    size_t frames = cacheBytes / PageCache::page_size;
+    try {
+        genreBuckets.reset(new int32_t[bucketCountFor(maxGenres)]);
+        genreSlots.reset(new GenreSlot[maxGenres]);
+        pending.reset(new int32_t[pending_capacity]);
+    } catch (std::bad_alloc&) {
+        genreBuckets.reset();
+        genreSlots.reset();
+        return StatusType::ALLOCATION_ERROR;
+    }
+    if (!cache.open(path, (int)pages, frames > 0 ? frames : 1, direct)) {
+        genreBuckets.reset();
+        genreSlots.reset();
+        pending.reset();
+        return StatusType::FAILURE;
+    }
+    this->maxSongs = maxSongs;
+    genreSlotCount = maxGenres;
+    songs = 0;
+    genres = 0;
+    bucketPages = buckets;
+    recordBase = buckets;
+    nextOverflow = buckets + (int)recordPages;
+    maxPages = (int)pages;
+    seed = hashtable::mix64((uint64_t)std::chrono::steady_clock::now().time_since_epoch().count());
+    genreBucketCount = bucketCountFor(maxGenres);
+    memset(genreBuckets.get(), 0xff, sizeof(int32_t) * (size_t)genreBucketCount);
+    pendingCount = 0;
+    return StatusType::SUCCESS;
+}
+
+void SpilledDSpotify::close() {
+    if (!genreSlots) {
+        return;
+    }
+    (void)compressPending();
+    cache.close();
+    genreBuckets.reset();
+    genreSlots.reset();
+    pending.reset();
+}
+
+StatusType SpilledDSpotify::flush() {
+    if (!genreSlots) {
+        return StatusType::FAILURE;
+    }
+    bool ok = compressPending();
+    ok = cache.flush() && ok;
+    return ok ? StatusType::SUCCESS : StatusType::ALLOCATION_ERROR;
+}
+
+size_t SpilledDSpotify::dataBytes() const {
+    return (size_t)nextOverflow * PageCache::page_size;
+}
+
+const PageCache& SpilledDSpotify::pageCache() const {
+    return cache;
+}
+
+int SpilledDSpotify::overflowPages() const {
+    return nextOverflow - recordBase - (maxSongs + records_per_page - 1) / records_per_page;
+}
+
+int SpilledDSpotify::pendingCompressions() const {
+    return pendingCount;
+}
+
+int SpilledDSpotify::genreCapacity() const {
+    return genreSlotCount;
+}
+
+SpilledDSpotify::SongRecord* SpilledDSpotify::record(int r, bool dirty) {
+    static_assert(sizeof(SongRecord) * records_per_page == PageCache::page_size, "records fill a page");
+    char* p = cache.page(recordBase + r / records_per_page, dirty);
+    if (p == nullptr) {
+        return nullptr;
+    }
+    return reinterpret_cast<SongRecord*>(p) + r % records_per_page;
+}
+
+int SpilledDSpotify::findSong(int songId) {
+    int pageNo = bucketOf(songId, seed, bucketPages);
+    do {
+        const IndexPage* p = reinterpret_cast<const IndexPage*>(cache.page(pageNo, false));
+        if (p == nullptr) {
+            return -2;
+        }
+        for (int i = 0; i < p->count; i++) {
+            if (p->entries[i].id == songId) {
+                return p->entries[i].record;
+            }
+        }
+        pageNo = p->overflow;
+    } while (pageNo != 0);
+    return -1;
+}
+
+bool SpilledDSpotify::indexSong(int songId, int r) {
+    int pageNo = bucketOf(songId, seed, bucketPages);
+    for (;;) {
+        IndexPage* p = reinterpret_cast<IndexPage*>(cache.page(pageNo, false));
+        if (p == nullptr) {
+            return false;
+        }
+        if (p->overflow != 0) {
+            pageNo = p->overflow;
+            continue;
+        }
+        if (p->count < entries_per_page) {
+            // a hit now, so this marks the frame dirty without another read
+            p = reinterpret_cast<IndexPage*>(cache.page(pageNo, true));
+            p->entries[p->count].id = songId;
+            p->entries[p->count].record = r;
+            p->count++;
+            return true;
+        }
+        if (nextOverflow == maxPages) {
+            return false;
+        }
+        int next = nextOverflow++;
+        p = reinterpret_cast<IndexPage*>(cache.page(pageNo, true));
+        p->overflow = next;
+        pageNo = next;
+    }
+}
+
+bool SpilledDSpotify::reserveGenre() {
+    if (genres < genreSlotCount) {
+        return true;
+    }
+    if (genreSlotCount > INT32_MAX / 2) {
+        return false;
+    }
+    int count = genreSlotCount * 2;
+    int32_t bucketCount = bucketCountFor(count);
+    std::unique_ptr<GenreSlot[]> slots;
+    std::unique_ptr<int32_t[]> buckets;
+    try {
+        slots.reset(new GenreSlot[count]);
+        buckets.reset(new int32_t[bucketCount]);
+    } catch (std::bad_alloc&) {
+        return false;
+    }
+    // the slots keep their numbers, the song records name them. only the chains change
+    memcpy(slots.get(), genreSlots.get(), sizeof(GenreSlot) * (size_t)genres);
+    memset(buckets.get(), 0xff, sizeof(int32_t) * (size_t)bucketCount);
+    for (int i = 0; i < genres; i++) {
+        int32_t& head = buckets[bucketOf(slots[i].id, seed, bucketCount)];
+        slots[i].next = head;
+        head = i;
+    }
+    genreSlots = std::move(slots);
+    genreBuckets = std::move(buckets);
+    genreSlotCount = count;
+    genreBucketCount = bucketCount;
+    return true;
+}
+
+int SpilledDSpotify::findGenre(int genreId) {
+    for (int i = genreBuckets[bucketOf(genreId, seed, genreBucketCount)]; i >= 0; i = genreSlots[i].next) {
+        if (genreSlots[i].id == genreId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool SpilledDSpotify::walk(int r, int* root, int* changes) {
+    int depth = 0;
+    if (!SlotForest<SpilledDSpotify>(*this).walk(r, root, changes, &depth)) {
+        return false;
+    }
+    if (depth >= 2) {
+        pending[pendingCount++] = r;
+        if (pendingCount == pending_capacity) {
+            return compressPending();
+        }
+    }
+    return true;
+}
+
+bool SpilledDSpotify::compressPending() {
+    // in record order: the songs on one page are compressed together, and the ones a
+    // query asked about many times only once
+    std::sort(pending.get(), pending.get() + pendingCount);
+    int n = pendingCount;
+    pendingCount = 0;
+    SlotForest<SpilledDSpotify> forest(*this);
+    for (int i = 0; i < n; i++) {
+        // a song compressed by an earlier one of the batch is left as it is
+        if ((i == 0 || pending[i] != pending[i - 1]) && !forest.compress(pending[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SpilledDSpotify::readRecord(int r, slotforest::Record* rec) {
+    const SongRecord* s = record(r, false);
+    if (s == nullptr) {
+        return false;
+    }
+    *rec = s->forest;
+    return true;
+}
+
+bool SpilledDSpotify::writeRecord(int r, const slotforest::Record& rec) {
+    // mostly a hit on the page the read before brought in, so this only marks it dirty
+    SongRecord* s = record(r, true);
+    if (s == nullptr) {
+        return false;
+    }
+    s->forest = rec;
+    return true;
+}
+
+int SpilledDSpotify::recordLimit() const {
+    return songs;
+}
+
+void SpilledDSpotify::beginWrite() {}
+
+void SpilledDSpotify::endWrite() {}
+
+StatusType SpilledDSpotify::addGenre(int genreId) {
+    if (genreId <= 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!genreSlots || findGenre(genreId) >= 0) {
+        return StatusType::FAILURE;
+    }
+    if (!reserveGenre()) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    int slot = genres++;
+    GenreSlot& g = genreSlots[slot];
+    int32_t& head = genreBuckets[bucketOf(genreId, seed, genreBucketCount)];
+    g.id = genreId;
+    g.root = -1;
+    g.songCount = 0;
+    g.next = head;
+    head = slot;
+    return StatusType::SUCCESS;
+}
+
+StatusType SpilledDSpotify::addSong(int songId, int genreId) {
+    if (songId <= 0 || genreId <= 0) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!genreSlots) {
+        return StatusType::FAILURE;
+    }
+    int found = findSong(songId);
+    if (found == -2) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    int gslot = findGenre(genreId);
+    if (found >= 0 || gslot < 0) {
+        return StatusType::FAILURE;
+    }
+    if (songs == maxSongs) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    GenreSlot& g = genreSlots[gslot];
+    int r = songs;
+    if (!indexSong(songId, r)) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    SongRecord* s = record(r, true);
+    if (s == nullptr) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    s->id = songId;
+    if (!SlotForest<SpilledDSpotify>(*this).attach(r, g.root, gslot)) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    songs++;
+    if (g.root >= 0) {
+        g.songCount++;
+    } else {
+        g.root = r;
+        g.songCount = 1;
+    }
+    return StatusType::SUCCESS;
+}
+
+StatusType SpilledDSpotify::mergeGenres(int genreId1, int genreId2, int genreId3) {
+    if (genreId1 <= 0 || genreId2 <= 0 || genreId3 <= 0
+        || genreId1 == genreId2 || genreId2 == genreId3 || genreId1 == genreId3) {
+        return StatusType::INVALID_INPUT;
+    }
+    if (!genreSlots) {
+        return StatusType::FAILURE;
+    }
+    int s1 = findGenre(genreId1);
+    int s2 = findGenre(genreId2);
+    if (s1 < 0 || s2 < 0 || findGenre(genreId3) >= 0) {
+        return StatusType::FAILURE;
+    }
+    // before taking references into the slots, growing moves them
+    if (!reserveGenre()) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    GenreSlot& g1 = genreSlots[s1];
+    GenreSlot& g2 = genreSlots[s2];
+    int s3 = genres;
+    int root = -1;
+    if (!SlotForest<SpilledDSpotify>(*this).merge(g1.root, g1.songCount, g2.root, g2.songCount, s3, &root)) {
+        return StatusType::ALLOCATION_ERROR;
+    }
+    genres++;
+    GenreSlot& g3 = genreSlots[s3];
+    int32_t& head = genreBuckets[bucketOf(genreId3, seed, genreBucketCount)];
+    g3.id = genreId3;
+    g3.root = root;
+    g3.songCount = g1.songCount + g2.songCount;
+    g3.next = head;
+    head = s3;
+    g1.root = -1;
+    g1.songCount = 0;
+    g2.root = -1;
+    g2.songCount = 0;
+    return StatusType::SUCCESS;
+}
+
+output_t<int> SpilledDSpotify::getSongGenre(int songId) {
+    if (songId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    if (!genreSlots) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    int r = findSong(songId);
+    if (r == -1) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    int root = -1;
+    int changes = 0;
+    if (r == -2 || !walk(r, &root, &changes)) {
+        return output_t<int>(StatusType::ALLOCATION_ERROR);
+    }
+    const SongRecord* rec = record(root, false);
+    if (rec == nullptr) {
+        return output_t<int>(StatusType::ALLOCATION_ERROR);
+    }
+    return output_t<int>(genreSlots[rec->forest.genre].id);
+}
+
+output_t<int> SpilledDSpotify::getNumberOfSongsByGenre(int genreId) {
+    if (genreId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    int slot = genreSlots ? findGenre(genreId) : -1;
+    if (slot < 0) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    return output_t<int>(genreSlots[slot].songCount);
+}
+
+output_t<int> SpilledDSpotify::getNumberOfGenreChanges(int songId) {
+    if (songId <= 0) {
+        return output_t<int>(StatusType::INVALID_INPUT);
+    }
+    if (!genreSlots) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    int r = findSong(songId);
+    if (r == -1) {
+        return output_t<int>(StatusType::FAILURE);
+    }
+    int root = -1;
+    int changes = 0;
+    if (r == -2 || !walk(r, &root, &changes)) {
+        return output_t<int>(StatusType::ALLOCATION_ERROR);
+    }
+    return output_t<int>(changes);
+}
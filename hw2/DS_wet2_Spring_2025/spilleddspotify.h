@@ -0,0 +1,120 @@
+#ifndef SPILLEDDSPOTIFY_H
+#define SPILLEDDSPOTIFY_H
+
+#include "wet2util.h"
+#include "pagecache.h"
+#include "slotforest.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+// A DSpotify catalog whose songs may not fit in memory. The song records (the song forest)
+// and the songId index live in pages of a file; a PageCache keeps a bounded number of
+// them in memory and evicts by CLOCK, so only the hot part of the catalog takes RAM.
+// Genres are far fewer than songs and stay in memory, in slots that double when they run
+// out. The song capacity is fixed when the store is created; records refer to each other
+// by record index, like SharedDSpotify's slots, and the forest over them is the same
+// SlotForest, with the record pages as its store.
+//
+// This is a separate class beside DSpotify, not a storage tier behind it: DSpotify keeps
+// its pointer-linked songs and growing tables in memory, and a catalog does not move here
+// when it outgrows RAM. It has only the six operations of the original interface.
+//
+// The songId index is a hash of bucket pages: a lookup reads one index page (more only
+// for a bucket that overflowed into a chain of pages) and then the song's record page.
+// Queries do not compress the paths they walk right away, which would dirty a random
+// record page each: the songs to compress are collected and compressed a batch at a time
+// in record order, so the writes of a batch hit each page once.
+//
+// An I/O error is reported as ALLOCATION_ERROR and may leave the catalog half updated;
+// recreate it then. removeSong/removeGenre and the other DSpotify extensions are not
+// available here.
+class SpilledDSpotify
+{
+public:
+    SpilledDSpotify();
+    ~SpilledDSpotify();
+    SpilledDSpotify(const SpilledDSpotify &other) = delete;
+    SpilledDSpotify& operator=(const SpilledDSpotify &other) = delete;
+
+    // creates the store in file path (truncating it) for up to maxSongs songs, with slots
+    // for maxGenres genres to start with, keeping at most cacheBytes of its pages in memory. with direct the file
+    // bypasses the kernel's page cache where the file system allows it (see PageCache).
+    // indexPages 0 sizes the songId index for maxSongs; a smaller count (rounded up to a
+    // power of two) makes buckets overflow into page chains, for tests
+    StatusType create(const char* path, int maxSongs, int maxGenres, size_t cacheBytes, bool direct = true,
+                      int indexPages = 0);
+    // writes the dirty pages back and closes the file
+    void close();
+
+    // same semantics as in DSpotify. addSong gives ALLOCATION_ERROR when the store holds
+    // maxSongs songs already
+    StatusType addGenre(int genreId);
+    StatusType addSong(int songId, int genreId);
+    StatusType mergeGenres(int genreId1, int genreId2, int genreId3);
+
+    output_t<int> getSongGenre(int songId);
+    output_t<int> getNumberOfSongsByGenre(int genreId);
+    output_t<int> getNumberOfGenreChanges(int songId);
+
+    // compresses the songs still waiting for it and writes every dirty page back
+    StatusType flush();
+    // bytes of the file the catalog spans (index and record pages)
+    size_t dataBytes() const;
+    const PageCache& pageCache() const;
+    // overflow index pages in use, songs waiting for path compression and genre slots
+    int overflowPages() const;
+    int pendingCompressions() const;
+    int genreCapacity() const;
+
+private:
+    struct SongRecord;
+    struct GenreSlot {
+        int32_t id;
+        int32_t root;      // record of the root of this genre's tree, -1 when empty
+        int32_t songCount;
+        int32_t next;
+    };
+    PageCache cache;
+    int maxSongs;
+    int genreSlotCount;    // allocated genre slots
+    int songs;             // used records
+    int genres;            // used genre slots
+    int bucketPages;       // index pages 0..bucketPages-1, a power of two
+    int recordBase;        // first record page
+    int nextOverflow;      // next free overflow page, after the record pages
+    int maxPages;
+    uint64_t seed;
+    int genreBucketCount;  // a power of two
+    // genres chain through next from their bucket, as in SharedDSpotify. -1 is "none"
+    std::unique_ptr<int32_t[]> genreBuckets;
+    std::unique_ptr<GenreSlot[]> genreSlots;
+    // records waiting for path compression, compressed when full or on flush
+    std::unique_ptr<int32_t[]> pending;
+    int pendingCount;
+
+    // the record, nullptr on an I/O error. valid until the next page access
+    SongRecord* record(int r, bool dirty);
+    // record of the song, -1 if missing, -2 on an I/O error
+    int findSong(int songId);
+    int findGenre(int genreId);
+    // makes room for one more genre slot, doubling the slots and their buckets when they
+    // are all used. false when out of memory
+    bool reserveGenre();
+    // appends songId -> r to its bucket's chain. false on an I/O error or a full store
+    bool indexSong(int songId, int r);
+    // root record of r and its total number of genre changes. queues r for compression
+    // when its path is long. false on an I/O error
+    bool walk(int r, int* root, int* changes);
+    bool compressPending();
+    // SlotForest's store: the forest fields of the song records, false on an I/O error.
+    // compressions are not bracketed, nothing reads the records concurrently
+    friend class SlotForest<SpilledDSpotify>;
+    bool readRecord(int r, slotforest::Record* rec);
+    bool writeRecord(int r, const slotforest::Record& rec);
+    int recordLimit() const;
+    void beginWrite();
+    void endWrite();
+};
+
+#endif /* SPILLEDDSPOTIFY_H */
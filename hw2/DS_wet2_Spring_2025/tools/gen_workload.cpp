@@ -0,0 +1,475 @@
+// gen_workload.cpp
+// Seeded, deterministic generator of DSpotify command streams in the format read by
+// main25b2.cpp. Next to the commands it writes the expected output, computed by a
+// simple reference model that shares no code with the real implementation, so every
+// generated pair can be checked exactly like Inputs/ and ExpectedOutputs/.
+//
+// build: g++ -std=c++14 -O2 -o gen_workload.out gen_workload.cpp
+//
+// usage: ./gen_workload.out [options]
+//   --ops N            number of commands (default 10000)
+//   --seed S           random seed (default 1)
+//   --mode M           random | deep-merge | collide (default random)
+//   --mix a:b:c:d:e:f  weights of addGenre:addSong:mergeGenres:getSongGenre:
+//                      getNumberOfSongsByGenre:getNumberOfGenreChanges (default 2:40:2:20:16:20)
+//   --zipf S           Zipf exponent of song popularity in queries, 0 = uniform (default 1.0)
+//   --genre-skew S     Zipf exponent of which genre receives a new song (default 0.8)
+//   --invalid P        probability that a command gets an invalid or unknown id (default 0.02)
+//   --depth L          deep-merge: each round merges 2^L single-song genres (default 10)
+//   --ids dense|sparse sequential ids or ids scattered over [1, 2^31) (default sparse)
+//   --out PREFIX       write PREFIX.in and PREFIX.out instead of commands to stdout
+//   --no-expected      skip the reference model (for streams too large to model)
+//
+// modes:
+//   random      independent commands drawn from --mix.
+//   deep-merge  rounds of 2^L one-song genres merged pairwise, level by level, with no
+//               queries in between, so union by size builds trees of depth L before any
+//               path compression happens. each round ends with queries on its songs.
+//   collide     like random, but every song and genre id is picked so that
+//               frac(id * (sqrt(5)-1)/2) is tiny. HashTable::hashKey sends all of them to
+//               bucket 0 at every capacity the table reaches, so each chain is one list.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+enum Op { ADD_GENRE, ADD_SONG, MERGE, GET_SONG_GENRE, GET_COUNT, GET_CHANGES, NUM_OPS };
+
+static const char* opNames[NUM_OPS] = {
+    "addGenre", "addSong", "mergeGenres", "getSongGenre", "getNumberOfSongsByGenre", "getNumberOfGenreChanges"
+};
+static const char* statusNames[] = {"SUCCESS", "ALLOCATION_ERROR", "INVALID_INPUT", "FAILURE"};
+enum Status { SUCCESS = 0, INVALID_INPUT = 2, FAILURE = 3 };
+
+// ---------------------------------------------------------------------------------------
+// Reference model. Every genre owns a container of songs; a song's number of changes is
+// its own value plus the container's offset, so a merge moves the smaller container into
+// the larger one and bumps the offset (small-to-large, O(n log n) in total).
+// ---------------------------------------------------------------------------------------
+class Reference
+{
+public:
+    Status addGenre(int g) {
+	if(g <= 0) return INVALID_INPUT;
+	if(genres.count(g)) return FAILURE;
+	genres[g] = -1;
+	return SUCCESS;
+    }
+    Status addSong(int s, int g) {
+	if(s <= 0 || g <= 0) return INVALID_INPUT;
+	if(songs.count(s)) return FAILURE;
+	auto it = genres.find(g);
+	if(it == genres.end()) return FAILURE;
+	if(it->second < 0) {
+	    it->second = (int)containers.size();
+	    containers.push_back(Container{g, 0, vector<int>()});
+	}
+	Container& c = containers[it->second];
+	c.members.push_back(s);
+	songs[s] = SongRec{it->second, 1 - c.offset};
+	return SUCCESS;
+    }
+    Status merge(int g1, int g2, int g3) {
+	if(g1 <= 0 || g2 <= 0 || g3 <= 0 || g1 == g2 || g2 == g3 || g1 == g3) return INVALID_INPUT;
+	if(!genres.count(g1) || !genres.count(g2) || genres.count(g3)) return FAILURE;
+	int c1 = genres[g1];
+	int c2 = genres[g2];
+	int into = -1;
+	if(c1 >= 0 && c2 >= 0) {
+	    int big = containers[c1].members.size() >= containers[c2].members.size() ? c1 : c2;
+	    int small = big == c1 ? c2 : c1;
+	    Container& b = containers[big];
+	    Container& sm = containers[small];
+	    for(int s : sm.members) {
+		SongRec& r = songs[s];
+		r.local += sm.offset - b.offset;
+		r.container = big;
+	    }
+	    b.members.insert(b.members.end(), sm.members.begin(), sm.members.end());
+	    vector<int>().swap(sm.members);
+	    into = big;
+	} else {
+	    into = c1 >= 0 ? c1 : c2;
+	}
+	if(into >= 0) {
+	    containers[into].offset++;
+	    containers[into].genre = g3;
+	}
+	genres[g1] = -1;
+	genres[g2] = -1;
+	genres[g3] = into;
+	return SUCCESS;
+    }
+    Status songGenre(int s, long long* ans) {
+	if(s <= 0) return INVALID_INPUT;
+	auto it = songs.find(s);
+	if(it == songs.end()) return FAILURE;
+	*ans = containers[it->second.container].genre;
+	return SUCCESS;
+    }
+    Status songCount(int g, long long* ans) {
+	if(g <= 0) return INVALID_INPUT;
+	auto it = genres.find(g);
+	if(it == genres.end()) return FAILURE;
+	*ans = it->second < 0 ? 0 : containers[it->second].members.size();
+	return SUCCESS;
+    }
+    Status changes(int s, long long* ans) {
+	if(s <= 0) return INVALID_INPUT;
+	auto it = songs.find(s);
+	if(it == songs.end()) return FAILURE;
+	*ans = it->second.local + containers[it->second.container].offset;
+	return SUCCESS;
+    }
+
+private:
+    struct SongRec {
+	int container;
+	long long local;
+    };
+    struct Container {
+	int genre;
+	long long offset;
+	vector<int> members;
+    };
+    unordered_map<int,SongRec> songs;
+    // genre id -> container index, -1 for a genre without songs
+    unordered_map<int,int> genres;
+    vector<Container> containers;
+};
+
+// ---------------------------------------------------------------------------------------
+// Zipf(n, s) sampler by rejection-inversion (Hormann & Derflinger), O(1) per sample and
+// n may change between calls, which is what a growing catalog needs.
+// ---------------------------------------------------------------------------------------
+class Zipf
+{
+public:
+    explicit Zipf(double exponent) : s(exponent) {}
+    // returns a rank in [1, n], rank 1 being the most popular
+    long long sample(long long n, mt19937_64& rng) {
+	uniform_real_distribution<double> uni(0.0, 1.0);
+	if(n <= 1) return 1;
+	if(s <= 0) return 1 + (long long)(uni(rng) * n) % n;
+	double hX1 = hIntegral(1.5) - 1.0;
+	double hN = hIntegral(n + 0.5);
+	double sConst = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+	while(true) {
+	    double u = hN + uni(rng) * (hX1 - hN);
+	    double x = hIntegralInverse(u);
+	    long long k = (long long)(x + 0.5);
+	    if(k < 1) k = 1;
+	    if(k > n) k = n;
+	    if(k - x <= sConst || u >= hIntegral(k + 0.5) - h((double)k)) {
+		return k;
+	    }
+	}
+    }
+
+private:
+    double s;
+    double h(double x) const { return exp(-s * log(x)); }
+    double hIntegral(double x) const { double lx = log(x); return helper2((1.0 - s) * lx) * lx; }
+    double hIntegralInverse(double x) const {
+	double t = x * (1.0 - s);
+	if(t < -1.0) t = -1.0;
+	return exp(helper1(t) * x);
+    }
+    static double helper1(double x) { return fabs(x) > 1e-8 ? log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x)); }
+    static double helper2(double x) { return fabs(x) > 1e-8 ? expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x)); }
+};
+
+// ---------------------------------------------------------------------------------------
+// id sources
+// ---------------------------------------------------------------------------------------
+static const long long ID_PRIME = 2147483647LL; // 2^31 - 1
+
+// i-th id (i >= 1) of a stream: sequential, or a bijection of [1, 2^31-2] scattering ids
+static int denseOrSparseId(long long i, bool dense, long long multiplier) {
+    if(dense) return (int)i;
+    return (int)((i % (ID_PRIME - 1) * multiplier) % ID_PRIME);
+}
+
+// ids whose Fibonacci hash collides: frac(k * multiplier) < delta, with multiplier
+// computed exactly like HashTable::hashKey does. consecutive hits of an irrational
+// rotation are a Fibonacci number apart, so the next one is found by trying those.
+class CollidingIds
+{
+public:
+    CollidingIds(long long count, int parity) : cur(0), take(parity) {
+	// bucket = floor(capacity * frac) is 0 whenever frac < 1/capacity, and the table never
+	// grows past count/2 buckets. if there are not that many such ids below 2^31, accept
+	// a few buckets' worth instead.
+	delta = 1.0L / (2 * count + 2);
+	long double needed = 4.0L * (count + 1) / 2147483647.0L;
+	if(delta < needed) delta = needed;
+	fib[0] = 1;
+	fib[1] = 2;
+	for(int i = 2; i < 45; i++) fib[i] = fib[i-1] + fib[i-2];
+    }
+    // returns 0 (an invalid id) once ids run out
+    int next() {
+	// hits alternate between the two streams (songs and genres), so they never share an id
+	int first = step();
+	int second = step();
+	return take ? second : first;
+    }
+
+private:
+    long long cur;
+    int take;
+    long double delta;
+    long long fib[45];
+
+    static long double frac(long long k) {
+	static long double multiplier = 0.5 * (sqrt(5) - 1);
+	long double scaled = multiplier * k;
+	return scaled - floorl(scaled);
+    }
+    int step() {
+	for(int i = 0; i < 45; i++) {
+	    long long k = cur + fib[i];
+	    if(k >= ID_PRIME) break;
+	    if(frac(k) < delta) {
+		cur = k;
+		return (int)k;
+	    }
+	}
+	return 0;
+    }
+};
+
+// ---------------------------------------------------------------------------------------
+// generator
+// ---------------------------------------------------------------------------------------
+struct Options {
+    long long ops = 10000;
+    unsigned long long seed = 1;
+    string mode = "random";
+    double mix[NUM_OPS] = {2, 40, 2, 20, 16, 20};
+    double zipf = 1.0;
+    double genreSkew = 0.8;
+    double invalid = 0.02;
+    int depth = 10;
+    bool dense = false;
+    string out;
+    bool expected = true;
+};
+
+class Generator
+{
+public:
+    Generator(const Options& o, FILE* in, FILE* out)
+	: opt(o), rng(o.seed), popularity(o.zipf), genrePick(o.genreSkew), in(in), out(out),
+	  songIds(o.mode == "collide" ? o.ops + 1 : 1, 0), genreIds(o.mode == "collide" ? o.ops + 1 : 1, 1),
+	  emitted(0), nextSong(1), nextGenre(1)
+    {}
+
+    void run() {
+	if(opt.mode == "deep-merge") {
+	    deepMerge();
+	} else {
+	    mixed();
+	}
+    }
+
+private:
+    const Options& opt;
+    mt19937_64 rng;
+    Zipf popularity;
+    Zipf genrePick;
+    FILE* in;
+    FILE* out;
+    Reference ref;
+    CollidingIds songIds;
+    CollidingIds genreIds;
+    long long emitted;
+    long long nextSong;
+    long long nextGenre;
+    vector<int> songs;       // every song ever added, oldest first
+    vector<int> liveGenres;  // genres that were added or created by a merge
+
+    bool done() const { return emitted >= opt.ops; }
+    double uniform() { return uniform_real_distribution<double>(0.0, 1.0)(rng); }
+
+    int freshSong() {
+	if(opt.mode == "collide") return songIds.next();
+	return denseOrSparseId(nextSong++, opt.dense, 48271);
+    }
+    int freshGenre() {
+	if(opt.mode == "collide") return genreIds.next();
+	return denseOrSparseId(nextGenre++, opt.dense, 16807);
+    }
+    // a song id for a query: popular (Zipf rank) existing songs, sometimes unknown or invalid
+    int querySong() {
+	if(songs.empty() || uniform() < opt.invalid) return badId();
+	return songs[popularity.sample(songs.size(), rng) - 1];
+    }
+    int pickGenre() {
+	if(liveGenres.empty() || uniform() < opt.invalid) return badId();
+	return liveGenres[genrePick.sample(liveGenres.size(), rng) - 1];
+    }
+    int badId() {
+	switch(rng() % 3) {
+	case 0: return 0;
+	case 1: return -(int)(rng() % 1000) - 1;
+	default: return (int)(rng() % 2147483646) + 1; // almost surely unknown
+	}
+    }
+
+    void emit(Op op, int a, int b = 0, int c = 0) {
+	if(op == ADD_SONG) fprintf(in, "%s %d %d\n", opNames[op], a, b);
+	else if(op == MERGE) fprintf(in, "%s %d %d %d\n", opNames[op], a, b, c);
+	else fprintf(in, "%s %d\n", opNames[op], a);
+	emitted++;
+	if(out == nullptr) return;
+	Status st = SUCCESS;
+	long long ans = 0;
+	bool hasAns = false;
+	switch(op) {
+	case ADD_GENRE: st = ref.addGenre(a); break;
+	case ADD_SONG: st = ref.addSong(a, b); break;
+	case MERGE: st = ref.merge(a, b, c); break;
+	case GET_SONG_GENRE: st = ref.songGenre(a, &ans); hasAns = true; break;
+	case GET_COUNT: st = ref.songCount(a, &ans); hasAns = true; break;
+	case GET_CHANGES: st = ref.changes(a, &ans); hasAns = true; break;
+	default: break;
+	}
+	if(hasAns && st == SUCCESS) fprintf(out, "%s: %s, %lld\n", opNames[op], statusNames[st], ans);
+	else fprintf(out, "%s: %s\n", opNames[op], statusNames[st]);
+    }
+
+    void addGenre() {
+	int g = uniform() < opt.invalid ? badId() : freshGenre();
+	emit(ADD_GENRE, g);
+	if(g > 0) liveGenres.push_back(g);
+    }
+    void addSong() {
+	int s = uniform() < opt.invalid ? badId() : freshSong();
+	int g = pickGenre();
+	emit(ADD_SONG, s, g);
+	if(s > 0 && g > 0) songs.push_back(s);
+    }
+    void merge() {
+	int g1 = pickGenre();
+	int g2 = pickGenre();
+	int g3 = uniform() < opt.invalid ? pickGenre() : freshGenre();
+	emit(MERGE, g1, g2, g3);
+	if(g3 > 0 && g1 > 0 && g2 > 0 && g1 != g2 && g3 != g1 && g3 != g2) liveGenres.push_back(g3);
+    }
+
+    void mixed() {
+	double total = 0;
+	for(int i = 0; i < NUM_OPS; i++) total += opt.mix[i];
+	while(!done()) {
+	    double r = uniform() * total;
+	    int op = 0;
+	    while(op < NUM_OPS - 1 && r >= opt.mix[op]) {
+		r -= opt.mix[op];
+		op++;
+	    }
+	    // nothing to add songs to yet
+	    if(liveGenres.empty() && op != ADD_GENRE) op = ADD_GENRE;
+	    switch(op) {
+	    case ADD_GENRE: addGenre(); break;
+	    case ADD_SONG: addSong(); break;
+	    case MERGE: merge(); break;
+	    case GET_SONG_GENRE: emit(GET_SONG_GENRE, querySong()); break;
+	    case GET_COUNT: emit(GET_COUNT, pickGenre()); break;
+	    default: emit(GET_CHANGES, querySong()); break;
+	    }
+	}
+    }
+
+    void deepMerge() {
+	const long long width = 1LL << opt.depth;
+	while(!done()) {
+	    vector<int> level;
+	    vector<int> roundSongs;
+	    for(long long i = 0; i < width && !done(); i++) {
+		int g = freshGenre();
+		emit(ADD_GENRE, g);
+		int s = freshSong();
+		emit(ADD_SONG, s, g);
+		level.push_back(g);
+		roundSongs.push_back(s);
+	    }
+	    // equal sizes at every level: each union adds one to the depth of the smaller side
+	    while(level.size() > 1 && !done()) {
+		vector<int> up;
+		for(size_t i = 0; i + 1 < level.size() && !done(); i += 2) {
+		    int g = freshGenre();
+		    emit(MERGE, level[i], level[i+1], g);
+		    up.push_back(g);
+		}
+		level.swap(up);
+	    }
+	    // the first songs of the round are the deepest leaves now
+	    for(size_t i = 0; i < roundSongs.size() && !done(); i++) {
+		emit(i % 2 ? GET_CHANGES : GET_SONG_GENRE, roundSongs[i]);
+	    }
+	    if(!level.empty() && !done()) emit(GET_COUNT, level[0]);
+	}
+    }
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr, "usage: %s [--ops N] [--seed S] [--mode random|deep-merge|collide] [--mix a:b:c:d:e:f]\n"
+		    "          [--zipf S] [--genre-skew S] [--invalid P] [--depth L] [--ids dense|sparse]\n"
+		    "          [--out PREFIX] [--no-expected]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for(int i = 1; i < argc; i++) {
+	string a = argv[i];
+	bool hasValue = i + 1 < argc;
+	if(a == "--no-expected") opt.expected = false;
+	else if(!hasValue) usage(argv[0]);
+	else if(a == "--ops") opt.ops = atoll(argv[++i]);
+	else if(a == "--seed") opt.seed = strtoull(argv[++i], nullptr, 10);
+	else if(a == "--mode") opt.mode = argv[++i];
+	else if(a == "--zipf") opt.zipf = atof(argv[++i]);
+	else if(a == "--genre-skew") opt.genreSkew = atof(argv[++i]);
+	else if(a == "--invalid") opt.invalid = atof(argv[++i]);
+	else if(a == "--depth") opt.depth = atoi(argv[++i]);
+	else if(a == "--ids") opt.dense = string(argv[++i]) == "dense";
+	else if(a == "--out") opt.out = argv[++i];
+	else if(a == "--mix") {
+	    if(sscanf(argv[++i], "%lf:%lf:%lf:%lf:%lf:%lf", &opt.mix[0], &opt.mix[1], &opt.mix[2],
+		      &opt.mix[3], &opt.mix[4], &opt.mix[5]) != NUM_OPS) usage(argv[0]);
+	} else usage(argv[0]);
+    }
+    if(opt.mode != "random" && opt.mode != "deep-merge" && opt.mode != "collide") usage(argv[0]);
+    if(opt.depth < 1 || opt.depth > 30 || opt.ops < 0) usage(argv[0]);
+
+    FILE* in = stdout;
+    FILE* out = nullptr;
+    if(!opt.out.empty()) {
+	in = fopen((opt.out + ".in").c_str(), "w");
+	if(opt.expected) out = fopen((opt.out + ".out").c_str(), "w");
+	if(in == nullptr || (opt.expected && out == nullptr)) {
+	    perror("fopen");
+	    return 1;
+	}
+    }
+    static char inBuf[1 << 20];
+    static char outBuf[1 << 20];
+    setvbuf(in, inBuf, _IOFBF, sizeof(inBuf));
+    if(out != nullptr) setvbuf(out, outBuf, _IOFBF, sizeof(outBuf));
+
+    Generator gen(opt, in, out);
+    gen.run();
+
+    if(in != stdout) fclose(in);
+    if(out != nullptr) fclose(out);
+    return 0;
+}
@@ -0,0 +1,1103 @@
+// model_check.cpp
+// Randomized check of the DSpotify operations main25b2.cpp cannot reach, so the
+// gen_workload streams do not cover them. Random operations run on a DSpotify and on a
+// naive reference model side by side, and every answer is compared. The first mismatch
+// is printed with its operation number and the program exits with status 1.
+//
+// Ids come from small pools, so the same ids are removed, re-added and merged many
+// times. Each mode also counts the situations it is meant to reach, and it fails if one
+// of them never happened.
+//
+// build: g++ -std=c++14 -DNDEBUG -O2 -o model_check.out model_check.cpp $(ls ../*.cpp | grep -v main25b2)
+//
+// usage: ./model_check.out [options]
+//   --mode M   remove (default), songcache, readview, build, spill or shared
+//   --ops N    number of operations (default 20000)
+//   --seed S   random seed (default 1)
+//   --widths W compact (default, DSpotify) or wide (BasicDSpotify<dspotify::Wide>); spill
+//              and shared have compact only
+//
+// modes:
+//   remove     addGenre/addSong/mergeGenres with removeSong and removeGenre, checking
+//              every query plus getLargestGenres and forEachSongInGenre. Covers:
+//              removing a root that other songs hang under (it stays as a tombstone),
+//              removing the last song of a genre, and re-adding a removed id.
+//   songcache  the same operations with a small song cache on (setSongCacheSize), so most
+//              queries are answered from it, plus a second catalog that is absorbed into
+//              the first now and then. Checks that a cached answer is never stale after
+//              mergeGenres, removeSong and a re-add of the id, or absorb (the absorbed
+//              catalog must forget its songs), and across the wrap-around of the cache
+//              epoch: advanceSongCacheEpoch jumps close to UINT32_MAX while entries of
+//              epoch 1 are still in the cache, and a few merges wrap it.
+//   readview   addGenre/addSong/mergeGenres/removeSong/removeGenre and absorbs of a second
+//              catalog, with a view published every few mutations (and by publishReadView
+//              now and then). Every newly published view is compared with the model in
+//              full, and an older view with the model of its time, so a version changed
+//              after it was published shows. Now and then updates of the versioned maps
+//              are made to fail (failReadViewUpdates): with one failure the last view must
+//              stay published until the interval ends, where one rebuild catches up; with
+//              two the publish at the end of the interval fails as well, and the next try
+//              must come only at the end of the following interval. No mutation between
+//              two interval ends may rebuild or publish.
+//   build      buildFromCatalog against a second catalog fed the same records through
+//              addGenre/addSong one by one, instead of the model. Each random catalog is built
+//              with 1, 3 and 8 threads, each with and without a dense id range covering half
+//              of the ids. The records hold duplicate genre and song ids (the first must win),
+//              non-positive ids and songs of genres never added. Every answer is compared,
+//              member lists in their order (forEachSongInGenre and getGenreSongsPage) and
+//              getLargestGenres in full, then again after the same merges, removals and
+//              additions on all of them, which walk and link the forests the build set up.
+//   spill      SpilledDSpotify's six operations against the model, with the store in
+//              model_check_spill.dat in the current directory (removed at the end). It runs
+//              three times: with a cache of one page, a single index page and a single genre
+//              slot, three pages and two index pages, and 64 pages with the index sized by
+//              create(), then queries every id after a flush. Songs and merges mostly go to
+//              genres not merged away yet, so paths of three links show up. Covers: buckets
+//              overflowing into page chains, songs queued for path compression that a
+//              mergeGenres moves under a new root before the batch is compressed, answers read
+//              back after the one page of the cache was evicted, and genre slots doubling
+//              under addGenre and mergeGenres.
+//   shared     SharedDSpotify's six operations against the model, in a segment named after
+//              the process (removed at the end). Every song query is asked of the writer,
+//              which compresses the path it walked, and of a second handle attached
+//              read-only, which never does. The segment holds half of the song pool, so
+//              addSong fills it up and must then report ALLOCATION_ERROR and change
+//              nothing. Songs and merges mostly go to genres not merged away yet, as in spill.
+
+#include "../dspotify25b2.h"
+#include "../spilleddspotify.h"
+#include "../shareddspotify.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// ---------------------------------------------------------------------------------------
+// Reference model. A song stores its genre and its number of changes directly, and a
+// merge visits every song of the two genres. Slow, but it shares nothing with DSpotify.
+// It also mirrors which song is the root of each genre's tree, but only to count the
+// situations above, never to compute an answer.
+// ---------------------------------------------------------------------------------------
+class Model
+{
+public:
+    StatusType addGenre(int g) {
+	if(g <= 0) return StatusType::INVALID_INPUT;
+	if(genres.count(g)) return StatusType::FAILURE;
+	genres[g] = GenreRec();
+	return StatusType::SUCCESS;
+    }
+    StatusType addSong(int s, int g) {
+	if(s <= 0 || g <= 0) return StatusType::INVALID_INPUT;
+	if(songs.count(s)) return StatusType::FAILURE;
+	auto it = genres.find(g);
+	if(it == genres.end()) return StatusType::FAILURE;
+	songs[s] = SongRec{g, 1};
+	it->second.members.insert(s);
+	if(it->second.root == 0) it->second.root = s;
+	if(removed.count(s)) readded++;
+	return StatusType::SUCCESS;
+    }
+    StatusType merge(int g1, int g2, int g3) {
+	if(g1 <= 0 || g2 <= 0 || g3 <= 0 || g1 == g2 || g2 == g3 || g1 == g3) return StatusType::INVALID_INPUT;
+	if(!genres.count(g1) || !genres.count(g2) || genres.count(g3)) return StatusType::FAILURE;
+	GenreRec& a = genres[g1];
+	GenreRec& b = genres[g2];
+	GenreRec made;
+	// union by size keeps the root of the bigger tree, g1's on a tie
+	made.root = a.root != 0 && (b.root == 0 || a.members.size() >= b.members.size()) ? a.root : b.root;
+	for(GenreRec* from : {&a, &b}) {
+	    for(int s : from->members) {
+		songs[s].genre = g3;
+		songs[s].changes++;
+		made.members.insert(s);
+	    }
+	    from->members.clear();
+	    from->root = 0;
+	}
+	genres[g3] = made;
+	return StatusType::SUCCESS;
+    }
+    StatusType removeSong(int s) {
+	if(s <= 0) return StatusType::INVALID_INPUT;
+	auto it = songs.find(s);
+	if(it == songs.end()) return StatusType::FAILURE;
+	GenreRec& g = genres[it->second.genre];
+	g.members.erase(s);
+	if(g.root == s && !g.members.empty()) rootsRemoved++;
+	if(g.members.empty()) {
+	    g.root = 0;
+	    lastRemoved++;
+	}
+	songs.erase(it);
+	removed.insert(s);
+	return StatusType::SUCCESS;
+    }
+    StatusType removeGenre(int g) {
+	if(g <= 0) return StatusType::INVALID_INPUT;
+	auto it = genres.find(g);
+	if(it == genres.end() || !it->second.members.empty()) return StatusType::FAILURE;
+	genres.erase(it);
+	return StatusType::SUCCESS;
+    }
+    StatusType songGenre(int s, int* ans) const {
+	if(s <= 0) return StatusType::INVALID_INPUT;
+	auto it = songs.find(s);
+	if(it == songs.end()) return StatusType::FAILURE;
+	*ans = it->second.genre;
+	return StatusType::SUCCESS;
+    }
+    StatusType songCount(int g, int* ans) const {
+	if(g <= 0) return StatusType::INVALID_INPUT;
+	auto it = genres.find(g);
+	if(it == genres.end()) return StatusType::FAILURE;
+	*ans = (int)it->second.members.size();
+	return StatusType::SUCCESS;
+    }
+    StatusType changes(int s, int* ans) const {
+	if(s <= 0) return StatusType::INVALID_INPUT;
+	auto it = songs.find(s);
+	if(it == songs.end()) return StatusType::FAILURE;
+	*ans = it->second.changes;
+	return StatusType::SUCCESS;
+    }
+    // the k largest genres, ties by smaller id
+    vector<int> largest(int k) const {
+	vector<pair<int,int>> order;
+	for(auto& g : genres) order.push_back(make_pair(-(int)g.second.members.size(), g.first));
+	sort(order.begin(), order.end());
+	vector<int> ids;
+	for(int i = 0; i < k && i < (int)order.size(); i++) ids.push_back(order[i].second);
+	return ids;
+    }
+    vector<int> songIds() const {
+	vector<int> ids;
+	for(auto& s : songs) ids.push_back(s.first);
+	return ids;
+    }
+    vector<int> genreIds() const {
+	vector<int> ids;
+	for(auto& g : genres) ids.push_back(g.first);
+	return ids;
+    }
+    const set<int>* members(int g) const {
+	auto it = genres.find(g);
+	return it == genres.end() ? nullptr : &it->second.members;
+    }
+    // moves everything of other here, FAILURE (nothing moves) if they share an id
+    StatusType absorb(Model& other) {
+	for(auto& s : other.songs) {
+	    if(songs.count(s.first)) return StatusType::FAILURE;
+	}
+	for(auto& g : other.genres) {
+	    if(genres.count(g.first)) return StatusType::FAILURE;
+	}
+	songs.insert(other.songs.begin(), other.songs.end());
+	genres.insert(other.genres.begin(), other.genres.end());
+	other.songs.clear();
+	other.genres.clear();
+	return StatusType::SUCCESS;
+    }
+
+    long long rootsRemoved = 0; // a removed song that was its tree's root and had company
+    long long lastRemoved = 0;  // a removed song that was the last of its genre
+    long long readded = 0;      // an added song whose id had been removed before
+
+private:
+    struct SongRec {
+	int genre;
+	int changes;
+    };
+    struct GenreRec {
+	set<int> members;
+	int root = 0; // song at the root of the genre's tree (maybe removed since), 0 if none
+    };
+    map<int,SongRec> songs;
+    map<int,GenreRec> genres;
+    set<int> removed;
+};
+
+// ---------------------------------------------------------------------------------------
+// comparison helpers: the first mismatch is reported, and the run fails
+// ---------------------------------------------------------------------------------------
+static const char* statusName(StatusType st) {
+    switch(st) {
+    case StatusType::SUCCESS: return "SUCCESS";
+    case StatusType::ALLOCATION_ERROR: return "ALLOCATION_ERROR";
+    case StatusType::INVALID_INPUT: return "INVALID_INPUT";
+    default: return "FAILURE";
+    }
+}
+
+static long long opIndex = 0;
+static long long mismatches = 0;
+
+static void mismatch(const string& op, const string& got, const string& want) {
+    if(mismatches++ == 0) {
+	fprintf(stderr, "op %lld: %s: got %s, expected %s\n", opIndex, op.c_str(), got.c_str(), want.c_str());
+    }
+}
+
+static void check(const string& op, StatusType got, StatusType want) {
+    if(got != want) mismatch(op, statusName(got), statusName(want));
+}
+
+static void check(const string& op, output_t<int> got, StatusType wantSt, int want) {
+    if(got.status() != wantSt) {
+	mismatch(op, statusName(got.status()), statusName(wantSt));
+    } else if(wantSt == StatusType::SUCCESS && got.ans() != want) {
+	mismatch(op, to_string(got.ans()), to_string(want));
+    }
+}
+
+static void collectSong(int songId, void* ctx) {
+    static_cast<vector<int>*>(ctx)->push_back(songId);
+}
+
+// ---------------------------------------------------------------------------------------
+// modes
+// ---------------------------------------------------------------------------------------
+struct Options {
+    string mode = "remove";
+    long long ops = 20000;
+    unsigned long long seed = 1;
+    bool wide = false;
+};
+
+// an id from [1, pool], sometimes 0 or negative
+static int pickId(mt19937_64& rng, int pool) {
+    if(rng() % 50 == 0) return -(int)(rng() % 3);
+    return 1 + (int)(rng() % pool);
+}
+
+template<class Engine>
+static bool checkRemove(const Options& opt) {
+    mt19937_64 rng(opt.seed);
+    Engine ds;
+    Model model;
+    const int songPool = 400;
+    const int genrePool = 120;
+    for(opIndex = 0; opIndex < opt.ops && mismatches == 0; opIndex++) {
+	int r = (int)(rng() % 100);
+	int s = pickId(rng, songPool);
+	int g = pickId(rng, genrePool);
+	string args = " " + to_string(s) + " " + to_string(g);
+	int want = 0;
+	if(r < 8) {
+	    check("addGenre " + to_string(g), ds.addGenre(g), model.addGenre(g));
+	} else if(r < 40) {
+	    check("addSong" + args, ds.addSong(s, g), model.addSong(s, g));
+	} else if(r < 47) {
+	    int g2 = pickId(rng, genrePool);
+	    int g3 = pickId(rng, genrePool);
+	    string op = "mergeGenres " + to_string(g) + " " + to_string(g2) + " " + to_string(g3);
+	    check(op, ds.mergeGenres(g, g2, g3), model.merge(g, g2, g3));
+	} else if(r < 62) {
+	    check("removeSong " + to_string(s), ds.removeSong(s), model.removeSong(s));
+	} else if(r < 68) {
+	    check("removeGenre " + to_string(g), ds.removeGenre(g), model.removeGenre(g));
+	} else if(r < 80) {
+	    StatusType st = model.songGenre(s, &want);
+	    check("getSongGenre " + to_string(s), ds.getSongGenre(s), st, want);
+	} else if(r < 92) {
+	    StatusType st = model.changes(s, &want);
+	    check("getNumberOfGenreChanges " + to_string(s), ds.getNumberOfGenreChanges(s), st, want);
+	} else if(r < 96) {
+	    StatusType st = model.songCount(g, &want);
+	    check("getNumberOfSongsByGenre " + to_string(g), ds.getNumberOfSongsByGenre(g), st, want);
+	} else if(r < 98) {
+	    int ids[5];
+	    vector<int> expected = model.largest(5);
+	    output_t<int> got = ds.getLargestGenres(5, ids);
+	    check("getLargestGenres 5", got, StatusType::SUCCESS, (int)expected.size());
+	    for(int i = 0; got.status() == StatusType::SUCCESS && i < got.ans() && i < (int)expected.size(); i++) {
+		if(ids[i] != expected[i]) {
+		    mismatch("getLargestGenres 5, position " + to_string(i), to_string(ids[i]), to_string(expected[i]));
+		}
+	    }
+	} else {
+	    const set<int>* members = model.members(g);
+	    vector<int> got;
+	    StatusType st = ds.forEachSongInGenre(g, collectSong, &got);
+	    StatusType wantSt = g <= 0 ? StatusType::INVALID_INPUT : members == nullptr ? StatusType::FAILURE : StatusType::SUCCESS;
+	    check("forEachSongInGenre " + to_string(g), st, wantSt);
+	    sort(got.begin(), got.end());
+	    if(members != nullptr && st == StatusType::SUCCESS && got != vector<int>(members->begin(), members->end())) {
+		mismatch("forEachSongInGenre " + to_string(g), to_string(got.size()) + " songs",
+			 to_string(members->size()) + " songs");
+	    }
+	}
+    }
+    printf("remove%s seed %llu: %lld ops, %lld roots with children removed, %lld last songs of a genre removed,"
+	   " %lld removed ids re-added\n", opt.wide ? " (wide)" : "", opt.seed, opIndex, model.rootsRemoved, model.lastRemoved, model.readded);
+    if(mismatches == 0 && (model.rootsRemoved == 0 || model.lastRemoved == 0 || model.readded == 0)) {
+	fprintf(stderr, "remove seed %llu: a covered situation never happened, raise --ops\n", opt.seed);
+	return false;
+    }
+    return mismatches == 0;
+}
+
+// an id from [lo, hi], sometimes 0 or negative
+static int pickIn(mt19937_64& rng, int lo, int hi) {
+    if(rng() % 50 == 0) return -(int)(rng() % 3);
+    return lo + (int)(rng() % (hi - lo + 1));
+}
+
+// getSongGenre or getNumberOfGenreChanges of song s on ds, checked against model
+template<class Engine>
+static void checkSongQuery(Engine& ds, const Model& model, int s, bool changes) {
+    int want = 0;
+    if(changes) {
+	StatusType st = model.changes(s, &want);
+	check("getNumberOfGenreChanges " + to_string(s), ds.getNumberOfGenreChanges(s), st, want);
+    } else {
+	StatusType st = model.songGenre(s, &want);
+	check("getSongGenre " + to_string(s), ds.getSongGenre(s), st, want);
+    }
+}
+
+template<class Engine>
+static bool checkSongCache(const Options& opt) {
+    mt19937_64 rng(opt.seed);
+    // ds keeps songs 1..songPool and genres 1..genrePool of its own, plus whatever it
+    // absorbed. other fills fresh ranges above songBase / genreBase, which move up by a
+    // pool at every absorb, so an absorb never collides
+    Engine ds;
+    Engine other;
+    Model model;
+    Model otherModel;
+    const int songPool = 300;
+    const int genrePool = 60;
+    const int cacheEntries = 64;
+    // every cycle starts the cache over at epoch 1 and later jumps close to the wrap
+    const int cycle = 1000;
+    // merges from the jump to the wrap: the fewer, the more epoch 1 entries are still there
+    const uint32_t wrapDistance = 0;
+    int songBase = songPool;
+    int genreBase = genrePool;
+    long long hits = 0;
+    long long misses = 0;
+    long long merges = 0;
+    long long mergesSinceJump = -1;
+    long long wraps = 0;
+    long long absorbs = 0;
+    long long absorbedQueries = 0; // queries on other for songs it had given away
+    long long readdedQueries = 0;  // queries of a song after it was removed and added again
+    set<int> readded;
+    if(ds.setSongCacheSize(cacheEntries) != StatusType::SUCCESS
+       || other.setSongCacheSize(cacheEntries) != StatusType::SUCCESS) {
+	fprintf(stderr, "songcache: could not turn the cache on\n");
+	return false;
+    }
+    // ds mostly works on its own ids, sometimes on absorbed ones
+    auto dsSong = [&]() {
+	return rng() % 8 == 0 ? pickIn(rng, 1, songBase) : pickIn(rng, 1, songPool);
+    };
+    auto dsGenre = [&]() {
+	return rng() % 8 == 0 ? pickIn(rng, 1, genreBase) : pickIn(rng, 1, genrePool);
+    };
+    auto collectStats = [&]() {
+	long long h = 0;
+	long long m = 0;
+	ds.songCacheStats(&h, &m);
+	hits += h;
+	misses += m;
+    };
+    for(opIndex = 0; opIndex < opt.ops && mismatches == 0; opIndex++) {
+	if(opIndex % cycle == 0 && opIndex > 0) {
+	    collectStats();
+	    check("setSongCacheSize " + to_string(cacheEntries), ds.setSongCacheSize(cacheEntries), StatusType::SUCCESS);
+	    mergesSinceJump = -1;
+	} else if(opIndex % cycle == cycle / 4) {
+	    // the entries stored before (down to epoch 1) stay in the cache across the jump
+	    check("advanceSongCacheEpoch", ds.advanceSongCacheEpoch(UINT32_MAX - wrapDistance), StatusType::SUCCESS);
+	    mergesSinceJump = 0;
+	}
+	int r = (int)(rng() % 100);
+	if(r < 45) {
+	    int s = dsSong();
+	    if(readded.count(s)) readdedQueries++;
+	    checkSongQuery(ds, model, s, r % 2 == 1);
+	} else if(r < 55) {
+	    int s = pickIn(rng, 1, songPool);
+	    int g = dsGenre();
+	    long long readdedBefore = model.readded;
+	    check("addSong " + to_string(s) + " " + to_string(g), ds.addSong(s, g), model.addSong(s, g));
+	    if(model.readded > readdedBefore) readded.insert(s);
+	} else if(r < 60) {
+	    int g = pickIn(rng, 1, genrePool);
+	    check("addGenre " + to_string(g), ds.addGenre(g), model.addGenre(g));
+	} else if(r < 68) {
+	    int g1 = dsGenre();
+	    int g2 = dsGenre();
+	    int g3 = dsGenre();
+	    StatusType want = model.merge(g1, g2, g3);
+	    check("mergeGenres " + to_string(g1) + " " + to_string(g2) + " " + to_string(g3),
+		  ds.mergeGenres(g1, g2, g3), want);
+	    if(want == StatusType::SUCCESS) {
+		merges++;
+		if(mergesSinceJump >= 0 && ++mergesSinceJump == (long long)wrapDistance + 1) wraps++;
+	    }
+	} else if(r < 76) {
+	    int s = dsSong();
+	    check("removeSong " + to_string(s), ds.removeSong(s), model.removeSong(s));
+	} else if(r < 78) {
+	    int g = dsGenre();
+	    check("removeGenre " + to_string(g), ds.removeGenre(g), model.removeGenre(g));
+	} else if(r < 88) {
+	    // other grows in its own range
+	    int s = pickIn(rng, songBase + 1, songBase + songPool);
+	    int g = pickIn(rng, genreBase + 1, genreBase + genrePool);
+	    if(r < 82) {
+		check("other addGenre " + to_string(g), other.addGenre(g), otherModel.addGenre(g));
+	    } else if(r < 86) {
+		check("other addSong " + to_string(s) + " " + to_string(g), other.addSong(s, g), otherModel.addSong(s, g));
+	    } else {
+		int g2 = pickIn(rng, genreBase + 1, genreBase + genrePool);
+		int g3 = pickIn(rng, genreBase + 1, genreBase + genrePool);
+		check("other mergeGenres " + to_string(g) + " " + to_string(g2) + " " + to_string(g3),
+		      other.mergeGenres(g, g2, g3), otherModel.merge(g, g2, g3));
+	    }
+	} else if(r < 99) {
+	    // other's songs, including the ones it gave away at the last absorb
+	    int s = pickIn(rng, songBase - songPool + 1, songBase + songPool);
+	    if(s > 0 && s <= songBase && s > songPool) absorbedQueries++;
+	    checkSongQuery(other, otherModel, s, r % 2 == 1);
+	} else if(rng() % 8 == 0) {
+	    StatusType want = model.absorb(otherModel);
+	    check("absorb", ds.absorb(&other), want);
+	    if(want == StatusType::SUCCESS) {
+		absorbs++;
+		songBase += songPool;
+		genreBase += genrePool;
+	    }
+	}
+    }
+    collectStats();
+    printf("songcache%s seed %llu: %lld ops, %lld cache hits, %lld misses, %lld merges, %lld epoch wraps,"
+	   " %lld absorbs, %lld queries of given away songs, %lld queries of re-added songs\n",
+	   opt.wide ? " (wide)" : "", opt.seed, opIndex, hits, misses, merges, wraps, absorbs, absorbedQueries,
+	   readdedQueries);
+    if(mismatches == 0 && (hits == 0 || wraps == 0 || absorbs == 0 || absorbedQueries == 0 || readdedQueries == 0)) {
+	fprintf(stderr, "songcache seed %llu: a covered situation never happened, raise --ops\n", opt.seed);
+	return false;
+    }
+    return mismatches == 0;
+}
+
+// every answer of view against model, plus some ids that are not there
+static void checkView(const ReadView& view, const Model& model, const string& what) {
+    int want = 0;
+    vector<int> ids = model.songIds();
+    if(view.numberOfSongs() != (int)ids.size()) {
+	mismatch(what + " numberOfSongs", to_string(view.numberOfSongs()), to_string(ids.size()));
+    }
+    for(int s : ids) {
+	StatusType st = model.songGenre(s, &want);
+	check(what + " getSongGenre " + to_string(s), view.getSongGenre(s), st, want);
+	st = model.changes(s, &want);
+	check(what + " getNumberOfGenreChanges " + to_string(s), view.getNumberOfGenreChanges(s), st, want);
+    }
+    for(int g : model.genreIds()) {
+	StatusType st = model.songCount(g, &want);
+	check(what + " getNumberOfSongsByGenre " + to_string(g), view.getNumberOfSongsByGenre(g), st, want);
+    }
+    for(int id = -1; id <= 8; id++) {
+	int missing = id * 1000003 + 7;
+	StatusType st = model.songGenre(missing, &want);
+	check(what + " getSongGenre " + to_string(missing), view.getSongGenre(missing), st, want);
+	st = model.songCount(missing, &want);
+	check(what + " getNumberOfSongsByGenre " + to_string(missing), view.getNumberOfSongsByGenre(missing), st, want);
+    }
+    long long visited = 0;
+    auto visit = [&](int songId, int genreId, int changes) {
+	visited++;
+	int g = 0;
+	int c = 0;
+	if(model.songGenre(songId, &g) != StatusType::SUCCESS || model.changes(songId, &c) != StatusType::SUCCESS
+	   || g != genreId || c != changes) {
+	    mismatch(what + " forEachSong " + to_string(songId), to_string(genreId) + "/" + to_string(changes),
+		     to_string(g) + "/" + to_string(c));
+	}
+    };
+    view.forEachSong([](int songId, int genreId, int changes, void* ctx) {
+	(*static_cast<decltype(visit)*>(ctx))(songId, genreId, changes);
+    }, &visit);
+    if(visited != (long long)ids.size()) {
+	mismatch(what + " forEachSong", to_string(visited) + " songs", to_string(ids.size()) + " songs");
+    }
+}
+
+template<class Engine>
+static bool checkReadView(const Options& opt) {
+    mt19937_64 rng(opt.seed);
+    Engine ds;
+    Engine other;
+    Model model;
+    Model otherModel;
+    const int songPool = 400;
+    const int genrePool = 100;
+    const int interval = 50;
+    // other fills fresh ranges above songBase / genreBase, as in songcache
+    int songBase = songPool;
+    int genreBase = genrePool;
+    long long epoch = 0;        // mutations so far, what a view published now must carry
+    long long otherEpoch = 0;
+    long long seenEpoch = -1;   // epoch of the last view checked
+    long long views = 0;
+    long long oldChecks = 0;
+    long long failures = 0;     // update failures forced
+    long long failedPublishes = 0;
+    long long recovered = 0;    // forced failures after which a correct view was published
+    long long absorbs = 0;
+    int failing = 0;            // failures forced and not used up yet
+    bool stale = false;         // an update failed, the next publish rebuilds
+    long long since = 0;        // the engine's sincePublish
+    shared_ptr<const ReadView> oldView;
+    Model oldModel;
+    if(ds.setReadViewInterval(interval) != StatusType::SUCCESS || other.setReadViewInterval(interval) != StatusType::SUCCESS) {
+	fprintf(stderr, "readview: could not turn publishing on\n");
+	return false;
+    }
+    auto stats = [](Engine& e) {
+	long long published = 0;
+	long long rebuilds = 0;
+	e.readViewStats(&published, &rebuilds);
+	return rebuilds;
+    };
+    // the first rebuild is setReadViewInterval's, on the empty catalog
+    long long rebuildsWanted = 1;
+    bool boundary = false;      // this op ends an interval (or publishes explicitly)
+    auto mutatedBy = [&](StatusType st, long long n) {
+	if(st != StatusType::SUCCESS) return;
+	epoch += n;
+	since += n;
+	boundary = since >= interval;
+    };
+    for(opIndex = 0; opIndex < opt.ops && mismatches == 0; opIndex++) {
+	if(failing == 0 && !stale && opIndex % 1500 == 700) {
+	    failing = 1 + (int)(opIndex / 1500 % 2);
+	    ds.failReadViewUpdates(failing);
+	    failures++;
+	}
+	boundary = false;
+	int r = (int)(rng() % 100);
+	int s = pickIn(rng, 1, songPool);
+	int g = pickIn(rng, 1, genrePool);
+	if(r < 8) {
+	    StatusType want = model.addGenre(g);
+	    check("addGenre " + to_string(g), ds.addGenre(g), want);
+	    mutatedBy(want, 1);
+	} else if(r < 50) {
+	    StatusType want = model.addSong(s, g);
+	    check("addSong " + to_string(s) + " " + to_string(g), ds.addSong(s, g), want);
+	    mutatedBy(want, 1);
+	} else if(r < 60) {
+	    int g2 = pickIn(rng, 1, genrePool);
+	    int g3 = pickIn(rng, 1, genrePool);
+	    StatusType want = model.merge(g, g2, g3);
+	    check("mergeGenres " + to_string(g) + " " + to_string(g2) + " " + to_string(g3), ds.mergeGenres(g, g2, g3), want);
+	    mutatedBy(want, 1);
+	} else if(r < 75) {
+	    StatusType want = model.removeSong(s);
+	    check("removeSong " + to_string(s), ds.removeSong(s), want);
+	    mutatedBy(want, 1);
+	} else if(r < 80) {
+	    StatusType want = model.removeGenre(g);
+	    check("removeGenre " + to_string(g), ds.removeGenre(g), want);
+	    mutatedBy(want, 1);
+	} else if(r < 86) {
+	    // answers do not mutate, but compress the forest the versions were built from
+	    int want = 0;
+	    StatusType st = model.changes(s, &want);
+	    check("getNumberOfGenreChanges " + to_string(s), ds.getNumberOfGenreChanges(s), st, want);
+	} else if(r < 98) {
+	    int os = pickIn(rng, songBase + 1, songBase + songPool);
+	    int og = pickIn(rng, genreBase + 1, genreBase + genrePool);
+	    StatusType want;
+	    if(r < 90) {
+		want = otherModel.addGenre(og);
+		check("other addGenre " + to_string(og), other.addGenre(og), want);
+	    } else if(r < 96) {
+		want = otherModel.addSong(os, og);
+		check("other addSong " + to_string(os) + " " + to_string(og), other.addSong(os, og), want);
+	    } else {
+		int og2 = pickIn(rng, genreBase + 1, genreBase + genrePool);
+		int og3 = pickIn(rng, genreBase + 1, genreBase + genrePool);
+		want = otherModel.merge(og, og2, og3);
+		check("other mergeGenres " + to_string(og) + " " + to_string(og2) + " " + to_string(og3),
+		      other.mergeGenres(og, og2, og3), want);
+	    }
+	    if(want == StatusType::SUCCESS) otherEpoch++;
+	} else if(r < 99) {
+	    long long moved = (long long)otherModel.songIds().size() + (long long)otherModel.genreIds().size();
+	    StatusType want = model.absorb(otherModel);
+	    check("absorb", ds.absorb(&other), want);
+	    if(want == StatusType::SUCCESS) {
+		mutatedBy(want, moved);
+		otherEpoch += moved;
+		absorbs++;
+		songBase += songPool;
+		genreBase += genrePool;
+	    }
+	} else if(failing == 0) {
+	    check("publishReadView", ds.publishReadView(), StatusType::SUCCESS);
+	    boundary = true;
+	}
+	// a forced failure is used up by the first update after it, at the latest by the one
+	// of the mutation ending the interval, and then by the rebuild of that publish
+	bool published = false;
+	if(boundary) {
+	    since = 0;
+	    if(failing > 0) {
+		// the update failed, the maps are stale
+		failing--;
+		stale = true;
+	    }
+	    if(stale) {
+		rebuildsWanted++;
+		if(failing > 0) {
+		    failing--;
+		    failedPublishes++;
+		} else {
+		    stale = false;
+		    recovered++;
+		    published = true;
+		}
+	    } else {
+		published = true;
+	    }
+	}
+	shared_ptr<const ReadView> view = ds.openReadView();
+	if(published != (view->epoch() != seenEpoch)) {
+	    mismatch("view published", published ? "no" : "yes", published ? "yes" : "no");
+	}
+	if(published) {
+	    // just published: the current state
+	    if(view->epoch() != epoch) {
+		mismatch("view epoch", to_string(view->epoch()), to_string(epoch));
+	    }
+	    checkView(*view, model, "view " + to_string(view->epoch()));
+	    seenEpoch = view->epoch();
+	    views++;
+	    if(views % 4 == 0) {
+		if(oldView) {
+		    checkView(*oldView, oldModel, "old view " + to_string(oldView->epoch()));
+		    oldChecks++;
+		}
+		oldView = view;
+		oldModel = model;
+	    }
+	}
+	if(stats(ds) != rebuildsWanted) {
+	    mismatch("rebuilds of the versioned maps", to_string(stats(ds)), to_string(rebuildsWanted));
+	}
+	if(other.openReadView()->epoch() > otherEpoch) {
+	    mismatch("other view epoch", to_string(other.openReadView()->epoch()), "at most " + to_string(otherEpoch));
+	}
+    }
+    printf("readview%s seed %llu: %lld ops, %lld views checked, %lld old views rechecked, %lld absorbs,"
+	   " %lld update failures forced, %lld publishes failed, %lld recovered\n", opt.wide ? " (wide)" : "", opt.seed,
+	   opIndex, views, oldChecks, absorbs, failures, failedPublishes, recovered);
+    if(mismatches == 0 && (views == 0 || oldChecks == 0 || absorbs == 0 || failedPublishes == 0 || recovered == 0)) {
+	fprintf(stderr, "readview seed %llu: a covered situation never happened, raise --ops\n", opt.seed);
+	return false;
+    }
+    return mismatches == 0;
+}
+
+// every answer of b about the ids up to the pools, compared with a's
+template<class Engine>
+static void compareCatalogs(Engine& a, Engine& b, int songPool, int genrePool, const string& what) {
+    for(int s = -1; s <= songPool && mismatches == 0; s++) {
+	output_t<int> genre = a.getSongGenre(s);
+	check(what + " getSongGenre " + to_string(s), b.getSongGenre(s), genre.status(), genre.ans());
+	output_t<int> changes = a.getNumberOfGenreChanges(s);
+	check(what + " getNumberOfGenreChanges " + to_string(s), b.getNumberOfGenreChanges(s), changes.status(),
+	      changes.ans());
+    }
+    for(int g = -1; g <= genrePool + 3 && mismatches == 0; g++) {
+	output_t<int> want = a.getNumberOfSongsByGenre(g);
+	check(what + " getNumberOfSongsByGenre " + to_string(g), b.getNumberOfSongsByGenre(g), want.status(), want.ans());
+	vector<int> wantList;
+	vector<int> gotList;
+	StatusType st = a.forEachSongInGenre(g, collectSong, &wantList);
+	check(what + " forEachSongInGenre " + to_string(g), b.forEachSongInGenre(g, collectSong, &gotList), st);
+	if(mismatches == 0 && gotList != wantList) {
+	    mismatch(what + " forEachSongInGenre " + to_string(g), "another member list",
+		     "the same " + to_string(wantList.size()) + " songs in the same order");
+	}
+	// the same list in pages of 7
+	int wantPage[7];
+	int gotPage[7];
+	int cursor = 0;
+	do {
+	    int wantNext = 0;
+	    int gotNext = 0;
+	    output_t<int> n = a.getGenreSongsPage(g, cursor, 7, wantPage, &wantNext);
+	    check(what + " getGenreSongsPage " + to_string(g), b.getGenreSongsPage(g, cursor, 7, gotPage, &gotNext),
+		  n.status(), n.ans());
+	    if(n.status() != StatusType::SUCCESS || mismatches != 0) break;
+	    if(!equal(wantPage, wantPage + n.ans(), gotPage) || gotNext != wantNext) {
+		mismatch(what + " getGenreSongsPage " + to_string(g) + " from " + to_string(cursor), "another page",
+			 "the same page");
+	    }
+	    cursor = wantNext;
+	} while(cursor != 0 && mismatches == 0);
+    }
+    vector<int> wantTop(genrePool + 3);
+    vector<int> gotTop(genrePool + 3);
+    output_t<int> n = a.getLargestGenres(genrePool + 3, wantTop.data());
+    check(what + " getLargestGenres", b.getLargestGenres(genrePool + 3, gotTop.data()), n.status(), n.ans());
+    if(mismatches == 0 && n.status() == StatusType::SUCCESS
+       && !equal(wantTop.begin(), wantTop.begin() + n.ans(), gotTop.begin())) {
+	mismatch(what + " getLargestGenres", "other genres or another order", "the same genres in the same order");
+    }
+}
+
+template<class Engine>
+static StatusType mutateCatalog(Engine& ds, int r, int s, int g, int g2, int g3) {
+    if(r < 35) return ds.mergeGenres(g, g2, g3);
+    if(r < 60) return ds.removeSong(s);
+    if(r < 70) return ds.removeGenre(g);
+    if(r < 95) return ds.addSong(s, g);
+    return ds.addGenre(g);
+}
+
+template<class Engine>
+static bool checkBuild(const Options& opt) {
+    mt19937_64 rng(opt.seed);
+    const int threadCounts[] = {1, 3, 8};
+    long long builds = 0;
+    long long records = 0;
+    long long duplicateGenres = 0;
+    long long duplicateSongs = 0;
+    long long invalidIds = 0;
+    long long unknownGenres = 0;
+    for(opIndex = 0; records < opt.ops && mismatches == 0; ) {
+	// small pools, so ids repeat; from empty catalogs to a few hundred records
+	int genrePool = 1 + (int)(rng() % 60);
+	int songPool = 1 + (int)(rng() % 400);
+	int numGenres = (int)(rng() % (2 * genrePool + 10));
+	int numSongs = (int)(rng() % (songPool + 50));
+	vector<int> genreIds(numGenres);
+	vector<int> songIds(numSongs);
+	vector<int> songGenres(numSongs);
+	set<int> genres;
+	for(int& g : genreIds) {
+	    g = rng() % 20 == 0 ? -(int)(rng() % 2) : 1 + (int)(rng() % genrePool);
+	    if(g <= 0) invalidIds++;
+	    else if(!genres.insert(g).second) duplicateGenres++;
+	}
+	set<int> songs;
+	for(int i = 0; i < numSongs; i++) {
+	    songIds[i] = rng() % 30 == 0 ? -(int)(rng() % 2) : 1 + (int)(rng() % songPool);
+	    // genres past the pool are never added
+	    songGenres[i] = rng() % 30 == 0 ? -(int)(rng() % 2) : 1 + (int)(rng() % (genrePool + 3));
+	    if(songIds[i] <= 0 || songGenres[i] <= 0) invalidIds++;
+	    else if(!genres.count(songGenres[i])) unknownGenres++;
+	    else if(!songs.insert(songIds[i]).second) duplicateSongs++;
+	}
+	records += numGenres + numSongs;
+
+	Engine ref;
+	for(int g : genreIds) (void)ref.addGenre(g);
+	for(int i = 0; i < numSongs; i++) (void)ref.addSong(songIds[i], songGenres[i]);
+	check("publishReadView", ref.publishReadView(), StatusType::SUCCESS);
+	vector<Engine*> built;
+	vector<string> names;
+	for(int threads : threadCounts) {
+	    for(int dense = 0; dense < 2 && mismatches == 0; dense++) {
+		Engine* ds = new Engine();
+		built.push_back(ds);
+		names.push_back("build threads=" + to_string(threads) + (dense ? " dense" : ""));
+		const string& what = names.back();
+		if(dense) {
+		    check(what + " setDenseIdRange", ds->setDenseIdRange(songPool / 2, genrePool / 2), StatusType::SUCCESS);
+		}
+		check(what, ds->buildFromCatalog(genreIds.data(), numGenres, songIds.data(), songGenres.data(), numSongs,
+						  threads), StatusType::SUCCESS);
+		check(what + " publishReadView", ds->publishReadView(), StatusType::SUCCESS);
+		long long want = ref.openReadView()->epoch();
+		long long got = ds->openReadView()->epoch();
+		if(got != want) mismatch(what + " epoch", to_string(got), to_string(want));
+		compareCatalogs(ref, *ds, songPool, genrePool, what);
+		builds++;
+	    }
+	}
+
+	// the same mutations on all of them, mostly on the ids the records used
+	for(int k = 0; k < 300 && mismatches == 0; k++, opIndex++) {
+	    int r = (int)(rng() % 100);
+	    int s = 1 + (int)(rng() % songPool);
+	    int g = 1 + (int)(rng() % (genrePool + 3));
+	    int g2 = 1 + (int)(rng() % (genrePool + 3));
+	    int g3 = 1 + (int)(rng() % (genrePool + 3));
+	    StatusType want = mutateCatalog(ref, r, s, g, g2, g3);
+	    output_t<int> changes = ref.getNumberOfGenreChanges(s);
+	    for(size_t e = 0; e < built.size(); e++) {
+		check(names[e] + " mutation " + to_string(r), mutateCatalog(*built[e], r, s, g, g2, g3), want);
+		check(names[e] + " getNumberOfGenreChanges " + to_string(s), built[e]->getNumberOfGenreChanges(s),
+		      changes.status(), changes.ans());
+	    }
+	}
+	for(size_t e = 0; e < built.size() && mismatches == 0; e++) {
+	    compareCatalogs(ref, *built[e], songPool, genrePool, names[e] + " after mutations");
+	}
+	for(Engine* ds : built) delete ds;
+    }
+    printf("build%s seed %llu: %lld catalogs built from %lld records, %lld duplicate genres, %lld duplicate songs,"
+	   " %lld non-positive ids, %lld songs of unknown genres\n", opt.wide ? " (wide)" : "", opt.seed, builds,
+	   records, duplicateGenres, duplicateSongs, invalidIds, unknownGenres);
+    if(mismatches == 0 && (duplicateGenres == 0 || duplicateSongs == 0 || invalidIds == 0 || unknownGenres == 0)) {
+	fprintf(stderr, "build seed %llu: a covered situation never happened, raise --ops\n", opt.seed);
+	return false;
+    }
+    return mismatches == 0;
+}
+
+static bool checkSpill(const Options& opt) {
+    struct Setup {
+	const char* name;
+	size_t cacheBytes;
+	bool direct;
+	int indexPages;
+	int genreSlots;  // to start with, 0 for the pool
+    };
+    const Setup setups[] = {
+	{"one frame", PageCache::page_size, true, 1, 1},
+	{"three frames", 3 * PageCache::page_size, false, 2, 0},
+	{"64 frames", 64 * PageCache::page_size, true, 0, 0},
+    };
+    const char* path = "model_check_spill.dat";
+    // no ids are removed, so the song pool is the capacity and the store never fills up
+    const int songPool = 3000;
+    const int genrePool = 2000;
+    // flushes are rare, so most queued songs wait through several merges
+    const long long flushEvery = 5000;
+    long long overflowPages = 0;
+    long long slotGrowths = 0;     // doublings of the genre slots
+    long long queued = 0;           // queries that queued their song for compression
+    long long mergesOverPending = 0; // merges done while compressions were pending
+    bool ok = true;
+    for(const Setup& setup : setups) {
+	mt19937_64 rng(opt.seed);
+	SpilledDSpotify ds;
+	Model model;
+	// genres not merged away yet. songs and merges mostly go to these, so trees grow
+	// from merges of merges and paths get longer than two links
+	vector<int> live;
+	int genreSlots = setup.genreSlots > 0 ? setup.genreSlots : genrePool;
+	if(ds.create(path, songPool, genreSlots, setup.cacheBytes, setup.direct, setup.indexPages) != StatusType::SUCCESS) {
+	    fprintf(stderr, "spill: could not create %s\n", path);
+	    return false;
+	}
+	auto query = [&](int s, bool changes) {
+	    int before = ds.pendingCompressions();
+	    checkSongQuery(ds, model, s, changes);
+	    if(ds.pendingCompressions() > before) queued++;
+	};
+	auto liveGenre = [&]() {
+	    return live.empty() || rng() % 4 == 0 ? pickId(rng, genrePool) : live[rng() % live.size()];
+	};
+	for(opIndex = 0; opIndex < opt.ops && mismatches == 0; opIndex++) {
+	    if(opIndex % flushEvery == flushEvery - 1) {
+		check("flush", ds.flush(), StatusType::SUCCESS);
+	    }
+	    int r = (int)(rng() % 100);
+	    int s = pickId(rng, songPool);
+	    int want = 0;
+	    if(r < 8) {
+		int g = pickId(rng, genrePool);
+		StatusType st = model.addGenre(g);
+		check("addGenre " + to_string(g), ds.addGenre(g), st);
+		if(st == StatusType::SUCCESS) live.push_back(g);
+	    } else if(r < 50) {
+		int g = liveGenre();
+		check("addSong " + to_string(s) + " " + to_string(g), ds.addSong(s, g), model.addSong(s, g));
+	    } else if(r < 56) {
+		int g1 = liveGenre();
+		int g2 = liveGenre();
+		int g3 = pickId(rng, genrePool);
+		bool pending = ds.pendingCompressions() > 0;
+		StatusType st = model.merge(g1, g2, g3);
+		check("mergeGenres " + to_string(g1) + " " + to_string(g2) + " " + to_string(g3), ds.mergeGenres(g1, g2, g3), st);
+		if(st == StatusType::SUCCESS) {
+		    if(pending) mergesOverPending++;
+		    live.erase(remove_if(live.begin(), live.end(), [&](int id) { return id == g1 || id == g2; }), live.end());
+		    live.push_back(g3);
+		}
+	    } else if(r < 88) {
+		query(s, r % 2 == 1);
+	    } else {
+		int g = liveGenre();
+		StatusType st = model.songCount(g, &want);
+		check("getNumberOfSongsByGenre " + to_string(g), ds.getNumberOfSongsByGenre(g), st, want);
+	    }
+	}
+	// the last batch is compressed here, after the merges of the last stretch
+	check("flush", ds.flush(), StatusType::SUCCESS);
+	for(int s = 1; s <= songPool && mismatches == 0; s++) {
+	    query(s, false);
+	    query(s, true);
+	}
+	const PageCache& cache = ds.pageCache();
+	printf("spill %s seed %llu: %lld ops, %d overflow index pages, %lld hits, %lld misses, %lld writes%s\n",
+	       setup.name, opt.seed, opIndex, ds.overflowPages(), cache.hits(), cache.misses(), cache.writes(),
+	       cache.direct() ? ", direct" : "");
+	if(setup.indexPages > 0) overflowPages += ds.overflowPages();
+	for(int slots = genreSlots; slots < ds.genreCapacity(); slots *= 2) slotGrowths++;
+	ds.close();
+	if(mismatches != 0) {
+	    fprintf(stderr, "spill %s seed %llu: mismatch\n", setup.name, opt.seed);
+	    ok = false;
+	    break;
+	}
+    }
+    remove(path);
+    printf("spill seed %llu: %lld queries queued a compression, %lld merges with compressions pending,"
+	   " %lld genre slot doublings\n", opt.seed, queued, mergesOverPending, slotGrowths);
+    if(ok && (overflowPages == 0 || queued == 0 || mergesOverPending == 0 || slotGrowths == 0)) {
+	fprintf(stderr, "spill seed %llu: a covered situation never happened, raise --ops\n", opt.seed);
+	return false;
+    }
+    return ok;
+}
+
+static bool checkShared(const Options& opt) {
+    mt19937_64 rng(opt.seed);
+    const string name = "/model_check_shared_" + to_string(getpid());
+    const int songPool = 3000;
+    const int genrePool = 2000;
+    const int maxSongs = songPool / 2;
+    SharedDSpotify ds;
+    SharedDSpotify reader;
+    Model model;
+    vector<int> live;
+    if(ds.create(name.c_str(), maxSongs, genrePool) != StatusType::SUCCESS
+       || reader.attach(name.c_str()) != StatusType::SUCCESS) {
+	fprintf(stderr, "shared: could not create and attach %s\n", name.c_str());
+	SharedDSpotify::remove(name.c_str());
+	return false;
+    }
+    int stored = 0;
+    long long full = 0;       // addSongs refused because the segment was full
+    long long unions = 0;     // merges of two non-empty genres
+    long long readOnly = 0;   // mutations the reader handle refused
+    auto liveGenre = [&]() {
+	return live.empty() || rng() % 4 == 0 ? pickId(rng, genrePool) : live[rng() % live.size()];
+    };
+    for(opIndex = 0; opIndex < opt.ops && mismatches == 0; opIndex++) {
+	int r = (int)(rng() % 100);
+	int s = pickId(rng, songPool);
+	int want = 0;
+	if(r < 8) {
+	    int g = pickId(rng, genrePool);
+	    StatusType st = model.addGenre(g);
+	    check("addGenre " + to_string(g), ds.addGenre(g), st);
+	    if(st == StatusType::SUCCESS) live.push_back(g);
+	} else if(r < 50) {
+	    int g = liveGenre();
+	    int genre = 0;
+	    bool fits = model.songGenre(s, &genre) == StatusType::FAILURE && model.songCount(g, &want) == StatusType::SUCCESS;
+	    if(fits && stored == maxSongs) {
+		check("addSong " + to_string(s) + " " + to_string(g) + " (full)", ds.addSong(s, g), StatusType::ALLOCATION_ERROR);
+		full++;
+	    } else {
+		StatusType st = model.addSong(s, g);
+		check("addSong " + to_string(s) + " " + to_string(g), ds.addSong(s, g), st);
+		if(st == StatusType::SUCCESS) stored++;
+	    }
+	} else if(r < 56) {
+	    int g1 = liveGenre();
+	    int g2 = liveGenre();
+	    int g3 = pickId(rng, genrePool);
+	    int c1 = 0;
+	    int c2 = 0;
+	    bool both = model.songCount(g1, &c1) == StatusType::SUCCESS && model.songCount(g2, &c2) == StatusType::SUCCESS
+			&& c1 > 0 && c2 > 0;
+	    StatusType st = model.merge(g1, g2, g3);
+	    check("mergeGenres " + to_string(g1) + " " + to_string(g2) + " " + to_string(g3), ds.mergeGenres(g1, g2, g3), st);
+	    if(st == StatusType::SUCCESS) {
+		if(both) unions++;
+		live.erase(remove_if(live.begin(), live.end(), [&](int id) { return id == g1 || id == g2; }), live.end());
+		live.push_back(g3);
+	    }
+	} else if(r < 88) {
+	    // the reader first, so it walks the path before the writer compresses it
+	    checkSongQuery(reader, model, s, r % 2 == 1);
+	    checkSongQuery(ds, model, s, r % 2 == 1);
+	} else if(r < 98) {
+	    int g = liveGenre();
+	    StatusType st = model.songCount(g, &want);
+	    check("getNumberOfSongsByGenre " + to_string(g), ds.getNumberOfSongsByGenre(g), st, want);
+	    check("reader getNumberOfSongsByGenre " + to_string(g), reader.getNumberOfSongsByGenre(g), st, want);
+	} else {
+	    check("reader addGenre", reader.addGenre(1 + (int)(rng() % genrePool)), StatusType::FAILURE);
+	    readOnly++;
+	}
+    }
+    for(int s = 1; s <= songPool && mismatches == 0; s++) {
+	checkSongQuery(reader, model, s, false);
+	checkSongQuery(reader, model, s, true);
+	checkSongQuery(ds, model, s, false);
+	checkSongQuery(ds, model, s, true);
+    }
+    reader.detach();
+    ds.detach();
+    SharedDSpotify::remove(name.c_str());
+    printf("shared seed %llu: %lld ops, %d songs stored, %lld addSongs refused when full, %lld unions,"
+	   " %lld mutations refused to the reader\n", opt.seed, opIndex, stored, full, unions, readOnly);
+    if(mismatches == 0 && (full == 0 || unions == 0 || readOnly == 0)) {
+	fprintf(stderr, "shared seed %llu: a covered situation never happened, raise --ops\n", opt.seed);
+	return false;
+    }
+    return mismatches == 0;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    for(int i = 1; i < argc; i++) {
+	string a = argv[i];
+	if(i + 1 >= argc) {
+	    fprintf(stderr, "missing value for %s\n", a.c_str());
+	    return 2;
+	}
+	if(a == "--mode") opt.mode = argv[++i];
+	else if(a == "--ops") opt.ops = atoll(argv[++i]);
+	else if(a == "--seed") opt.seed = strtoull(argv[++i], nullptr, 10);
+	else if(a == "--widths" && (string(argv[i + 1]) == "compact" || string(argv[i + 1]) == "wide")) {
+	    opt.wide = string(argv[++i]) == "wide";
+	} else {
+	    fprintf(stderr, "unknown option %s\n", a.c_str());
+	    return 2;
+	}
+    }
+    bool ok;
+    if(opt.mode == "remove") {
+	ok = opt.wide ? checkRemove<BasicDSpotify<dspotify::Wide>>(opt) : checkRemove<DSpotify>(opt);
+    } else if(opt.mode == "songcache") {
+	ok = opt.wide ? checkSongCache<BasicDSpotify<dspotify::Wide>>(opt) : checkSongCache<DSpotify>(opt);
+    } else if(opt.mode == "readview") {
+	ok = opt.wide ? checkReadView<BasicDSpotify<dspotify::Wide>>(opt) : checkReadView<DSpotify>(opt);
+    } else if(opt.mode == "build") {
+	ok = opt.wide ? checkBuild<BasicDSpotify<dspotify::Wide>>(opt) : checkBuild<DSpotify>(opt);
+    } else if(opt.mode == "spill" && !opt.wide) {
+	ok = checkSpill(opt);
+    } else if(opt.mode == "shared" && !opt.wide) {
+	ok = checkShared(opt);
+    } else {
+	fprintf(stderr, "unknown mode %s%s\n", opt.mode.c_str(), opt.wide ? " for wide widths" : "");
+	return 2;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#!/bin/bash
+# Generates workloads with gen_workload.cpp and checks the driver's output against the
+# reference model's expected output, the same way run_all_student_tests.sh checks Inputs/.
+# Then runs model_check.cpp on the operations and settings the driver cannot reach,
+# SpilledDSpotify included.
+# usage: ./run_generated_tests.sh [ops=20000] [seeds=5]
+
+cd "$(dirname "$0")"
+OPS=${1:-20000}
+SEEDS=${2:-5}
+
+echo "🔧 Compiling..."
+g++ -std=c++14 -DNDEBUG -Wall -O2 -o main.out $(ls ../*.cpp) || { echo "❌ Compilation failed"; exit 1; }
+g++ -std=c++14 -Wall -O2 -o gen_workload.out gen_workload.cpp || { echo "❌ Compilation failed"; exit 1; }
+g++ -std=c++14 -DNDEBUG -Wall -O2 -o model_check.out model_check.cpp $(ls ../*.cpp | grep -v main25b2.cpp) \
+  || { echo "❌ Compilation failed"; exit 1; }
+echo "✅ Compilation succeeded."
+
+mkdir -p Generated
+pass=0
+fail=0
+for mode in random deep-merge collide; do
+  for seed in $(seq 1 "$SEEDS"); do
+    base="Generated/${mode}_s${seed}"
+    extra=""
+    # the collision mode is quadratic by design, keep it small
+    if [ "$mode" == "collide" ]; then extra="--ops $((OPS / 4))"; fi
+    ./gen_workload.out --ops "$OPS" --mode "$mode" --seed "$seed" $extra --out "$base"
+    if ./main.out < "$base.in" | diff -q - "$base.out" > /dev/null; then
+      result="✅"
+      ((pass++))
+    else
+      result="❌"
+      ((fail++))
+    fi
+    printf "%-28s Output: %s\n" "$base" "$result"
+  done
+done
+
+# every mode against both engine instantiations
+for mode in remove songcache readview build; do
+  for widths in compact wide; do
+    for seed in $(seq 1 "$SEEDS"); do
+      if ./model_check.out --mode "$mode" --widths "$widths" --ops "$OPS" --seed "$seed" > /dev/null; then
+        result="✅"
+        ((pass++))
+      else
+        result="❌"
+        ((fail++))
+      fi
+      printf "%-34s Model:  %s\n" "model_check ${mode}_${widths}_s${seed}" "$result"
+    done
+  done
+done
+
+# SpilledDSpotify and SharedDSpotify are not templated on the widths
+for mode in spill shared; do
+  for seed in $(seq 1 "$SEEDS"); do
+    if ./model_check.out --mode "$mode" --ops "$OPS" --seed "$seed" > /dev/null; then
+      result="✅"
+      ((pass++))
+    else
+      result="❌"
+      ((fail++))
+    fi
+    printf "%-34s Model:  %s\n" "model_check ${mode}_s${seed}" "$result"
+  done
+done
+
+echo ""
+printf "📊 Summary Report:\n"
+printf "%-20s %d\n" "✅ Tests Passed:" "$pass"
+printf "%-20s %d\n" "❌ Tests Failed:" "$fail"
+[ "$fail" -eq 0 ]
@@ -0,0 +1,37 @@
+#include "trace.h"
+
+#ifdef DSPOTIFY_TRACE
+
+#include <stdio.h>
+
+namespace trace {
+    bool dump(const char* path) {
+	FILE* f = fopen(path, "w");
+	if(f == nullptr) {
+	    return false;
+	}
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	for(Ring* ring = rings().load(); ring != nullptr; ring = ring->next) {
+	    unsigned long long end = ring->head.load(std::memory_order_acquire);
+	    unsigned long long begin = end > (unsigned long long)ring_size ? end - ring_size : 0;
+	    for(unsigned long long i = begin; i < end; i++) {
+		const Event& e = ring->events[i & (ring_size - 1)];
+		fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,\"pid\":1,\"tid\":%d",
+			first ? "" : ",\n", e.name, e.phase, e.ts, ring->tid);
+		if(e.phase == 'i') {
+		    fprintf(f, ",\"s\":\"t\"");
+		}
+		if(e.phase != 'E') {
+		    fprintf(f, ",\"args\":{\"a\":%lld,\"b\":%lld}", e.a, e.b);
+		}
+		fprintf(f, "}");
+		first = false;
+	    }
+	}
+	fprintf(f, "\n]}\n");
+	return fclose(f) == 0;
+    }
+}
+
+#endif /* DSPOTIFY_TRACE */
@@ -0,0 +1,123 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Event tracing for replays, dumped as Chrome trace-event JSON (open it in Perfetto or
+// chrome://tracing). The trace points are only built in when compiling with
+// -DDSPOTIFY_TRACE; otherwise every TRACE_* macro expands to nothing.
+// Built in, tracing still starts disabled: trace::setEnabled(true) turns it on, and a
+// disabled trace point costs one relaxed atomic load.
+//
+//   TRACE_SPAN(name)                 begin/end pair around the enclosing scope
+//   TRACE_SPAN_ARGS(name, a, b)      same, the begin event carries two numbers
+//   TRACE_INSTANT(name, a, b)        a single point in time
+//
+// name must be a string literal (only the pointer is stored).
+
+#ifdef DSPOTIFY_TRACE
+
+#include <atomic>
+#include <chrono>
+
+namespace trace {
+    struct Event {
+	const char* name;
+	long long ts; // microseconds
+	long long a;
+	long long b;
+	char phase;   // 'B' begin, 'E' end, 'i' instant
+    };
+
+    // single-producer ring owned by one thread. when full, the oldest events are overwritten
+    const static int ring_size = 1 << 15;
+    struct Ring {
+	Event events[ring_size];
+	std::atomic<unsigned long long> head; // number of events ever written
+	int tid;
+	Ring* next;
+    };
+
+    inline std::atomic<bool>& enabledFlag() {
+	static std::atomic<bool> enabled(false);
+	return enabled;
+    }
+    // every ring ever created, newest first. rings are never freed, so a thread's events
+    // can still be dumped after it exited
+    inline std::atomic<Ring*>& rings() {
+	static std::atomic<Ring*> head(nullptr);
+	return head;
+    }
+    inline std::chrono::steady_clock::time_point epoch() {
+	static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return start;
+    }
+
+    inline Ring* threadRing() {
+	thread_local Ring* ring = nullptr;
+	if(ring == nullptr) {
+	    static std::atomic<int> nextTid(1);
+	    ring = new Ring();
+	    ring->head.store(0);
+	    ring->tid = nextTid.fetch_add(1);
+	    ring->next = rings().load();
+	    while(!rings().compare_exchange_weak(ring->next, ring)) {
+	    }
+	}
+	return ring;
+    }
+
+    inline void record(const char* name, char phase, long long a, long long b) {
+	Ring* ring = threadRing();
+	unsigned long long h = ring->head.load(std::memory_order_relaxed);
+	Event& e = ring->events[h & (ring_size - 1)];
+	e.name = name;
+	e.ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch()).count();
+	e.a = a;
+	e.b = b;
+	e.phase = phase;
+	ring->head.store(h + 1, std::memory_order_release);
+    }
+
+    inline bool enabled() {
+	return enabledFlag().load(std::memory_order_relaxed);
+    }
+    inline void setEnabled(bool on) {
+	(void)epoch();
+	enabledFlag().store(on);
+    }
+
+    // writes every buffered event to path. call it while no thread is recording, events
+    // written concurrently may come out torn. returns false if the file could not be written
+    bool dump(const char* path);
+
+    class Span {
+    public:
+	Span(const char* n, long long a = 0, long long b = 0) : name(enabled() ? n : nullptr) {
+	    if(name != nullptr) {
+		record(name, 'B', a, b);
+	    }
+	}
+	~Span() {
+	    if(name != nullptr) {
+		record(name, 'E', 0, 0);
+	    }
+	}
+	Span(const Span&) = delete;
+	Span& operator=(const Span&) = delete;
+    private:
+	const char* name;
+    };
+}
+
+#define TRACE_SPAN(name) trace::Span trace_span__(name)
+#define TRACE_SPAN_ARGS(name, a, b) trace::Span trace_span__(name, (a), (b))
+#define TRACE_INSTANT(name, a, b) do { if(trace::enabled()) trace::record(name, 'i', (a), (b)); } while(0)
+
+#else
+
+#define TRACE_SPAN(name) do {} while(0)
+#define TRACE_SPAN_ARGS(name, a, b) do {} while(0)
+#define TRACE_INSTANT(name, a, b) do {} while(0)
+
+#endif /* DSPOTIFY_TRACE */
+
+#endif /* TRACE_H */
@@ -7,6 +7,7 @@
 // #include "hashtable.h"
 // #include "hashtable_doublehashing.h"
 #include "hashtable_chainhashing.h"
+#include "uwu.hpp"
 
 template<class T>
 class Node {
@@ -40,10 +41,18 @@ template<class T>
 int defaultKeyFn(const T& value) {
     return value.id;
 }
-template<class T>
+// W is the engine's widths (see widths.h): the Modefied_ operations work on its songs,
+// genres and tables
+template<class T,class W>
 class UnionFind
 {
 public:
+    typedef BasicSong<W> Song;
+    typedef BasicGenre<W> Genre;
+    typedef BasicSongTable<W> SongTable;
+    typedef BasicGenreTable<W> GenreTable;
+    typedef typename W::count_type count_type;
+
     HashTable<int,Node<T>*> elements;
     int (*keyfn)(const T&);
     //! Default constructor
@@ -75,8 +84,14 @@ public:
     // given two ids, will union the sets that correspond to each value associated with the id. Returns true if there was a union, false otherwise
     bool unionSets(const int id1,const int id2);
     int getAbsoluteRank(int gen) ;
-    int  Modefied_Union(int gen1, int gen2, int gen3 ,shared_ptr< HashTable<int,shared_ptr< Genre>>> Genres); 
-    int Modefied_find(int songid, shared_ptr< HashTable<int,shared_ptr<Song>>> songs) ; 
+    // made, when given, is the Genre object to use for gen3 (so the caller controls where it is allocated)
+    int  Modefied_Union(int gen1, int gen2, int gen3 ,shared_ptr< GenreTable> Genres,
+                        shared_ptr<Genre> made = nullptr); 
+    int Modefied_find(int songid, shared_ptr< SongTable> songs) ; 
+    // read-only Modefied_find: returns the genre of song and writes its total number of
+    // genre changes into changes, at the engine's count width. does no path compression,
+    // so any number of threads may call it at once as long as nobody mutates the forest
+    int Modefied_find_readonly(const Song* song, count_type* changes) const;
     // used to speed implementation. Will return the top most parent of element ele
     // and update the parent of all nodes along the path
     Node<T>* find_root(Node<T>* ele);
@@ -85,8 +100,8 @@ public:
 protected:
 private:
 };
-template<class T>
-int UnionFind<T>::rank(int fleetId) {
+template<class T,class W>
+int UnionFind<T,W>::rank(int fleetId) {
     Node<T>* flt = elements.find(fleetId);
     int rank = 0;
     while(flt != flt->parent) {
@@ -104,8 +119,8 @@ int UnionFind<T>::rank(int fleetId) {
 
 }
 // Helper: Get the absolute "rank" (genre changes so far) from this node to the root.
-template<class T>
-int UnionFind<T>::getAbsoluteRank(int fleetId) {
+template<class T,class W>
+int UnionFind<T,W>::getAbsoluteRank(int fleetId) {
     Node<T>* flt = elements.find(fleetId);
     int sum = 0;
     // walk up to root, accumulating relRank
@@ -118,8 +133,8 @@ int UnionFind<T>::getAbsoluteRank(int fleetId) {
     return sum;
 }
 
-template<class T>
-bool UnionFind<T>::makeSet(const T& value) {
+template<class T,class W>
+bool UnionFind<T,W>::makeSet(const T& value) {
     int id = keyfn(value);
     if(elements.contains(id)) {
 	return false;
@@ -132,8 +147,8 @@ bool UnionFind<T>::makeSet(const T& value) {
     elements.insert(id,n);
     return true;
 }
-template<class T>
-Node<T>* UnionFind<T>::find(const int id) {
+template<class T,class W>
+Node<T>* UnionFind<T,W>::find(const int id) {
     if(!elements.contains(id)) {
 	return nullptr;
     }
@@ -141,8 +156,8 @@ Node<T>* UnionFind<T>::find(const int id) {
     assert(ele != nullptr);
     return find_root(ele);
 }
-template<class T>
-Node<T>* UnionFind<T>::find_root(Node<T>* ele) {
+template<class T,class W>
+Node<T>* UnionFind<T,W>::find_root(Node<T>* ele) {
     assert(ele!=nullptr);
     if(ele != ele->parent) {
 	Node<T>* org_parent = ele->parent;
@@ -153,8 +168,8 @@ Node<T>* UnionFind<T>::find_root(Node<T>* ele) {
     }
     return ele->parent;
 }
-template<class T>
-bool UnionFind<T>::unionSets(const int id1,const int id2) {
+template<class T,class W>
+bool UnionFind<T,W>::unionSets(const int id1,const int id2) {
     Node<T>* big_set = nullptr;
     Node<T>* small_set = nullptr;
     {
@@ -178,25 +193,30 @@ bool UnionFind<T>::unionSets(const int id1,const int id2) {
     return true;
 }
 
-template<class T>
-   int UnionFind<T>::Modefied_find(int songid, shared_ptr< HashTable<int,shared_ptr<Song>>> songs) {
+template<class T,class W>
+   int UnionFind<T,W>::Modefied_find(int songid, shared_ptr< SongTable> songs) {
         auto songNode = songs->find(songid);
         if(songNode == nullptr) {
             return 0;
         }
-        int sum = 0;
+        count_type sum = 0;
+        int depth = 0;
         auto temp1 = songNode ; 
         while(temp1->parent != nullptr) {
             sum += temp1->merges;
             temp1 = temp1->parent;
+            depth++;
+        }
+        if(depth >= 4) {
+            TRACE_INSTANT("UnionFind::deep_find", songid, depth);
         }
 
-        int sub=0;
+        count_type sub=0;
          shared_ptr<Song> temp2 = songNode;
 
         while(temp2->parent != nullptr && temp2->parent != temp1){
             auto temp= temp2;
-            int orgin = temp2->merges;
+            count_type orgin = temp2->merges;
             temp2->merges = sum - sub;
             sub += orgin;
             temp2 = temp2->parent;
@@ -207,8 +227,24 @@ template<class T>
         return temp1->genre_root->id;
     }
 
-template<class T>
- int UnionFind<T>::Modefied_Union(int gen1, int gen2, int gen3 ,shared_ptr< HashTable<int,shared_ptr< Genre>>> Genres) {
+template<class T,class W>
+int UnionFind<T,W>::Modefied_find_readonly(const Song* song, count_type* changes) const {
+    count_type sum = 0;
+    const Song* cur = song;
+    while(cur->parent != nullptr) {
+        sum += cur->merges;
+        cur = cur->parent.get();
+    }
+    // the root's merges count for every song in its tree
+    sum += cur->merges;
+    *changes = sum;
+    if(cur->genre_root == nullptr) return 0;
+    return cur->genre_root->id;
+}
+
+template<class T,class W>
+ int UnionFind<T,W>::Modefied_Union(int gen1, int gen2, int gen3 ,shared_ptr< GenreTable> Genres,
+                                  shared_ptr<Genre> made) {
         auto g1 = Genres->find(gen1);
         auto g2 = Genres->find(gen2);
         auto g3 = Genres->find(gen3);
@@ -217,8 +253,10 @@ template<class T>
             return 0;
         }
         
-        shared_ptr<Genre> newgen =  make_shared<Genre>(gen3);
+        shared_ptr<Genre> newgen = made ? made : make_shared<Genre>(gen3);
         Genres->insert(gen3,newgen);
+        // every song of g1 and g2 is in gen3 now
+        spliceMembers(g1.get(), g2.get(), newgen.get());
         auto song1 = g1->root_in_songs.lock();
         auto song2 = g2->root_in_songs.lock();
         // here we set  and upadte the size ,  whos the parent and whos the root in the union.
@@ -252,6 +290,7 @@ template<class T>
         }
         
         // here we union 
+        TRACE_INSTANT("UnionFind::union", g1->songCount, g2->songCount);
         if(g1->songCount >= g2->songCount){
             song2->parent = song1;
             song2->merges -= song1->merges;
@@ -283,7 +322,7 @@ template<class T>
 
     }
 
-template<class T>
-UnionFind<T>::~UnionFind() noexcept {
+template<class T,class W>
+UnionFind<T,W>::~UnionFind() noexcept {
     }
 #endif /* UNIONFIND_SLOW_H */
@@ -8,9 +8,72 @@ int genreHashKey(const int& j){
     return j; 
 }  
 
-int  genreHashKeyFunction ( const shared_ptr <Genre>& t ) {
+template<class W>
+int  genreHashKeyFunction ( const shared_ptr <BasicGenre<W>>& t ) {
    return t->id ;     
 } 
  int intKey(const int& t){
     return  t; 
- }
\ No newline at end of file
+ }
+
+template<class W>
+void linkMember(BasicGenre<W>* g, BasicSong<W>* s) {
+    BasicSong<W>* first = g->firstMember;
+    if (first == nullptr) {
+        s->nextMember = s;
+        s->prevMember = s;
+        g->firstMember = s;
+        return;
+    }
+    // before first, i.e. at the end of the circle
+    s->nextMember = first;
+    s->prevMember = first->prevMember;
+    first->prevMember->nextMember = s;
+    first->prevMember = s;
+}
+
+template<class W>
+void unlinkMember(BasicGenre<W>* g, BasicSong<W>* s) {
+    if (s->nextMember == s) {
+        g->firstMember = nullptr;
+    } else {
+        if (g->firstMember == s) {
+            g->firstMember = s->nextMember;
+        }
+        s->prevMember->nextMember = s->nextMember;
+        s->nextMember->prevMember = s->prevMember;
+    }
+    s->nextMember = s;
+    s->prevMember = s;
+}
+
+template<class W>
+void spliceMembers(BasicGenre<W>* a, BasicGenre<W>* b, BasicGenre<W>* to) {
+    BasicSong<W>* first = a->firstMember;
+    BasicSong<W>* second = b->firstMember;
+    a->firstMember = nullptr;
+    b->firstMember = nullptr;
+    if (first == nullptr || second == nullptr) {
+        to->firstMember = first != nullptr ? first : second;
+        return;
+    }
+    BasicSong<W>* firstLast = first->prevMember;
+    BasicSong<W>* secondLast = second->prevMember;
+    firstLast->nextMember = second;
+    second->prevMember = firstLast;
+    secondLast->nextMember = first;
+    first->prevMember = secondLast;
+    to->firstMember = first;
+}
+
+// the engine only exists at these two widths
+template int genreHashKeyFunction<dspotify::Compact>(const shared_ptr<BasicGenre<dspotify::Compact>>& t);
+template void linkMember<dspotify::Compact>(BasicGenre<dspotify::Compact>* g, BasicSong<dspotify::Compact>* s);
+template void unlinkMember<dspotify::Compact>(BasicGenre<dspotify::Compact>* g, BasicSong<dspotify::Compact>* s);
+template void spliceMembers<dspotify::Compact>(BasicGenre<dspotify::Compact>* a, BasicGenre<dspotify::Compact>* b,
+                                               BasicGenre<dspotify::Compact>* to);
+template int genreHashKeyFunction<dspotify::Wide>(const shared_ptr<BasicGenre<dspotify::Wide>>& t);
+template void linkMember<dspotify::Wide>(BasicGenre<dspotify::Wide>* g, BasicSong<dspotify::Wide>* s);
+template void unlinkMember<dspotify::Wide>(BasicGenre<dspotify::Wide>* g, BasicSong<dspotify::Wide>* s);
+template void spliceMembers<dspotify::Wide>(BasicGenre<dspotify::Wide>* a, BasicGenre<dspotify::Wide>* b,
+                                            BasicGenre<dspotify::Wide>* to);
@@ -2,31 +2,63 @@
 #pragma once
 #include <iostream>
 #include <memory>
+#include "widths.h"
+#include "hashtable_chainhashing.h"
 
 using namespace std;
 
-class Song ; 
+template<class W> class BasicSong;
 
-class Genre {
+// W is one of the dspotify::Widths, BasicDSpotify<W>::Genre is the engine's instantiation
+template<class W>
+class BasicGenre {
     public:
+    typedef typename W::count_type count_type;
     int id;
-    weak_ptr<Song> root_in_songs ; 
-    int songCount;
+    weak_ptr<BasicSong<W>> root_in_songs ; 
+    count_type songCount;
+    int heapIndex; // position in DSpotify's GenreHeap, -1 when not in it
+    BasicSong<W>* firstMember; // any song of the genre's member list, nullptr when it has no songs
     
-    Genre(int genreId) : id(genreId),root_in_songs(shared_ptr<Song>()) ,songCount(0) {}
+    BasicGenre(int genreId) : id(genreId),root_in_songs(shared_ptr<BasicSong<W>>()) ,songCount(0), heapIndex(-1), firstMember(nullptr) {}
 };
 
 // Song structure
-class Song {
+template<class W>
+class BasicSong {
     public:
+    typedef typename W::count_type count_type;
     int id;
-    int merges;  // The genre this song was originally added to
-    shared_ptr<Song> parent ; 
-    shared_ptr<Genre> genre_root ; 
-    Song(int songId, int when_merged) : id(songId) ,merges(when_merged),parent(nullptr) , genre_root(nullptr)  {}
+    count_type merges;  // The genre this song was originally added to
+    shared_ptr<BasicSong> parent ; 
+    shared_ptr<BasicGenre<W>> genre_root ; 
+    // circular doubly linked list of the songs currently in the same genre. not owning,
+    // the songs table owns the songs. a removed song is unlinked and points to itself
+    BasicSong* nextMember;
+    BasicSong* prevMember;
+    // this song's record in the DSpotify's ReadViewVersions, -1 while it has none
+    int viewRecord;
+    BasicSong(int songId, count_type when_merged) : id(songId) ,merges(when_merged),parent(nullptr) , genre_root(nullptr),
+        nextMember(this), prevMember(this), viewRecord(-1) {}
 };
 
+// the engine's tables, indexed with W's width
+template<class W>
+using BasicSongTable = HashTable<int,shared_ptr<BasicSong<W>>,typename W::index_type>;
+template<class W>
+using BasicGenreTable = HashTable<int,shared_ptr<BasicGenre<W>>,typename W::index_type>;
+
+// member list helpers, all O(1). instantiated in uwu.cpp for both widths
+template<class W>
+void linkMember(BasicGenre<W>* g, BasicSong<W>* s);
+template<class W>
+void unlinkMember(BasicGenre<W>* g, BasicSong<W>* s);
+// joins the member lists of a and b (either may be empty) into one into `to`, leaving a and b empty
+template<class W>
+void spliceMembers(BasicGenre<W>* a, BasicGenre<W>* b, BasicGenre<W>* to);
+
 int songHashKey(const int & e) ; 
 int genreHashKey(const int& j); 
-int genreHashKeyFunction ( const shared_ptr <Genre>& t ) ;
+template<class W>
+int genreHashKeyFunction ( const shared_ptr <BasicGenre<W>>& t ) ;
 int intKey(const int& t) ;  
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef WIDTHS_H
+#define WIDTHS_H
+
+#include <stdint.h>
+
+// Integer widths of the engine, a template parameter of BasicDSpotify and everything it is
+// made of. count_type holds Genre::songCount and Song::merges, index_type the HashTable
+// len/capacity and bucket positions. Ids stay int: the public API takes and returns int
+// ids. Both instantiations are compiled into every build (see the end of
+// dspotify25b2.cpp), DSpotify is the compact one.
+namespace dspotify {
+    template<class Count,class Index>
+    struct Widths {
+	typedef Count count_type;
+	typedef Index index_type;
+    };
+
+    // 32-bit: the compact layout, enough below 2^31 songs
+    typedef Widths<int32_t,int32_t> Compact;
+    // 64-bit: no count or table index can overflow, 8 more bytes per Song
+    typedef Widths<int64_t,int64_t> Wide;
+}
+
+#endif // WIDTHS_H